@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Synthetic SWF files for the benchmarks, written through the public writer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "corpus.h"
+
+#define TAG_SIZE (64 * 1024)
+#define SMALL_TAGS 32       ///< Small tags between each large one
+
+typedef struct {
+    SWFTag tag;
+    uint8_t payload[TAG_SIZE];
+    uint64_t seed;
+    size_t remaining;       ///< Bytes of tag payload left to generate
+    unsigned n;             ///< Tags generated so far
+} TagSource;
+
+static const char *const words[] = {
+    "_root.", "gotoAndPlay(", "this.", "stop();", "var ", "function ", "onEnterFrame",
+    "= new Array(", "); ", "\n", "if (", ") {", "}", "_x += ", "_alpha", "0.5", "trace(",
+};
+
+static uint32_t next_random(uint64_t *seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 33;
+}
+
+static SWFError write_cb(void *ctx, const void *buf, size_t len) {
+    MemFile *out = ctx;
+    if (out->pos + len > out->alloc) {
+        size_t alloc = out->alloc ? out->alloc : 1 << 20;
+        while (alloc < out->pos + len)
+            alloc *= 2;
+        uint8_t *data = realloc(out->data, alloc);
+        if (!data)
+            return SWF_NOMEM;
+        out->data = data;
+        out->alloc = alloc;
+    }
+    memcpy(out->data + out->pos, buf, len);
+    out->pos += len;
+    if (out->pos > out->size)
+        out->size = out->pos;
+    return SWF_OK;
+}
+
+static SWFError seek_cb(void *ctx, uint64_t offset) {
+    ((MemFile*)ctx)->pos = offset;
+    return SWF_OK;
+}
+
+static SWFError next_tag(SWFWriter *writer, SWFTag **tag, void *ctx) {
+    TagSource *source = ctx;
+    SWFTag *t = &source->tag;
+    unsigned n = source->n++;
+    if (!source->remaining) {
+        *tag = NULL;
+        return SWF_OK;
+    }
+    memset(t, 0, sizeof(*t));
+    t->payload = source->payload;
+    if (n % (SMALL_TAGS + 1) < SMALL_TAGS) {
+        // Runs of small tags, like the placements in a frame, so per-tag
+        // overhead shows up as well as per-byte costs
+        if (n % (SMALL_TAGS + 1) == SMALL_TAGS - 1) {
+            t->type = SWF_SHOW_FRAME;
+        } else {
+            t->type = SWF_PLACE_OBJECT_2;
+            t->size = 4 + next_random(&source->seed) % 28;
+            for (uint32_t i = 0; i < t->size; i++)
+                t->payload[i] = next_random(&source->seed);
+        }
+    } else {
+        switch (n / (SMALL_TAGS + 1) % 4) {
+        case 0:
+        case 1:
+            // Script source: repetitive, compresses very well
+            t->type = SWF_DO_ACTION;
+            break;
+        case 2:
+            // ARGB gradient with a little noise
+            t->type = SWF_DEFINE_BITS_LOSSLESS;
+            t->id = n;
+            break;
+        default:
+            // Mostly incompressible: random bytes and random nibbles
+            t->type = SWF_DEFINE_BINARY_DATA;
+            t->id = n;
+            break;
+        }
+        t->size = TAG_SIZE;
+    }
+    if (t->size > source->remaining)
+        t->size = source->remaining;
+    switch (t->type) {
+    case SWF_DO_ACTION:
+        for (uint32_t i = 0; i < t->size;) {
+            const char *word = words[next_random(&source->seed) % (sizeof(words) / sizeof(*words))];
+            size_t len = strlen(word);
+            if (len > t->size - i)
+                len = t->size - i;
+            memcpy(t->payload + i, word, len);
+            i += len;
+        }
+        break;
+    case SWF_DEFINE_BITS_LOSSLESS:
+        for (uint32_t i = 0; i < t->size; i++)
+            t->payload[i] = (i & 3) ? (uint8_t)((i >> 2) % 640 + (next_random(&source->seed) & 7)) : 0xFF;
+        break;
+    case SWF_DEFINE_BINARY_DATA:
+        for (uint32_t i = 0; i < t->size; i++) {
+            uint32_t r = next_random(&source->seed);
+            t->payload[i] = r & (r & 0x100 ? 0xFF : 0x0F);
+        }
+        break;
+    default:
+        break;
+    }
+    source->remaining -= t->size;
+    *tag = t;
+    return SWF_OK;
+}
+
+SWFError make_corpus(MemFile *out, SWFCompression compression, size_t size, int level) {
+    static TagSource source;
+    SWFWriterOutput output = { .write = write_cb, .seek = seek_cb, .ctx = out };
+    SWFWriterSettings settings = { .compression = compression, .level = level };
+    SWF *swf = swf_init();
+    SWFWriter *writer = swf_writer_init(&output, &settings);
+    SWFError ret = SWF_NOMEM;
+    if (swf && writer) {
+        swf->version = 13;
+        swf->frame_size.x_max = 550 * 20;
+        swf->frame_size.y_max = 400 * 20;
+        swf->frame_rate = 24 << 8;
+        source.seed = 1;
+        source.remaining = size;
+        source.n = 0;
+        if ((ret = swf_writer_write_stream(writer, swf, next_tag, &source)) < 0)
+            fprintf(stderr, "Writing corpus: %s\n", swf_writer_get_error(writer)->text);
+    }
+    swf_writer_free(writer);
+    swf_free(swf);
+    return ret;
+}
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "swf.h"
+
+/**
+ * \brief An SWF file written to memory
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t alloc;           ///< Space allocated for data
+    size_t pos;             ///< Write position
+} MemFile;
+
+/**
+ * \brief Writes a synthetic SWF to out. Its tags mix script text, which
+ * compresses very well, gradient bitmaps, and mostly incompressible
+ * binary data. The same size always gives the same body.
+ * \param[out] out         Where to write the file; free out->data when done
+ * \param[in]  compression Compression to write the body with
+ * \param[in]  size        Total size of the tags' payloads
+ * \param[in]  level       Compression level, or -1 for the default
+ * \return < 0 if something went wrong; the error has been printed.
+ */
+SWFError make_corpus(MemFile *out, SWFCompression compression, size_t size, int level);
+
+/**
+ * \brief Reads a monotonic clock, in seconds
+ */
+double now(void);
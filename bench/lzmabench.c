@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * lzmabench: compares the LZMA decoding kernels on a synthetic ZWS file,
+ * which mixes well- and poorly-compressed stretches (see corpus.c). Each
+ * kernel decodes it whole with swf_parse_memory, and in 64KB pieces through
+ * an SWFParser; the best of several runs is reported in MB/s of
+ * decompressed data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "corpus.h"
+
+#define CHUNK_SIZE (64 * 1024)
+
+static SWFError parse_whole(const MemFile *in, uint32_t *size) {
+    SWF *swf;
+    SWFError ret = swf_parse_memory(in->data, in->size, 0, NULL, &swf);
+    if (swf)
+        *size = swf->size;
+    swf_free(swf);
+    return ret;
+}
+
+static SWFError parse_chunked(const MemFile *in, uint32_t *size) {
+    SWFParser *parser = swf_parser_init();
+    SWFError ret = SWF_NOMEM;
+    if (!parser)
+        return ret;
+    for (size_t pos = 0; pos < in->size; pos += CHUNK_SIZE) {
+        size_t len = in->size - pos < CHUNK_SIZE ? in->size - pos : CHUNK_SIZE;
+        if ((ret = swf_parser_append(parser, in->data + pos, len)) < 0 || ret == SWF_FINISHED)
+            break;
+    }
+    *size = swf_parser_get_swf(parser)->size;
+    swf_free(swf_parser_get_swf(parser));
+    swf_parser_free(parser);
+    return ret == SWF_FINISHED ? SWF_OK : ret < 0 ? ret : SWF_INVALID;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s MB     Decompressed size of the corpus (default: 32)\n"
+            "  -l LEVEL  LZMA level to write it with (default: 5)\n"
+            "  -n N      Runs per kernel and mode; the best is reported (default: 5)\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct {
+        SWFLzmaKernel kernel;
+        const char *name;
+    } kernels[] = {
+        { SWF_LZMA_KERNEL_REFERENCE, "reference" },
+        { SWF_LZMA_KERNEL_FAST, "fast" },
+    };
+    static const struct {
+        SWFError (*parse)(const MemFile*, uint32_t*);
+        const char *name;
+    } modes[] = {
+        { parse_whole, "memory" },
+        { parse_chunked, "chunked" },
+    };
+    size_t size = 32;
+    int level = 5, runs = 5, c;
+    while ((c = getopt(argc, argv, "s:l:n:")) != -1) {
+        switch (c) {
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            level = atoi(optarg);
+            break;
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!size || runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    MemFile corpus = { 0 };
+    if (make_corpus(&corpus, SWF_LZMA, size << 20, level) < 0)
+        return 1;
+    printf("corpus: %zu bytes compressed, %zu decompressed\n", corpus.size, size << 20);
+
+    int ret = 0;
+    for (unsigned k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+        if (swf_set_lzma_kernel(kernels[k].kernel) < 0) {
+            printf("%-10s unavailable\n", kernels[k].name);
+            continue;
+        }
+        for (unsigned m = 0; m < sizeof(modes) / sizeof(*modes); m++) {
+            double best = 0;
+            uint32_t out_size = 0;
+            for (int i = 0; i < runs; i++) {
+                double start = now();
+                if (modes[m].parse(&corpus, &out_size) < 0) {
+                    fprintf(stderr, "%s/%s: parse failed\n", kernels[k].name, modes[m].name);
+                    ret = 1;
+                    break;
+                }
+                double elapsed = now() - start;
+                if (!best || elapsed < best)
+                    best = elapsed;
+            }
+            if (best)
+                printf("%-10s %-8s %8.1f MB/s\n", kernels[k].name, modes[m].name, out_size / best / 1e6);
+        }
+    }
+    swf_set_lzma_kernel(SWF_LZMA_KERNEL_AUTO);
+    free(corpus.data);
+    return ret;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * parsebench: measures SWFParser throughput on synthetic files (see
+ * corpus.c), for each compression, append size, and way of keeping tags:
+ * "retain" leaves them to swf_add_tag, as an SWF that's kept whole would,
+ * and "callback" frees each one from tag_cb, as a streaming consumer would.
+ * Prints one CSV row per combination, with the best of several runs, so
+ * results can be compared between builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "corpus.h"
+
+static const size_t chunk_sizes[] = { 512, 4096, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+
+/**
+ * \brief Gets the decompressed size from a file's header
+ */
+static uint32_t declared_size(const MemFile *file) {
+    return file->data[4] | file->data[5] << 8 | file->data[6] << 16 | (uint32_t)file->data[7] << 24;
+}
+
+static SWFError free_tag(SWFParser *parser, void *data, void *ctx) {
+    swf_tag_free(data);
+    return SWF_OK;
+}
+
+/**
+ * \brief Parses in, appending chunk bytes at a time.
+ * \param[out] elapsed Seconds spent in swf_parser_append
+ * \param[out] tags    Number of tags parsed
+ */
+static SWFError parse(const MemFile *in, size_t chunk, int retain, double *elapsed, uint64_t *tags) {
+    SWFParserCallbacks callbacks = { .tag_cb = free_tag };
+    SWFParser *parser = swf_parser_init();
+    SWFError ret = SWF_NOMEM;
+    if (!parser)
+        return ret;
+    if (!retain)
+        swf_parser_set_callbacks(parser, &callbacks);
+    double start = now();
+    for (size_t pos = 0; pos < in->size; pos += chunk) {
+        size_t len = in->size - pos < chunk ? in->size - pos : chunk;
+        if ((ret = swf_parser_append(parser, in->data + pos, len)) < 0 || ret == SWF_FINISHED)
+            break;
+    }
+    *elapsed = now() - start;
+    if (ret < 0)
+        fprintf(stderr, "%s\n", swf_parser_get_error(parser)->text);
+
+    SWFParserStats stats;
+    swf_parser_get_stats(parser, &stats);
+    *tags = 0;
+    for (unsigned i = 0; i < SWF_PARSER_STATS_TAG_TYPES; i++)
+        *tags += stats.tag_counts[i];
+    swf_free(swf_parser_get_swf(parser));
+    swf_parser_free(parser);
+    return ret == SWF_FINISHED ? SWF_OK : ret < 0 ? ret : SWF_INVALID;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s MB     Decompressed size of each file (default: 16)\n"
+            "  -c MODES  Compressions to test, from F, C and Z (default: FCZ)\n"
+            "  -n N      Runs per combination; the best is reported (default: 3)\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *compressions = "FCZ";
+    size_t size = 16;
+    int runs = 3, c;
+    while ((c = getopt(argc, argv, "s:c:n:")) != -1) {
+        switch (c) {
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            compressions = optarg;
+            break;
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!size || runs < 1 || strspn(compressions, "FCZ") != strlen(compressions)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int ret = 0;
+    printf("compression,chunk_size,retention,compressed_bytes,decompressed_bytes,tags,"
+           "seconds,compressed_mb_s,decompressed_mb_s,tags_per_s\n");
+    for (const char *comp = compressions; *comp; comp++) {
+        MemFile file = { 0 };
+        if (make_corpus(&file, *comp, size << 20, -1) < 0) {
+            fprintf(stderr, "%cWS: skipped\n", *comp);
+            free(file.data);
+            continue;
+        }
+        uint32_t decompressed = declared_size(&file);
+        for (unsigned i = 0; i < sizeof(chunk_sizes) / sizeof(*chunk_sizes); i++) {
+            for (int retain = 0; retain < 2; retain++) {
+                double best = 0, elapsed;
+                uint64_t tags = 0;
+                for (int run = 0; run < runs; run++) {
+                    if (parse(&file, chunk_sizes[i], retain, &elapsed, &tags) < 0) {
+                        fprintf(stderr, "%cWS, %zu-byte chunks: parse failed\n", *comp, chunk_sizes[i]);
+                        ret = 1;
+                        best = 0;
+                        break;
+                    }
+                    if (!best || elapsed < best)
+                        best = elapsed;
+                }
+                if (best)
+                    printf("%cWS,%zu,%s,%zu,%u,%llu,%.6f,%.2f,%.2f,%.0f\n", *comp, chunk_sizes[i],
+                           retain ? "retain" : "callback", file.size, decompressed,
+                           (unsigned long long)tags, best, file.size / best / 1e6,
+                           decompressed / best / 1e6, tags / best);
+            }
+        }
+        free(file.data);
+    }
+    return ret;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Parsing of many files at once, for swf_batch.
+ * Every file is known up front, so rather than per-worker queues, workers
+ * take the next file off one list sorted largest-first. A big file can't
+ * be picked up last and leave one worker running long after the rest have
+ * run out of work.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#if HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#define READ_SIZE (256 * 1024)
+
+typedef struct {
+    SWFBatchItem **items;       ///< Sorted largest-first
+    unsigned nb_items;
+    unsigned next;              ///< Next item for a worker to take
+    const SWFBatchSettings *settings;
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+#endif
+} BatchPool;
+
+/**
+ * \brief Per-worker state, kept across files
+ */
+typedef struct {
+    BatchPool *pool;
+    SWFParser *parser;          ///< Reset between files, so its buffers are reused
+    uint8_t *data;              ///< Read buffer, READ_SIZE bytes
+} BatchWorker;
+
+static SWFError feed_file(SWFParser *parser, FILE *file, uint8_t *data, SWFErrorDesc *err) {
+    for (;;) {
+        size_t read = fread(data, 1, READ_SIZE, file);
+        if (!read)
+            return ferror(file) ? set_error(err, SWF_UNKNOWN, "swf_batch: Error reading file")
+                                : set_error(err, SWF_INVALID, "swf_batch: File is truncated");
+        SWFError ret = swf_parser_append(parser, data, read);
+        if (ret < 0 || ret == SWF_FINISHED)
+            return ret;
+    }
+}
+
+static void parse_item(BatchWorker *worker, SWFBatchItem *item) {
+    const SWFBatchSettings *settings = worker->pool->settings;
+    SWFErrorDesc err = { 0 };
+    SWF *swf = NULL;
+    SWFParser *parser = worker->parser;
+    if (!parser) {
+        if (!(parser = worker->parser = swf_parser_init())) {
+            set_error(&err, SWF_NOMEM, "swf_batch: Not enough memory to allocate parser");
+            goto done;
+        }
+        swf_parser_set_flags(parser, settings->parser_flags);
+        if (settings->callbacks)
+            swf_parser_set_callbacks(parser, settings->callbacks);
+        swf_parser_set_limits(parser, settings->limits);
+    } else if (swf_parser_reset(parser) < 0) {
+        err = *swf_parser_get_error(parser);
+        goto done;
+    }
+    swf = swf_parser_get_swf(parser);
+
+    SWFError ret = SWF_OK;
+    if (item->path) {
+        FILE *file = fopen(item->path, "rb");
+        if (!file) {
+            set_error(&err, SWF_UNKNOWN, "swf_batch: Couldn't open file");
+            goto done;
+        }
+        ret = feed_file(parser, file, worker->data, &err);
+        fclose(file);
+    } else {
+        ret = swf_parser_append(parser, item->data, item->size);
+        if (ret >= 0 && ret != SWF_FINISHED)
+            ret = set_error(&err, SWF_INVALID, "swf_batch: File is truncated");
+    }
+    if (ret < 0 && !err.code)
+        err = *swf_parser_get_error(parser);
+
+done:
+    if (settings->done_cb)
+        settings->done_cb(item, swf, &err, settings->ctx);
+    else
+        swf_free(swf);
+}
+
+static void *batch_worker(void *arg) {
+    BatchWorker *worker = arg;
+    BatchPool *pool = worker->pool;
+    for (;;) {
+#if HAVE_THREADS
+        pthread_mutex_lock(&pool->lock);
+#endif
+        unsigned i = pool->next < pool->nb_items ? pool->next++ : pool->nb_items;
+#if HAVE_THREADS
+        pthread_mutex_unlock(&pool->lock);
+#endif
+        if (i == pool->nb_items)
+            return NULL;
+        parse_item(worker, pool->items[i]);
+    }
+}
+
+static int compare_items(const void *a, const void *b) {
+    size_t size_a = (*(SWFBatchItem* const*)a)->size, size_b = (*(SWFBatchItem* const*)b)->size;
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+SWFError swf_batch(SWFBatchItem *items, unsigned nb_items, const SWFBatchSettings *settings) {
+    SWFError ret = SWF_OK;
+    BatchPool pool = { .nb_items = nb_items, .settings = settings };
+    if (!nb_items)
+        return SWF_OK;
+    if (!(pool.items = malloc(nb_items * sizeof(SWFBatchItem*))))
+        return SWF_NOMEM;
+    for (unsigned i = 0; i < nb_items; i++) {
+        SWFBatchItem *item = pool.items[i] = items + i;
+        struct stat st;
+        if (item->path && !item->size && !stat(item->path, &st))
+            item->size = st.st_size;
+    }
+    qsort(pool.items, nb_items, sizeof(SWFBatchItem*), compare_items);
+
+    unsigned threads = settings->threads ? settings->threads : 1;
+#if HAVE_THREADS
+    if (threads > nb_items)
+        threads = nb_items;
+#else
+    threads = 1;
+#endif
+    BatchWorker *workers = calloc(threads, sizeof(BatchWorker));
+    if (!workers) {
+        free(pool.items);
+        return SWF_NOMEM;
+    }
+    unsigned nb_workers = 0;
+    for (; nb_workers < threads; nb_workers++) {
+        workers[nb_workers].pool = &pool;
+        if (!(workers[nb_workers].data = malloc(READ_SIZE)))
+            break;
+    }
+    if (!nb_workers) {
+        ret = SWF_NOMEM;
+        goto end;
+    }
+
+#if HAVE_THREADS
+    pthread_t *thread_ids = NULL;
+    unsigned nb_threads = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    // The calling thread is one of the workers
+    if (nb_workers > 1 && (thread_ids = malloc((nb_workers - 1) * sizeof(pthread_t))))
+        while (nb_threads < nb_workers - 1 &&
+               !pthread_create(thread_ids + nb_threads, NULL, batch_worker, workers + nb_threads + 1))
+            nb_threads++;
+    batch_worker(workers);
+    for (unsigned i = 0; i < nb_threads; i++)
+        pthread_join(thread_ids[i], NULL);
+    free(thread_ids);
+    pthread_mutex_destroy(&pool.lock);
+#else
+    batch_worker(workers);
+#endif
+
+end:
+    for (unsigned i = 0; i < threads; i++) {
+        if (workers[i].parser)
+            swf_parser_free(workers[i].parser);
+        free(workers[i].data);
+    }
+    free(workers);
+    free(pool.items);
+    return ret;
+}
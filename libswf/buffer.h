@@ -19,6 +19,7 @@
 #pragma once
 
 #include "internal.h"
+#include "trace.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -30,17 +31,46 @@ typedef struct {
     size_t alloc_size;
     size_t rollback;
     int index;
+    SWFParserStats *stats;  ///< Counters to update, or NULL; kept by buf_free
+    const SWFParserTrace *trace; ///< Hooks to call, or NULL; kept by buf_free
+    size_t max_size;        ///< Largest allocation allowed, or 0 for any; kept by buf_free
 } Buffer;
 
 static inline void buf_free(Buffer *buffer) {
+    SWFParserStats *stats = buffer->stats;
+    const SWFParserTrace *trace = buffer->trace;
+    size_t max_size = buffer->max_size;
     if (buffer->alloc_ptr) {
         free(buffer->alloc_ptr);
     }
     memset(buffer, 0, sizeof(Buffer));
+    buffer->stats = stats;
+    buffer->trace = trace;
+    buffer->max_size = max_size;
+}
+
+/**
+ * \brief Picks a size to grow a buffer to: want, if max_size allows,
+ * but never less than need.
+ */
+static inline size_t buf_clamp(const Buffer *buffer, size_t want, size_t need) {
+    if (buffer->max_size && want > buffer->max_size)
+        want = buffer->max_size;
+    return want > need ? want : need;
+}
+
+/**
+ * \brief Records buffer->alloc_size in buffer->stats, if it's the largest yet.
+ */
+static inline void buf_update_peak(Buffer *buffer) {
+    if (buffer->stats && buffer->alloc_size > buffer->stats->peak_buffer_size)
+        buffer->stats->peak_buffer_size = buffer->alloc_size;
 }
 
 static inline SWFError buf_init(Buffer *buffer, size_t size) {
     buf_free(buffer);
+    if (buffer->max_size && size > buffer->max_size)
+        return set_error(buffer, SWF_LIMIT, "buf_init: size is over the parser's limits");
     uint8_t *new_buf = malloc(size);
     if (!new_buf)
         return SWF_NOMEM;
@@ -48,6 +78,7 @@ static inline SWFError buf_init(Buffer *buffer, size_t size) {
     buffer->alloc_size = size;
     buffer->size = 0;
     buffer->index = 0;
+    buf_update_peak(buffer);
     return SWF_OK;
 }
 
@@ -63,7 +94,7 @@ static inline uint64_t buf_get_bits(Buffer *buf, unsigned nb_bits) {
     for (unsigned i = 7; i >= inv_read; --i) {
         if (i == inv_read && (nb_bits & 7) <= 8 - bits)
             break;
-        tmp |= (int64_t)buf->ptr[bytes++] << (i << 3);
+        tmp |= (uint64_t)buf->ptr[bytes++] << (i << 3);
     }
 
     buf->index += nb_bits;
@@ -73,7 +104,7 @@ static inline uint64_t buf_get_bits(Buffer *buf, unsigned nb_bits) {
 
 static inline int64_t buf_get_sbits(Buffer *buf, int nb_bits) {
     uint64_t tmp = buf_get_bits(buf, nb_bits);
-    if (tmp >> (nb_bits - 1))
+    if (nb_bits && tmp >> (nb_bits - 1))
         tmp |= (0xFFFFFFFFFFFFFFFF >> nb_bits) << nb_bits;
     return (int64_t)tmp;
 }
@@ -94,13 +125,22 @@ static inline SWFError buf_init_with_data(Buffer *buffer, const uint8_t *data, s
 static inline SWFError buf_grow_to(Buffer *buffer, size_t size) {
     if (size <= buffer->size)
         return set_error(buffer, SWF_INTERNAL_ERROR, "buf_grow_to: size <= buffer->size");
+    if (buffer->max_size && size > buffer->max_size)
+        return set_error(buffer, SWF_LIMIT, "buf_grow_to: size is over the parser's limits");
     uint8_t *new_buf = malloc(size);
     if (!new_buf)
         return set_error(buffer, SWF_NOMEM, "buf_grow_to: malloc failed");
     memcpy(new_buf, buffer->ptr, buffer->size);
     free(buffer->alloc_ptr);
+    if (buffer->trace)
+        trace_buffer_grow(buffer->trace, buffer->alloc_size, size, buffer->size);
     buffer->alloc_ptr = buffer->ptr = new_buf;
     buffer->alloc_size = size;
+    if (buffer->stats) {
+        buffer->stats->nb_buffer_grows++;
+        buffer->stats->buffer_grow_bytes += size;
+    }
+    buf_update_peak(buffer);
     return SWF_OK;
 }
 
@@ -115,8 +155,11 @@ static inline SWFError buf_grow_by(Buffer *buffer, size_t add) {
  */
 static inline size_t buf_shift(Buffer *buffer) {
     if (buffer->ptr > buffer->alloc_ptr) {
-        if (buffer->size)
+        if (buffer->size) {
             memmove(buffer->alloc_ptr, buffer->ptr, buffer->size);
+            if (buffer->stats)
+                buffer->stats->shifted_bytes += buffer->size;
+        }
         buffer->ptr = buffer->alloc_ptr;
     }
     return buffer->alloc_size - buffer->size;
@@ -138,8 +181,10 @@ static inline SWFError buf_append(Buffer *buffer, const uint8_t *add, size_t siz
         buf_append_raw(buffer, add, size);
         return SWF_OK;
     }
-    // We have a buffer, but it's not big enough. Allocate a new one.
-    if ((ret = buf_grow_by(buffer, size)))
+    // We have a buffer, but it's not big enough. Allocate a new one, at
+    // least twice as big, so many small appends cost linear copying.
+    size_t need = buffer->size + size, want = buffer->alloc_size * 2;
+    if ((ret = buf_grow_to(buffer, buf_clamp(buffer, want > need ? want : need, need))))
         return ret;
     buf_append_raw(buffer, add, size);
     return SWF_OK;
@@ -170,7 +215,7 @@ static inline void buf_finish_bit_access(Buffer *buf) {
 static inline SWFError buf_grow(Buffer *buffer, unsigned factor) {
     if (factor < 2)
         return set_error(buffer, SWF_INTERNAL_ERROR, "buf_grow: factor < 2");
-    return buf_grow_to(buffer, buffer->alloc_size * factor);
+    return buf_grow_to(buffer, buf_clamp(buffer, buffer->alloc_size * factor, buffer->size + 1));
 }
 
 static inline void buf_clear_rollback(Buffer *buffer) {
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_KEYFRAME_INTERVAL 64
+
+/**
+ * \brief Copy of the display list as it was after a given frame
+ */
+typedef struct {
+    SWFDisplayObject *objects;
+    unsigned nb_objects;
+    int valid;
+} DisplaySnapshot;
+
+/**
+ * \brief Private data used when simulating a display list
+ */
+struct SWF_DisplayList {
+    SWFErrorDesc err;           ///< Last error that occurred on this SWFDisplayList
+    SWFTag *tags;               ///< Timeline's tags
+    SWFFrame *frames;           ///< Timeline's frame index
+    unsigned nb_frames;
+    int frame;                  ///< Last frame applied; -1 before the first
+    SWFDisplayObject *objects;  ///< Current display list, sorted by depth
+    unsigned nb_objects;
+    unsigned max_objects;
+    SWFDisplayChange *changes;  ///< Changes made by the last frame applied
+    unsigned nb_changes;
+    unsigned max_changes;
+    unsigned keyframe_interval;
+    DisplaySnapshot *keyframes; ///< keyframes[k] is the state after frame k * keyframe_interval
+    unsigned nb_keyframes;
+};
+
+static const SWFMatrix identity_matrix = {
+    .scale_x = 1 << 16,
+    .scale_y = 1 << 16,
+};
+
+static const SWFColorTransform identity_cxform = {
+    .mult = { 256, 256, 256, 256 },
+};
+
+static void parse_matrix(Reader *rd, SWFMatrix *matrix) {
+    unsigned nb_bits;
+    *matrix = identity_matrix;
+    if (rd_bits(rd, 1)) {
+        nb_bits = rd_bits(rd, 5);
+        matrix->scale_x = rd_sbits(rd, nb_bits);
+        matrix->scale_y = rd_sbits(rd, nb_bits);
+    }
+    if (rd_bits(rd, 1)) {
+        nb_bits = rd_bits(rd, 5);
+        matrix->rotate_skew_0 = rd_sbits(rd, nb_bits);
+        matrix->rotate_skew_1 = rd_sbits(rd, nb_bits);
+    }
+    nb_bits = rd_bits(rd, 5);
+    matrix->translate_x = rd_sbits(rd, nb_bits);
+    matrix->translate_y = rd_sbits(rd, nb_bits);
+    rd_align(rd);
+}
+
+static void parse_cxform(Reader *rd, SWFColorTransform *cxform, int alpha) {
+    *cxform = identity_cxform;
+    int has_add = rd_bits(rd, 1), has_mult = rd_bits(rd, 1);
+    unsigned nb_bits = rd_bits(rd, 4), nb_terms = alpha ? 4 : 3;
+    if (has_mult)
+        for (unsigned i = 0; i < nb_terms; i++)
+            cxform->mult[i] = rd_sbits(rd, nb_bits);
+    if (has_add)
+        for (unsigned i = 0; i < nb_terms; i++)
+            cxform->add[i] = rd_sbits(rd, nb_bits);
+    rd_align(rd);
+}
+
+/**
+ * \brief Finds the index of depth in dl->objects, or where it would be inserted.
+ */
+static unsigned find_depth(SWFDisplayObject *objects, unsigned nb_objects, uint16_t depth) {
+    unsigned lo = 0, hi = nb_objects;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (objects[mid].depth < depth)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static SWFError add_change(SWFDisplayList *dl, SWFDisplayChangeType type, SWFDisplayObject *obj) {
+    if (dl->nb_changes == dl->max_changes) {
+        unsigned max_changes = dl->max_changes ? dl->max_changes * 2 : 16;
+        SWFDisplayChange *changes = realloc(dl->changes, max_changes * sizeof(SWFDisplayChange));
+        if (!changes)
+            return set_error(dl, SWF_NOMEM, "add_change: Not enough memory to expand change list");
+        dl->changes = changes;
+        dl->max_changes = max_changes;
+    }
+    dl->changes[dl->nb_changes++] = (SWFDisplayChange){
+        .type = type,
+        .object = *obj,
+    };
+    return SWF_OK;
+}
+
+static SWFError remove_depth(SWFDisplayList *dl, uint16_t depth) {
+    unsigned i = find_depth(dl->objects, dl->nb_objects, depth);
+    if (i == dl->nb_objects || dl->objects[i].depth != depth)
+        return SWF_OK;
+    SWFError ret = add_change(dl, SWF_DISPLAY_REMOVE, dl->objects + i);
+    dl->nb_objects--;
+    memmove(dl->objects + i, dl->objects + i + 1, (dl->nb_objects - i) * sizeof(SWFDisplayObject));
+    return ret;
+}
+
+/**
+ * \brief Gets the object at depth, inserting a blank one if there isn't one.
+ */
+static SWFError get_depth(SWFDisplayList *dl, uint16_t depth, SWFDisplayObject **out, int *existed) {
+    unsigned i = find_depth(dl->objects, dl->nb_objects, depth);
+    if (i < dl->nb_objects && dl->objects[i].depth == depth) {
+        *existed = 1;
+        *out = dl->objects + i;
+        return SWF_OK;
+    }
+    if (dl->nb_objects == dl->max_objects) {
+        unsigned max_objects = dl->max_objects ? dl->max_objects * 2 : 16;
+        SWFDisplayObject *objects = realloc(dl->objects, max_objects * sizeof(SWFDisplayObject));
+        if (!objects)
+            return set_error(dl, SWF_NOMEM, "get_depth: Not enough memory to expand display list");
+        dl->objects = objects;
+        dl->max_objects = max_objects;
+    }
+    memmove(dl->objects + i + 1, dl->objects + i, (dl->nb_objects - i) * sizeof(SWFDisplayObject));
+    dl->nb_objects++;
+    dl->objects[i] = (SWFDisplayObject){
+        .depth = depth,
+        .matrix = identity_matrix,
+        .cxform = identity_cxform,
+    };
+    *existed = 0;
+    *out = dl->objects + i;
+    return SWF_OK;
+}
+
+static SWFError apply_place(SWFDisplayList *dl, SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    SWFDisplayObject *obj;
+    Reader rd;
+    int existed;
+    rd_init(&rd, tag->payload, tag->size);
+    if (tag->type == SWF_PLACE_OBJECT) {
+        uint16_t character = rd_16(&rd), depth = rd_16(&rd);
+        if (rd.overrun)
+            return SWF_OK;
+        if ((ret = remove_depth(dl, depth)) || (ret = get_depth(dl, depth, &obj, &existed)))
+            return ret;
+        obj->character = character;
+        parse_matrix(&rd, &obj->matrix);
+        if (rd_left(&rd))
+            parse_cxform(&rd, &obj->cxform, 0);
+        return add_change(dl, SWF_DISPLAY_PLACE, obj);
+    }
+    uint8_t flags = rd_8(&rd), flags2 = 0;
+    if (tag->type == SWF_PLACE_OBJECT_3)
+        flags2 = rd_8(&rd);
+    uint16_t depth = rd_16(&rd);
+    int move = flags & 0x01, has_character = flags & 0x02;
+    if (rd.overrun)
+        return SWF_OK;
+    if (flags2 & 0x08 || (flags2 & 0x10 && has_character)) {
+        size_t len;
+        rd_string(&rd, &len); // ClassName
+    }
+    uint16_t character = has_character ? rd_16(&rd) : 0;
+    if (!has_character) {
+        // This can only modify an existing object
+        unsigned i = find_depth(dl->objects, dl->nb_objects, depth);
+        if (!move || i == dl->nb_objects || dl->objects[i].depth != depth)
+            return SWF_OK;
+    }
+    if (!move && (ret = remove_depth(dl, depth)))
+        return ret;
+    if ((ret = get_depth(dl, depth, &obj, &existed)))
+        return ret;
+    if (has_character)
+        obj->character = character;
+    if (flags & 0x04)
+        parse_matrix(&rd, &obj->matrix);
+    if (flags & 0x08)
+        parse_cxform(&rd, &obj->cxform, 1);
+    if (flags & 0x10)
+        obj->ratio = rd_16(&rd);
+    if (flags & 0x20) {
+        size_t len;
+        rd_string(&rd, &len); // Name
+    }
+    if (flags & 0x40)
+        obj->clip_depth = rd_16(&rd);
+    return add_change(dl, existed ? SWF_DISPLAY_MODIFY : SWF_DISPLAY_PLACE, obj);
+}
+
+static SWFError apply_frame(SWFDisplayList *dl, unsigned n) {
+    SWFError ret = SWF_OK;
+    unsigned first = n ? dl->frames[n - 1].tag + 1 : 0, end = dl->frames[n].tag + 1;
+    dl->nb_changes = 0;
+    for (unsigned i = first; i < end; i++) {
+        SWFTag *tag = dl->tags + i;
+        Reader rd;
+        rd_init(&rd, tag->payload, tag->size);
+        switch (tag->type) {
+        case SWF_PLACE_OBJECT:
+        case SWF_PLACE_OBJECT_2:
+        case SWF_PLACE_OBJECT_3:
+            ret = apply_place(dl, tag);
+            break;
+        case SWF_REMOVE_OBJECT:
+            rd_16(&rd); // CharacterId
+            // Fall through
+        case SWF_REMOVE_OBJECT_2:
+            {
+                uint16_t depth = rd_16(&rd);
+                if (!rd.overrun)
+                    ret = remove_depth(dl, depth);
+            }
+            break;
+        default:
+            break;
+        }
+        if (ret < 0)
+            return ret;
+    }
+    dl->frame = n;
+    return SWF_OK;
+}
+
+static SWFError save_keyframe(SWFDisplayList *dl) {
+    unsigned k = dl->frame / dl->keyframe_interval;
+    if (dl->frame % dl->keyframe_interval || (k < dl->nb_keyframes && dl->keyframes[k].valid))
+        return SWF_OK;
+    if (k >= dl->nb_keyframes) {
+        unsigned nb_keyframes = (dl->nb_frames + dl->keyframe_interval - 1) / dl->keyframe_interval;
+        DisplaySnapshot *keyframes = realloc(dl->keyframes, nb_keyframes * sizeof(DisplaySnapshot));
+        if (!keyframes)
+            return set_error(dl, SWF_NOMEM, "save_keyframe: Not enough memory to expand keyframe list");
+        memset(keyframes + dl->nb_keyframes, 0, (nb_keyframes - dl->nb_keyframes) * sizeof(DisplaySnapshot));
+        dl->keyframes = keyframes;
+        dl->nb_keyframes = nb_keyframes;
+    }
+    DisplaySnapshot *snap = dl->keyframes + k;
+    snap->objects = malloc((dl->nb_objects ? dl->nb_objects : 1) * sizeof(SWFDisplayObject));
+    if (!snap->objects)
+        return set_error(dl, SWF_NOMEM, "save_keyframe: Not enough memory to allocate snapshot");
+    memcpy(snap->objects, dl->objects, dl->nb_objects * sizeof(SWFDisplayObject));
+    snap->nb_objects = dl->nb_objects;
+    snap->valid = 1;
+    return SWF_OK;
+}
+
+static SWFError restore_keyframe(SWFDisplayList *dl, unsigned k) {
+    DisplaySnapshot *snap = dl->keyframes + k;
+    if (snap->nb_objects > dl->max_objects) {
+        SWFDisplayObject *objects = realloc(dl->objects, snap->nb_objects * sizeof(SWFDisplayObject));
+        if (!objects)
+            return set_error(dl, SWF_NOMEM, "restore_keyframe: Not enough memory to expand display list");
+        dl->objects = objects;
+        dl->max_objects = snap->nb_objects;
+    }
+    memcpy(dl->objects, snap->objects, snap->nb_objects * sizeof(SWFDisplayObject));
+    dl->nb_objects = snap->nb_objects;
+    dl->frame = k * dl->keyframe_interval;
+    dl->nb_changes = 0;
+    return SWF_OK;
+}
+
+SWFDisplayList *swf_display_list_init(SWF *swf, SWFSprite *sprite, unsigned keyframe_interval) {
+    SWFDisplayList *out = calloc(1, sizeof(SWFDisplayList));
+    if (!out)
+        return NULL;
+    if (sprite) {
+        out->tags = sprite->tags;
+        out->frames = sprite->frames;
+        out->nb_frames = sprite->nb_frames;
+    } else {
+        out->tags = swf->tags;
+        out->frames = swf->frames;
+        out->nb_frames = swf->nb_frames;
+    }
+    out->frame = -1;
+    out->keyframe_interval = keyframe_interval ? keyframe_interval : DEFAULT_KEYFRAME_INTERVAL;
+    return out;
+}
+
+SWFError swf_display_list_next_frame(SWFDisplayList *dl, const SWFDisplayChange **changes,
+                                     unsigned *nb_changes) {
+    SWFError ret = SWF_OK;
+    if (dl->frame + 1 >= (int)dl->nb_frames)
+        return SWF_FINISHED;
+    if ((ret = apply_frame(dl, dl->frame + 1)) || (ret = save_keyframe(dl)))
+        return ret;
+    if (changes)
+        *changes = dl->changes;
+    if (nb_changes)
+        *nb_changes = dl->nb_changes;
+    return SWF_OK;
+}
+
+SWFError swf_display_list_seek(SWFDisplayList *dl, unsigned frame) {
+    SWFError ret = SWF_OK;
+    if (frame >= dl->nb_frames)
+        return set_error(dl, SWF_INVALID, "swf_display_list_seek: No such frame");
+    if ((int)frame == dl->frame)
+        return SWF_OK;
+    // Start from the nearest snapshot at or before the target, unless
+    // the current state is closer
+    unsigned k = frame / dl->keyframe_interval;
+    if (k >= dl->nb_keyframes)
+        k = dl->nb_keyframes ? dl->nb_keyframes - 1 : 0;
+    while (k > 0 && !dl->keyframes[k].valid)
+        k--;
+    if (dl->nb_keyframes && dl->keyframes[k].valid &&
+        ((int)frame < dl->frame || (int)(k * dl->keyframe_interval) > dl->frame)) {
+        if ((ret = restore_keyframe(dl, k)))
+            return ret;
+    } else if ((int)frame < dl->frame) {
+        dl->frame = -1;
+        dl->nb_objects = 0;
+    }
+    while (dl->frame < (int)frame)
+        if ((ret = swf_display_list_next_frame(dl, NULL, NULL)) < 0)
+            return ret;
+    dl->nb_changes = 0;
+    return SWF_OK;
+}
+
+const SWFDisplayObject *swf_display_list_get_objects(SWFDisplayList *dl, unsigned *nb_objects) {
+    *nb_objects = dl->nb_objects;
+    return dl->objects;
+}
+
+int swf_display_list_get_frame(SWFDisplayList *dl) {
+    return dl->frame;
+}
+
+SWFErrorDesc *swf_display_list_get_error(SWFDisplayList *dl) {
+    return &dl->err;
+}
+
+void swf_display_list_free(SWFDisplayList *dl) {
+    if (!dl)
+        return;
+    for (unsigned i = 0; i < dl->nb_keyframes; i++)
+        free(dl->keyframes[i].objects);
+    free(dl->keyframes);
+    free(dl->objects);
+    free(dl->changes);
+    free(dl);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "internal.h"
+
+// XXH64, so hashes can be reproduced with any xxHash implementation
+
+#define PRIME_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME_5 UINT64_C(0x27D4EB2F165667C5)
+
+static inline uint64_t rotl(uint64_t x, unsigned r) {
+    return x << r | x >> (64 - r);
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * PRIME_2, 31) * PRIME_1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t val) {
+    return (acc ^ hash_round(0, val)) * PRIME_1 + PRIME_4;
+}
+
+uint64_t hash_64(const uint8_t *data, size_t len) {
+    const uint8_t *end = data + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = PRIME_1 + PRIME_2, v2 = PRIME_2, v3 = 0, v4 = -PRIME_1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = hash_round(v1, read_64((uint8_t*)data));
+            v2 = hash_round(v2, read_64((uint8_t*)data + 8));
+            v3 = hash_round(v3, read_64((uint8_t*)data + 16));
+            v4 = hash_round(v4, read_64((uint8_t*)data + 24));
+            data += 32;
+        } while (data <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    } else {
+        h = PRIME_5;
+    }
+    h += len;
+    for (; data + 8 <= end; data += 8)
+        h = rotl(h ^ hash_round(0, read_64((uint8_t*)data)), 27) * PRIME_1 + PRIME_4;
+    if (data + 4 <= end) {
+        h = rotl(h ^ read_32((uint8_t*)data) * PRIME_1, 23) * PRIME_2 + PRIME_3;
+        data += 4;
+    }
+    for (; data < end; data++)
+        h = rotl(h ^ *data * PRIME_5, 11) * PRIME_1;
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Lookup tables that swf_add_tag keeps up to date as tags are added.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NB_SYMBOL_KINDS 3
+
+/**
+ * \brief A name interned in SymbolTable.names, and the ID it maps to for each SWFSymbolKind
+ */
+typedef struct {
+    uint32_t offset;                ///< Offset of the name in SymbolTable.names
+    uint32_t len;                   ///< Length of the name, not including the NUL
+    uint32_t hash;
+    int32_t ids[NB_SYMBOL_KINDS];   ///< -1 if the name isn't used for that kind
+} SymbolName;
+
+/**
+ * \brief Slot in SymbolTable.by_id
+ */
+typedef struct {
+    uint32_t entry;         ///< Entry index + 1; 0 if the slot is empty
+    uint16_t id;
+    uint8_t kind;
+} SymbolID;
+
+/**
+ * \brief Name <-> ID tables built from SymbolClass, ExportAssets and ImportAssets tags
+ */
+typedef struct SWF_SymbolTable {
+    char *names;            ///< Arena holding every interned name, NUL-terminated
+    size_t names_size;
+    size_t max_names_size;
+    SymbolName *entries;
+    unsigned nb_entries;
+    unsigned max_entries;
+    uint32_t *by_name;      ///< Hash table of entry indices + 1, keyed by name
+    unsigned max_by_name;
+    SymbolID *by_id;        ///< Hash table of entries keyed by kind and ID
+    unsigned nb_by_id;
+    unsigned max_by_id;
+} SymbolTable;
+
+static inline uint32_t hash_id(uint16_t id) {
+    return id * 0x9E3779B1u;
+}
+
+static inline uint32_t hash_name(const char *name, size_t len) {
+    // FNV-1a
+    uint32_t hash = 0x811C9DC5u;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)name[i]) * 0x01000193u;
+    return hash;
+}
+
+/**
+ * \brief Gets the ID of the character a tag defines; 0 if it doesn't.
+ * DefineBinaryData and DefineFont4 keep theirs at the start of the payload,
+ * since it's followed by a reserved field rather than the tag's contents.
+ */
+static uint16_t character_id(const SWFTag *tag) {
+    switch (tag->type) {
+    case SWF_DEFINE_BINARY_DATA:
+    case SWF_DEFINE_FONT_4:
+        return tag->size >= 2 ? read_16(tag->payload) : 0;
+    default:
+        return tag->id;
+    }
+}
+
+/**
+ * \brief Finds the slot for id in swf->characters: either the one holding
+ * it, or the empty one where it would be inserted.
+ */
+static uint32_t *find_character(SWF *swf, uint16_t id) {
+    unsigned mask = swf->max_characters - 1;
+    for (unsigned i = hash_id(id) >> 16 & mask;; i = (i + 1) & mask) {
+        uint32_t *slot = swf->characters + i;
+        if (!*slot || character_id(swf->tags + *slot - 1) == id)
+            return slot;
+    }
+}
+
+static SWFError grow_characters(SWF *swf) {
+    unsigned old_max = swf->max_characters;
+    uint32_t *old = swf->characters;
+    unsigned max = old_max ? old_max * 2 : 64;
+    uint32_t *characters = calloc(max, sizeof(uint32_t));
+    if (!characters)
+        return set_error(swf, SWF_NOMEM, "grow_characters: Not enough memory to expand character table");
+    swf->characters = characters;
+    swf->max_characters = max;
+    for (unsigned i = 0; i < old_max; i++)
+        if (old[i])
+            *find_character(swf, character_id(swf->tags + old[i] - 1)) = old[i];
+    free(old);
+    return SWF_OK;
+}
+
+static SWFError index_character(SWF *swf, unsigned index) {
+    SWFError ret = SWF_OK;
+    // Keep the load factor at or under 1/2, so probe sequences stay short
+    if ((swf->nb_characters + 1) * 2 > swf->max_characters &&
+        (ret = grow_characters(swf)))
+        return ret;
+    uint32_t *slot = find_character(swf, character_id(swf->tags + index));
+    if (*slot)
+        // The player ignores redefinitions of an ID; so do we
+        return SWF_OK;
+    *slot = index + 1;
+    swf->nb_characters++;
+    return SWF_OK;
+}
+
+static SWFError index_frame(SWF *swf, unsigned index) {
+    if (swf->nb_frames == swf->max_frames) {
+        unsigned max_frames = swf->max_frames ? swf->max_frames * 2 : 16;
+        SWFFrame *frames = realloc(swf->frames, max_frames * sizeof(SWFFrame));
+        if (!frames)
+            return set_error(swf, SWF_NOMEM, "index_frame: Not enough memory to expand SWFFrame array");
+        swf->frames = frames;
+        swf->max_frames = max_frames;
+    }
+    swf->frames[swf->nb_frames++] = (SWFFrame){
+        .tag = index,
+        .offset = swf->tags[index].offset,
+    };
+    return SWF_OK;
+}
+
+static uint32_t *find_name(SymbolTable *tab, const char *name, size_t len, uint32_t hash) {
+    unsigned mask = tab->max_by_name - 1;
+    for (unsigned i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t *slot = tab->by_name + i;
+        if (!*slot)
+            return slot;
+        SymbolName *entry = tab->entries + *slot - 1;
+        // Lengths first, so memcmp never reads past the end of a shorter name
+        if (entry->hash == hash && entry->len == len && !memcmp(tab->names + entry->offset, name, len))
+            return slot;
+    }
+}
+
+static SymbolID *find_id(SymbolTable *tab, SWFSymbolKind kind, uint16_t id) {
+    unsigned mask = tab->max_by_id - 1;
+    for (unsigned i = (hash_id(id) >> 16 ^ kind) & mask;; i = (i + 1) & mask) {
+        SymbolID *slot = tab->by_id + i;
+        if (!slot->entry || (slot->kind == kind && slot->id == id))
+            return slot;
+    }
+}
+
+static SWFError grow_symbols(SWF *swf, SymbolTable *tab) {
+    if ((tab->nb_entries + 1) * 2 > tab->max_by_name) {
+        unsigned max = tab->max_by_name ? tab->max_by_name * 2 : 64;
+        uint32_t *by_name = calloc(max, sizeof(uint32_t));
+        if (!by_name)
+            return set_error(swf, SWF_NOMEM, "grow_symbols: Not enough memory to expand name table");
+        free(tab->by_name);
+        tab->by_name = by_name;
+        tab->max_by_name = max;
+        for (unsigned i = 0; i < tab->nb_entries; i++) {
+            SymbolName *entry = tab->entries + i;
+            *find_name(tab, tab->names + entry->offset, entry->len, entry->hash) = i + 1;
+        }
+    }
+    if ((tab->nb_by_id + 1) * 2 > tab->max_by_id) {
+        unsigned old_max = tab->max_by_id;
+        SymbolID *old = tab->by_id;
+        unsigned max = old_max ? old_max * 2 : 64;
+        SymbolID *by_id = calloc(max, sizeof(SymbolID));
+        if (!by_id)
+            return set_error(swf, SWF_NOMEM, "grow_symbols: Not enough memory to expand ID table");
+        tab->by_id = by_id;
+        tab->max_by_id = max;
+        for (unsigned i = 0; i < old_max; i++)
+            if (old[i].entry)
+                *find_id(tab, old[i].kind, old[i].id) = old[i];
+        free(old);
+    }
+    if (tab->nb_entries == tab->max_entries) {
+        unsigned max = tab->max_entries ? tab->max_entries * 2 : 16;
+        SymbolName *entries = realloc(tab->entries, max * sizeof(SymbolName));
+        if (!entries)
+            return set_error(swf, SWF_NOMEM, "grow_symbols: Not enough memory to expand symbol list");
+        tab->entries = entries;
+        tab->max_entries = max;
+    }
+    return SWF_OK;
+}
+
+static SWFError add_symbol(SWF *swf, SWFSymbolKind kind, uint16_t id, const char *name, size_t len) {
+    SWFError ret = SWF_OK;
+    SymbolTable *tab = swf->symbols;
+    if ((ret = grow_symbols(swf, tab)))
+        return ret;
+    uint32_t hash = hash_name(name, len);
+    uint32_t *slot = find_name(tab, name, len, hash);
+    if (!*slot) {
+        // Intern the name
+        if (tab->names_size + len + 1 > tab->max_names_size) {
+            size_t max = tab->max_names_size ? tab->max_names_size * 2 : 1024;
+            while (max < tab->names_size + len + 1)
+                max *= 2;
+            char *names = realloc(tab->names, max);
+            if (!names)
+                return set_error(swf, SWF_NOMEM, "add_symbol: Not enough memory to expand name arena");
+            tab->names = names;
+            tab->max_names_size = max;
+        }
+        SymbolName *entry = tab->entries + tab->nb_entries;
+        entry->offset = tab->names_size;
+        entry->len = len;
+        entry->hash = hash;
+        for (unsigned i = 0; i < NB_SYMBOL_KINDS; i++)
+            entry->ids[i] = -1;
+        memcpy(tab->names + tab->names_size, name, len);
+        tab->names[tab->names_size + len] = 0;
+        tab->names_size += len + 1;
+        *slot = ++tab->nb_entries;
+    }
+    SymbolName *entry = tab->entries + *slot - 1;
+    // First mapping wins, in both directions
+    if (entry->ids[kind] < 0)
+        entry->ids[kind] = id;
+    SymbolID *id_slot = find_id(tab, kind, id);
+    if (!id_slot->entry) {
+        *id_slot = (SymbolID){ .entry = *slot, .id = id, .kind = kind };
+        tab->nb_by_id++;
+    }
+    return SWF_OK;
+}
+
+static SWFError index_symbols(SWF *swf, SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    SWFSymbolKind kind;
+    Reader rd;
+    size_t len;
+    if (!swf->symbols && !(swf->symbols = calloc(1, sizeof(SymbolTable))))
+        return set_error(swf, SWF_NOMEM, "index_symbols: Not enough memory to allocate symbol table");
+    rd_init(&rd, tag->payload, tag->size);
+    switch (tag->type) {
+    case SWF_SYMBOL_CLASS:
+        kind = SWF_SYMBOL_CLASS_NAME;
+        break;
+    case SWF_EXPORT_ASSETS:
+        kind = SWF_SYMBOL_EXPORT;
+        break;
+    case SWF_IMPORT_ASSETS_2:
+        rd_string(&rd, &len); // URL
+        rd_16(&rd); // Reserved
+        kind = SWF_SYMBOL_IMPORT;
+        break;
+    default:
+        rd_string(&rd, &len); // URL
+        kind = SWF_SYMBOL_IMPORT;
+        break;
+    }
+    unsigned count = rd_16(&rd);
+    for (unsigned i = 0; i < count; i++) {
+        uint16_t id = rd_16(&rd);
+        const char *name = rd_string(&rd, &len);
+        if (!name)
+            // Truncated; keep what we've got
+            break;
+        if ((ret = add_symbol(swf, kind, id, name, len)))
+            return ret;
+    }
+    return SWF_OK;
+}
+
+SWFError index_tag(SWF *swf, unsigned index) {
+    SWFTag *tag = swf->tags + index;
+    switch (tag->type) {
+    case SWF_SHOW_FRAME:
+        return index_frame(swf, index);
+    case SWF_SYMBOL_CLASS:
+    case SWF_EXPORT_ASSETS:
+    case SWF_IMPORT_ASSETS:
+    case SWF_IMPORT_ASSETS_2:
+        return index_symbols(swf, tag);
+    default:
+        if (character_id(tag))
+            return index_character(swf, index);
+        return SWF_OK;
+    }
+}
+
+void index_free(SWF *swf) {
+    if (swf->symbols) {
+        free(swf->symbols->names);
+        free(swf->symbols->entries);
+        free(swf->symbols->by_name);
+        free(swf->symbols->by_id);
+        free(swf->symbols);
+        swf->symbols = NULL;
+    }
+    free(swf->frames);
+    swf->frames = NULL;
+    swf->nb_frames = swf->max_frames = 0;
+    free(swf->characters);
+    swf->characters = NULL;
+    swf->nb_characters = swf->max_characters = 0;
+}
+
+SWFTag *swf_get_character(SWF *swf, uint16_t id) {
+    if (!id || !swf->max_characters)
+        return NULL;
+    uint32_t *slot = find_character(swf, id);
+    return *slot ? swf->tags + *slot - 1 : NULL;
+}
+
+static SWFError frame_tag_range(SWFFrame *frames, unsigned nb_frames, unsigned n,
+                                unsigned *first, unsigned *end) {
+    if (n >= nb_frames)
+        return SWF_INVALID;
+    *first = n ? frames[n - 1].tag + 1 : 0;
+    *end = frames[n].tag + 1;
+    return SWF_OK;
+}
+
+SWFError swf_frame_tag_range(SWF *swf, unsigned n, unsigned *first, unsigned *end) {
+    if (frame_tag_range(swf->frames, swf->nb_frames, n, first, end))
+        return set_error(swf, SWF_INVALID, "swf_frame_tag_range: No such frame");
+    return SWF_OK;
+}
+
+SWFError swf_sprite_frame_tag_range(SWFSprite *sprite, unsigned n, unsigned *first, unsigned *end) {
+    return frame_tag_range(sprite->frames, sprite->nb_frames, n, first, end);
+}
+
+int swf_get_symbol_id(SWF *swf, SWFSymbolKind kind, const char *name) {
+    SymbolTable *tab = swf->symbols;
+    if (!tab || !tab->nb_entries || kind >= NB_SYMBOL_KINDS)
+        return -1;
+    size_t len = strlen(name);
+    uint32_t *slot = find_name(tab, name, len, hash_name(name, len));
+    return *slot ? tab->entries[*slot - 1].ids[kind] : -1;
+}
+
+const char *swf_get_symbol_name(SWF *swf, SWFSymbolKind kind, uint16_t id) {
+    SymbolTable *tab = swf->symbols;
+    if (!tab || !tab->nb_by_id || kind >= NB_SYMBOL_KINDS)
+        return NULL;
+    SymbolID *slot = find_id(tab, kind, id);
+    return slot->entry ? tab->names + tab->entries[slot->entry - 1].offset : NULL;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Backends for inflating a whole CWS body in one call, picked with
+ * configure's --with-inflate. Streaming always goes through zlib.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "parser.h"
+
+#if HAVE_LIBZ
+
+#if HAVE_LIBDEFLATE
+#include <libdeflate.h>
+
+static SWFError libdeflate_decode_all(z_stream *zstrm, void *err, uint8_t *out, size_t out_size, size_t *produced) {
+    struct libdeflate_decompressor *dec = libdeflate_alloc_decompressor();
+    if (!dec)
+        return set_error(err, SWF_NOMEM, "libdeflate_decode_all: libdeflate_alloc_decompressor failed");
+    size_t in_used, out_used;
+    enum libdeflate_result res = libdeflate_zlib_decompress_ex(dec, zstrm->next_in, zstrm->avail_in,
+                                                               out, out_size, &in_used, &out_used);
+    libdeflate_free_decompressor(dec);
+    *produced = 0;
+    if (res != LIBDEFLATE_SUCCESS)
+        // Truncated input, a body larger than declared, or bad data: in
+        // every case, leave it to zlib to stream through from the start
+        return SWF_NEED_MORE_DATA;
+    *produced = out_used;
+    zstrm->next_in += in_used;
+    zstrm->avail_in -= in_used;
+    return SWF_OK;
+}
+
+const InflateBackend inflate_backend = {
+    .name = "libdeflate",
+    .decode_all = libdeflate_decode_all,
+};
+
+#else
+
+static SWFError zlib_decode_all(z_stream *zstrm, void *err, uint8_t *out, size_t out_size, size_t *produced) {
+    zstrm->next_out = out;
+    zstrm->avail_out = out_size;
+    // With Z_FINISH and room for everything, inflate writes straight to
+    // the output without keeping a window
+    int z_ret = inflate(zstrm, Z_FINISH);
+    *produced = out_size - zstrm->avail_out;
+    switch (z_ret) {
+    case Z_STREAM_END:
+        return SWF_OK;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        // Input ran out, or the body is larger than declared; the stream
+        // carries on from here
+        return SWF_NEED_MORE_DATA;
+    case Z_DATA_ERROR:
+        return set_error(err, SWF_INVALID, zstrm->msg);
+    case Z_MEM_ERROR:
+        return set_error(err, SWF_NOMEM, zstrm->msg);
+    default:
+        return set_error(err, SWF_UNKNOWN, zstrm->msg);
+    }
+}
+
+const InflateBackend inflate_backend = {
+    .name = "zlib",
+    .decode_all = zlib_decode_all,
+};
+
+#endif
+
+#endif
@@ -24,6 +24,48 @@
 
 extern ISzAlloc allocator;
 
+/// \private
+void sprite_free(SWFSprite *sprite);
+
+/// \private
+SWFError index_tag(SWF *swf, unsigned index);
+
+/// \private
+void index_free(SWF *swf);
+
+/// \private
+static inline int tag_has_id(uint16_t code) {
+    // These types start with a 2-byte ID, which is pulled out of the payload
+    switch (code) {
+    case SWF_DEFINE_SHAPE:
+    case SWF_DEFINE_BITS:
+    case SWF_DEFINE_BUTTON:
+    case SWF_DEFINE_FONT:
+    case SWF_DEFINE_TEXT:
+    case SWF_DEFINE_SOUND:
+    case SWF_DEFINE_BITS_LOSSLESS:
+    case SWF_DEFINE_BITS_JPEG_2:
+    case SWF_DEFINE_SHAPE_2:
+    case SWF_DEFINE_SHAPE_3:
+    case SWF_DEFINE_TEXT_2:
+    case SWF_DEFINE_BUTTON_2:
+    case SWF_DEFINE_BITS_JPEG_3:
+    case SWF_DEFINE_BITS_LOSSLESS_2:
+    case SWF_DEFINE_EDIT_TEXT:
+    case SWF_DEFINE_SPRITE:
+    case SWF_DEFINE_MORPH_SHAPE:
+    case SWF_DEFINE_FONT_2:
+    case SWF_DEFINE_VIDEO_STREAM:
+    case SWF_DEFINE_FONT_3:
+    case SWF_DEFINE_SHAPE_4:
+    case SWF_DEFINE_MORPH_SHAPE_2:
+    case SWF_DEFINE_BITS_JPEG_4:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 /// \private
 static inline SWFError set_error(void *parent, SWFError err, const char *text) {
     SWFErrorDesc *desc = ((SWFErrorDesc*)parent);
@@ -42,6 +84,9 @@ static inline SWFError copy_error(void *parent, void *child, SWFError err) {
     return err;
 }
 
+/// \private
+uint64_t hash_64(const uint8_t *data, size_t len);
+
 /// \private
 static inline uint16_t read_16(uint8_t *buf) {
     return (uint16_t)buf[1] << 8 | (uint16_t)buf[0];
@@ -54,7 +99,7 @@ static inline uint32_t read_32(uint8_t *buf) {
 
 /// \private
 static inline uint64_t read_64(uint8_t *buf) {
-    return (uint64_t)buf[7] << 56 | (uint64_t)buf[6] << 48 | (uint64_t)buf[5] << 40 | (uint64_t)buf[4] << 32 *
+    return (uint64_t)buf[7] << 56 | (uint64_t)buf[6] << 48 | (uint64_t)buf[5] << 40 | (uint64_t)buf[4] << 32 |
            (uint64_t)buf[3] << 24 | (uint64_t)buf[2] << 16 | (uint64_t)buf[1] << 8  | (uint64_t)buf[0];
 }
 
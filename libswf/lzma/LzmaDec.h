@@ -224,6 +224,15 @@ SRes LzmaDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
     const Byte *propData, unsigned propSize, ELzmaFinishMode finishMode,
     ELzmaStatus *status, ISzAlloc *alloc);
 
+/* ---------- Kernel selection ---------- */
+
+/* LzmaDec_SetFast picks the decoding kernel every decoder uses from then on:
+   the optimized one for x86-64 and AArch64 if fast != 0, or the portable
+   reference one otherwise. The optimized one is the default where it's built.
+   Returns 0 if the requested kernel isn't built in. */
+
+int LzmaDec_SetFast(int fast);
+
 #ifdef __cplusplus
 }
 #endif
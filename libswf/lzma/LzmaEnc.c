@@ -2160,6 +2160,7 @@ static SRes LzmaEnc_Encode2(CLzmaEnc *p, ICompressProgress *progress)
   int i = 0;
   for (i = 0; i < 16; i++)
     allocaDummy[i] = (Byte)i;
+  (void)allocaDummy;
   #endif
 
   for (;;)
@@ -0,0 +1,155 @@
+/* Threads.c -- multithreading library
+2009-09-20 : Igor Pavlov : Public domain
+POSIX threads port for libswf */
+
+#include <errno.h>
+
+#include "Threads.h"
+
+static void *ThreadStartRoutine(void *arg)
+{
+  CThread *p = (CThread *)arg;
+  p->func(p->param);
+  return NULL;
+}
+
+WRes Thread_Create(CThread *p, THREAD_FUNC_TYPE func, void *param)
+{
+  WRes res;
+  p->func = func;
+  p->param = param;
+  res = pthread_create(&p->handle, NULL, ThreadStartRoutine, p);
+  if (res == 0)
+    p->created = 1;
+  return res;
+}
+
+WRes Thread_Wait(CThread *p)
+{
+  if (!p->created)
+    return EINVAL;
+  return pthread_join(p->handle, NULL);
+}
+
+WRes Thread_Close(CThread *p)
+{
+  p->created = 0;
+  return 0;
+}
+
+static WRes Event_Create(CEvent *p, int manualReset, int signaled)
+{
+  WRes res = pthread_mutex_init(&p->mutex, NULL);
+  if (res != 0)
+    return res;
+  if ((res = pthread_cond_init(&p->cond, NULL)) != 0)
+  {
+    pthread_mutex_destroy(&p->mutex);
+    return res;
+  }
+  p->manualReset = manualReset;
+  p->state = (signaled ? 1 : 0);
+  p->created = 1;
+  return 0;
+}
+
+WRes ManualResetEvent_Create(CManualResetEvent *p, int signaled) { return Event_Create(p, 1, signaled); }
+WRes ManualResetEvent_CreateNotSignaled(CManualResetEvent *p) { return ManualResetEvent_Create(p, 0); }
+WRes AutoResetEvent_Create(CAutoResetEvent *p, int signaled) { return Event_Create(p, 0, signaled); }
+WRes AutoResetEvent_CreateNotSignaled(CAutoResetEvent *p) { return AutoResetEvent_Create(p, 0); }
+
+WRes Event_Set(CEvent *p)
+{
+  pthread_mutex_lock(&p->mutex);
+  p->state = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+WRes Event_Reset(CEvent *p)
+{
+  pthread_mutex_lock(&p->mutex);
+  p->state = 0;
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+WRes Event_Wait(CEvent *p)
+{
+  pthread_mutex_lock(&p->mutex);
+  while (p->state == 0)
+    pthread_cond_wait(&p->cond, &p->mutex);
+  if (!p->manualReset)
+    p->state = 0;
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+WRes Event_Close(CEvent *p)
+{
+  if (!p->created)
+    return 0;
+  p->created = 0;
+  pthread_mutex_destroy(&p->mutex);
+  pthread_cond_destroy(&p->cond);
+  return 0;
+}
+
+WRes Semaphore_Create(CSemaphore *p, UInt32 initCount, UInt32 maxCount)
+{
+  WRes res = pthread_mutex_init(&p->mutex, NULL);
+  if (res != 0)
+    return res;
+  if ((res = pthread_cond_init(&p->cond, NULL)) != 0)
+  {
+    pthread_mutex_destroy(&p->mutex);
+    return res;
+  }
+  p->count = initCount;
+  p->maxCount = maxCount;
+  p->created = 1;
+  return 0;
+}
+
+WRes Semaphore_ReleaseN(CSemaphore *p, UInt32 num)
+{
+  WRes res = 0;
+  pthread_mutex_lock(&p->mutex);
+  if (num > p->maxCount - p->count)
+    res = EINVAL;
+  else
+  {
+    p->count += num;
+    pthread_cond_broadcast(&p->cond);
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return res;
+}
+
+WRes Semaphore_Release1(CSemaphore *p) { return Semaphore_ReleaseN(p, 1); }
+
+WRes Semaphore_Wait(CSemaphore *p)
+{
+  pthread_mutex_lock(&p->mutex);
+  while (p->count == 0)
+    pthread_cond_wait(&p->cond, &p->mutex);
+  p->count--;
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+WRes Semaphore_Close(CSemaphore *p)
+{
+  if (!p->created)
+    return 0;
+  p->created = 0;
+  pthread_mutex_destroy(&p->mutex);
+  pthread_cond_destroy(&p->cond);
+  return 0;
+}
+
+WRes CriticalSection_Init(CCriticalSection *p)
+{
+  return pthread_mutex_init(p, NULL);
+}
@@ -0,0 +1,83 @@
+/* Threads.h -- multithreading library
+2009-03-27 : Igor Pavlov : Public domain
+POSIX threads port for libswf */
+
+#ifndef __7Z_THREADS_H
+#define __7Z_THREADS_H
+
+#include <pthread.h>
+
+#include "Types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned THREAD_FUNC_RET_TYPE;
+#define THREAD_FUNC_CALL_TYPE MY_STD_CALL
+#define THREAD_FUNC_DECL THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE
+typedef THREAD_FUNC_RET_TYPE (THREAD_FUNC_CALL_TYPE * THREAD_FUNC_TYPE)(void *);
+
+typedef struct _CThread
+{
+  pthread_t handle;
+  int created;
+  THREAD_FUNC_TYPE func;
+  void *param;
+} CThread;
+
+#define Thread_Construct(p) (p)->created = 0
+#define Thread_WasCreated(p) ((p)->created != 0)
+WRes Thread_Create(CThread *p, THREAD_FUNC_TYPE func, void *param);
+WRes Thread_Wait(CThread *p);
+WRes Thread_Close(CThread *p);
+
+typedef struct _CEvent
+{
+  int created;
+  int manualReset;
+  int state;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} CEvent;
+
+typedef CEvent CAutoResetEvent;
+typedef CEvent CManualResetEvent;
+#define Event_Construct(p) (p)->created = 0
+#define Event_IsCreated(p) ((p)->created != 0)
+WRes Event_Close(CEvent *p);
+WRes Event_Set(CEvent *p);
+WRes Event_Reset(CEvent *p);
+WRes Event_Wait(CEvent *p);
+WRes ManualResetEvent_Create(CManualResetEvent *p, int signaled);
+WRes ManualResetEvent_CreateNotSignaled(CManualResetEvent *p);
+WRes AutoResetEvent_Create(CAutoResetEvent *p, int signaled);
+WRes AutoResetEvent_CreateNotSignaled(CAutoResetEvent *p);
+
+typedef struct _CSemaphore
+{
+  int created;
+  UInt32 count;
+  UInt32 maxCount;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} CSemaphore;
+
+#define Semaphore_Construct(p) (p)->created = 0
+WRes Semaphore_Create(CSemaphore *p, UInt32 initCount, UInt32 maxCount);
+WRes Semaphore_ReleaseN(CSemaphore *p, UInt32 num);
+WRes Semaphore_Release1(CSemaphore *p);
+WRes Semaphore_Wait(CSemaphore *p);
+WRes Semaphore_Close(CSemaphore *p);
+
+typedef pthread_mutex_t CCriticalSection;
+WRes CriticalSection_Init(CCriticalSection *p);
+#define CriticalSection_Delete(p) pthread_mutex_destroy(p)
+#define CriticalSection_Enter(p) pthread_mutex_lock(p)
+#define CriticalSection_Leave(p) pthread_mutex_unlock(p)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
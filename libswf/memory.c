@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Parsing of complete in-memory files. With everything available up front,
+ * none of SWFParser's state machine or rollback bookkeeping is needed.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "parser.h"
+#include "reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LZMA_HEADER_SIZE (LZMA_PROPS_SIZE + 4)
+
+#if HAVE_LIBZ
+static SWFError inflate_body(SWF *swf, const uint8_t *in, size_t len, uint8_t *out, size_t *out_size) {
+    SWFError ret = SWF_OK;
+    z_stream zstrm = { .next_in = (uint8_t*)in, .avail_in = len };
+    switch (inflateInit(&zstrm)) {
+    case Z_OK:
+        break;
+    case Z_MEM_ERROR:
+        return set_error(swf, SWF_NOMEM, "inflate_body: inflateInit returned Z_MEM_ERROR");
+    default:
+        return set_error(swf, SWF_INTERNAL_ERROR, "inflate_body: inflateInit returned an our-fault error");
+    }
+    size_t produced = 0;
+    ret = inflate_backend.decode_all(&zstrm, swf, out, *out_size, &produced);
+    if (ret == SWF_NEED_MORE_DATA) {
+        // The stream didn't end within the declared size; zlib decodes
+        // whatever fits, and the tag walk finds out if that's enough
+        zstrm.next_out = out + produced;
+        zstrm.avail_out = *out_size - produced;
+        int z_ret = inflate(&zstrm, Z_FINISH);
+        produced = *out_size - zstrm.avail_out;
+        if (z_ret == Z_DATA_ERROR)
+            ret = set_error(swf, SWF_INVALID, zstrm.msg);
+        else if (z_ret == Z_MEM_ERROR)
+            ret = set_error(swf, SWF_NOMEM, zstrm.msg);
+        else
+            ret = SWF_OK;
+    }
+    inflateEnd(&zstrm);
+    *out_size = produced;
+    return ret;
+}
+#endif
+
+/**
+ * \brief Decodes an LZMA body into swf->body, which is the dictionary.
+ * The declared size isn't trusted with an allocation: the buffer starts
+ * from a guess based on the input and doubles as it fills, up to the
+ * declared size.
+ * \param[in,out] out_size In: the declared body size; out: bytes decoded
+ */
+static SWFError lzma_body(SWF *swf, const uint8_t *in, size_t len, size_t *out_size) {
+    SWFError ret = SWF_OK;
+    if (len < LZMA_HEADER_SIZE)
+        return set_error(swf, SWF_INVALID, "lzma_body: LZMA header is truncated");
+    CLzmaDec lzma;
+    LzmaDec_Construct(&lzma);
+    switch (LzmaDec_AllocateProbs(&lzma, in + 4, LZMA_PROPS_SIZE, &allocator)) {
+    case SZ_OK:
+        break;
+    case SZ_ERROR_MEM:
+        return set_error(swf, SWF_NOMEM, "lzma_body: LzmaDec_AllocateProbs returned SZ_ERROR_MEM");
+    default:
+        return set_error(swf, SWF_INVALID, "lzma_body: Unsupported LZMA properties");
+    }
+    in += LZMA_HEADER_SIZE;
+    len -= LZMA_HEADER_SIZE;
+    size_t body_size = *out_size, size = len * 4 > LZMA_DIRECT_MIN_SIZE ? len * 4 : LZMA_DIRECT_MIN_SIZE;
+    size = size < body_size ? size : body_size;
+    if (!(swf->body = malloc(size ? size : 1))) {
+        LzmaDec_FreeProbs(&lzma, &allocator);
+        return set_error(swf, SWF_NOMEM, "lzma_body: Not enough memory for decompressed body");
+    }
+    lzma.dic = swf->body;
+    lzma.dicBufSize = size;
+    LzmaDec_Init(&lzma);
+    for (;;) {
+        SizeT in_len = len;
+        ELzmaStatus status;
+        SRes lz_ret = LzmaDec_DecodeToDic(&lzma, lzma.dicBufSize, in, &in_len, LZMA_FINISH_ANY, &status);
+        in += in_len;
+        len -= in_len;
+        if (lz_ret == SZ_ERROR_DATA) {
+            ret = set_error(swf, SWF_INVALID, "lzma_body: Data error in LzmaDec_DecodeToDic");
+            break;
+        } else if (lz_ret != SZ_OK) {
+            ret = set_error(swf, SWF_UNKNOWN, "lzma_body: Unknown error in LzmaDec_DecodeToDic");
+            break;
+        }
+        // Truncation is reported by the tag walk, and nothing past the
+        // declared size is decoded
+        if (!len || status == LZMA_STATUS_FINISHED_WITH_MARK || lzma.dicPos < lzma.dicBufSize ||
+            lzma.dicBufSize == body_size)
+            break;
+        size = lzma.dicBufSize * 2 < body_size ? lzma.dicBufSize * 2 : body_size;
+        uint8_t *body = realloc(swf->body, size);
+        if (!body) {
+            ret = set_error(swf, SWF_NOMEM, "lzma_body: Not enough memory to expand decompressed body");
+            break;
+        }
+        swf->body = lzma.dic = body;
+        lzma.dicBufSize = size;
+    }
+    *out_size = lzma.dicPos;
+    lzma.dic = NULL;
+    LzmaDec_FreeProbs(&lzma, &allocator);
+    return ret;
+}
+
+/**
+ * \brief Counts the tags before the END tag, so the tag array is allocated once.
+ */
+static unsigned count_tags(uint8_t *p, uint8_t *end) {
+    unsigned nb_tags = 0;
+    while (end - p >= 2) {
+        uint16_t code_and_length = read_16(p);
+        size_t len = code_and_length & 0x3F;
+        p += 2;
+        if (len == 0x3F) {
+            if (end - p < 4)
+                break;
+            len = read_32(p);
+            p += 4;
+        }
+        if (!(code_and_length >> 6) || len > (size_t)(end - p))
+            break;
+        p += len;
+        nb_tags++;
+    }
+    return nb_tags;
+}
+
+static SWFError walk_tags(SWF *swf, uint8_t *body, size_t size, unsigned flags,
+                          const SWFParserLimits *limits) {
+    SWFError ret = SWF_OK;
+    Reader rd;
+    rd_init(&rd, body, size);
+    rd_rect(&rd, &swf->frame_size);
+    swf->frame_rate = rd_16(&rd);
+    swf->frame_count = rd_16(&rd);
+    if (rd.overrun)
+        return set_error(swf, SWF_INVALID, "walk_tags: Header is truncated");
+
+    uint8_t *p = body + rd.pos, *end = body + size;
+    unsigned nb_tags = count_tags(p, end);
+    if (limits->max_tags && nb_tags > limits->max_tags)
+        return set_error(swf, SWF_LIMIT, "walk_tags: File has more tags than max_tags");
+    if (nb_tags > swf->max_tags) {
+        SWFTag *tags = realloc(swf->tags, nb_tags * sizeof(SWFTag));
+        if (!tags)
+            return set_error(swf, SWF_NOMEM, "walk_tags: Not enough memory to allocate SWFTag array");
+        swf->tags = tags;
+        swf->max_tags = nb_tags;
+    }
+
+    while (end - p >= 2) {
+        uint8_t *start = p;
+        uint16_t code_and_length = read_16(p);
+        uint32_t len = code_and_length & 0x3F;
+        uint16_t code = code_and_length >> 6;
+        uint8_t tag_flags = SWF_TAG_BORROWED;
+        p += 2;
+        if (len == 0x3F) {
+            if (end - p < 4)
+                break;
+            len = read_32(p);
+            p += 4;
+            tag_flags |= SWF_TAG_LONG_HEADER;
+        }
+        if (len > (size_t)(end - p))
+            break;
+        if (code == SWF_END) {
+            if (limits->strict_size && 8 + (p + len - body) < swf->size)
+                return set_error(swf, SWF_INVALID, "walk_tags: File ends before its declared size");
+            return SWF_OK;
+        }
+        if (limits->max_tag_size && len > limits->max_tag_size)
+            return set_error(swf, SWF_LIMIT, "walk_tags: Tag is larger than max_tag_size");
+        if (tag_has_id(code) && len < 2)
+            return set_error(swf, SWF_INVALID, "walk_tags: Tag is too short for its character ID");
+        SWFTag tag = {
+            .type = code,
+            .size = len,
+            .flags = tag_flags,
+            .offset = 8 + (start - body),
+        };
+        if (tag_has_id(code)) {
+            tag.id = read_16(p);
+            tag.size -= 2;
+        }
+        uint8_t *payload = p + (len - tag.size);
+        if (flags & SWF_PARSER_HASH_TAGS) {
+            tag.hash = hash_64(payload, tag.size);
+            tag.flags |= SWF_TAG_HASHED;
+        }
+        if (tag.size) {
+            tag.payload = payload;
+            tag.raw_header = payload - start;
+        }
+        p += len;
+        if (code == SWF_JPEG_TABLES && tag.size) {
+            uint8_t *tables = malloc(tag.size);
+            if (!tables)
+                return set_error(swf, SWF_NOMEM, "walk_tags: Not enough memory to copy JPEG tables");
+            memcpy(tables, tag.payload, tag.size);
+            free(swf->JPEG_tables);
+            swf->JPEG_tables = tables;
+        }
+        if ((ret = swf_add_tag(swf, &tag)))
+            return ret;
+    }
+    return set_error(swf, SWF_INVALID, "walk_tags: File is truncated");
+}
+
+SWFError swf_parse_memory(const void *data, size_t len, unsigned flags, const SWFParserLimits *limits,
+                          SWF **out) {
+    static const SWFParserLimits no_limits;
+    SWFError ret = SWF_OK;
+    const uint8_t *in = data;
+    SWF *swf = *out = swf_init();
+    if (!swf)
+        return SWF_NOMEM;
+    if (len < 8 || in[1] != 'W' || in[2] != 'S' ||
+        (in[0] != SWF_UNCOMPRESSED && in[0] != SWF_ZLIB && in[0] != SWF_LZMA))
+        return set_error(swf, SWF_INVALID, "swf_parse_memory: Not an SWF file");
+    swf->compression = in[0];
+    swf->version = in[3];
+    swf->size = read_32((uint8_t*)in + 4);
+    if (swf->size < 8)
+        return set_error(swf, SWF_INVALID, "swf_parse_memory: Declared size is too small");
+    if (!limits)
+        limits = &no_limits;
+    // Nothing decodes past the declared size, so checking it covers every tag
+    if (limits->max_decompressed && swf->size > limits->max_decompressed)
+        return set_error(swf, SWF_LIMIT, "swf_parse_memory: Declared size is over max_decompressed");
+    in += 8;
+    len -= 8;
+
+    size_t body_size = swf->size - 8;
+    if (swf->compression == SWF_UNCOMPRESSED) {
+        // Tags point straight into the caller's data
+        body_size = len < body_size ? len : body_size;
+        return walk_tags(swf, (uint8_t*)in, body_size, flags, limits);
+    }
+    if (limits->max_buffered && body_size > limits->max_buffered)
+        return set_error(swf, SWF_LIMIT, "swf_parse_memory: Body is too large to decompress within max_buffered");
+    if (swf->compression == SWF_ZLIB) {
+#if HAVE_LIBZ
+        // Deflate can't do better than about 1032:1, so that's all a body
+        // this size can decompress to, whatever the header declares
+        body_size = len < body_size / 1032 ? len * 1032 : body_size;
+        if (!(swf->body = malloc(body_size ? body_size : 1)))
+            return set_error(swf, SWF_NOMEM, "swf_parse_memory: Not enough memory for decompressed body");
+        ret = inflate_body(swf, in, len, swf->body, &body_size);
+#else
+        return set_error(swf, SWF_RECOMPILE, "swf_parse_memory: ZLIB compression requires ZLIB");
+#endif
+    } else {
+        ret = lzma_body(swf, in, len, &body_size);
+    }
+    if (ret)
+        return ret;
+    return walk_tags(swf, swf->body, body_size, flags, limits);
+}
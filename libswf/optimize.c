@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+#if HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#define DEFAULT_FLAGS (SWF_OPTIMIZE_STRIP_DEBUG | SWF_OPTIMIZE_STRIP_METADATA | SWF_OPTIMIZE_BITMAPS)
+
+#define FILE_ATTRIBUTES_HAS_METADATA 0x10
+
+static int should_strip(const SWFTag *tag, unsigned flags) {
+    switch (tag->type) {
+    case SWF_ENABLE_DEBUGGER:
+    case SWF_ENABLE_DEBUGGER_2:
+    case SWF_DEBUG_ID:
+    case SWF_ENABLE_TELEMETRY:
+        return flags & SWF_OPTIMIZE_STRIP_DEBUG;
+    case SWF_PRODUCT_INFO:
+    case SWF_METADATA:
+        return flags & SWF_OPTIMIZE_STRIP_METADATA;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * \brief Drops the tags selected by flags, then rebuilds the lookup tables
+ * that refer to tags by index.
+ */
+static SWFError strip_tags(SWF *swf, unsigned flags) {
+    SWFError ret = SWF_OK;
+    unsigned nb_tags = 0;
+    int stripped_metadata = 0;
+    for (unsigned i = 0; i < swf->nb_tags; i++) {
+        SWFTag *tag = swf->tags + i;
+        if (should_strip(tag, flags)) {
+            stripped_metadata |= tag->type == SWF_METADATA;
+            swf_tag_free(tag);
+            continue;
+        }
+        swf->tags[nb_tags++] = *tag;
+    }
+    if (nb_tags == swf->nb_tags)
+        return SWF_OK;
+    swf->nb_tags = nb_tags;
+
+    // Don't advertise metadata that's no longer there
+    for (unsigned i = 0; stripped_metadata && i < nb_tags; i++) {
+        SWFTag *tag = swf->tags + i;
+        if (tag->type != SWF_FILE_ATTRIBUTES || !tag->size ||
+            !(tag->payload[0] & FILE_ATTRIBUTES_HAS_METADATA))
+            continue;
+        if (tag->flags & SWF_TAG_BORROWED) {
+            uint8_t *payload = malloc(tag->size);
+            if (!payload)
+                return set_error(swf, SWF_NOMEM, "strip_tags: Not enough memory to copy FileAttributes");
+            memcpy(payload, tag->payload, tag->size);
+            swf_tag_set_payload(tag, payload, tag->size);
+        }
+        tag->payload[0] &= ~FILE_ATTRIBUTES_HAS_METADATA;
+        tag->flags &= ~SWF_TAG_HASHED;
+        tag->hash = 0;
+    }
+
+    index_free(swf);
+    for (unsigned i = 0; i < nb_tags; i++)
+        if ((ret = index_tag(swf, i)))
+            return ret;
+    return SWF_OK;
+}
+
+#if HAVE_LIBZ
+
+/**
+ * \brief A DefineBitsLossless(2) tag to recompress
+ */
+typedef struct {
+    SWFTag *tag;
+    size_t prefix;      ///< Bytes of the payload before the zlib data
+    uint8_t *out;       ///< New payload, if it came out smaller; NULL otherwise
+    size_t out_size;
+    int z_ret;          ///< Z_OK, or the error that stopped recompression
+} BitmapJob;
+
+typedef struct {
+    BitmapJob *jobs;
+    unsigned nb_jobs;
+    unsigned next;      ///< Next job for a worker to take
+    int level;
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+#endif
+} BitmapPool;
+
+/**
+ * \brief Size of a lossless bitmap's decompressed data, or 0 if its header is bad
+ */
+static size_t bitmap_data_size(const SWFTag *tag) {
+    if (tag->size < 5)
+        return 0;
+    unsigned format = tag->payload[0];
+    size_t width = read_16(tag->payload + 1), height = read_16(tag->payload + 3);
+    int alpha = tag->type == SWF_DEFINE_BITS_LOSSLESS_2;
+    switch (format) {
+    case 3: // Colormapped; rows are padded to 32 bits
+        if (tag->size < 6)
+            return 0;
+        return (tag->payload[5] + 1) * (alpha ? 4 : 3) + ((width + 3) & ~3) * height;
+    case 4: // 15-bit RGB
+        return ((width * 2 + 3) & ~3) * height;
+    case 5: // 24-bit RGB or 32-bit ARGB
+        return width * height * 4;
+    default:
+        return 0;
+    }
+}
+
+static int recompress_bitmap(BitmapJob *job, int level) {
+    SWFTag *tag = job->tag;
+    size_t data_size = bitmap_data_size(tag);
+    if (!data_size)
+        return Z_DATA_ERROR;
+    job->prefix = tag->payload[0] == 3 ? 6 : 5;
+    size_t in_size = tag->size - job->prefix;
+    // Deflate can't do better than about 1032:1, so a header claiming more is bogus
+    if (data_size / 1032 > in_size)
+        return Z_DATA_ERROR;
+
+    uint8_t *data = malloc(data_size);
+    if (!data)
+        return Z_MEM_ERROR;
+    uLongf out_size = data_size;
+    int z_ret = uncompress(data, &out_size, tag->payload + job->prefix, in_size);
+    if (z_ret != Z_OK || out_size != data_size) {
+        free(data);
+        return z_ret == Z_OK || z_ret == Z_BUF_ERROR ? Z_DATA_ERROR : z_ret;
+    }
+
+    uLongf bound = compressBound(data_size);
+    uint8_t *out = malloc(job->prefix + bound);
+    if (!out) {
+        free(data);
+        return Z_MEM_ERROR;
+    }
+    z_ret = compress2(out + job->prefix, &bound, data, data_size, level);
+    free(data);
+    // Anything that doesn't fit in the old payload is no use to us
+    if (z_ret != Z_OK || bound >= in_size) {
+        free(out);
+        return z_ret;
+    }
+    memcpy(out, tag->payload, job->prefix);
+    job->out = out;
+    job->out_size = job->prefix + bound;
+    return Z_OK;
+}
+
+static void *bitmap_worker(void *arg) {
+    BitmapPool *pool = arg;
+    for (;;) {
+#if HAVE_THREADS
+        pthread_mutex_lock(&pool->lock);
+#endif
+        unsigned i = pool->next < pool->nb_jobs ? pool->next++ : pool->nb_jobs;
+#if HAVE_THREADS
+        pthread_mutex_unlock(&pool->lock);
+#endif
+        if (i == pool->nb_jobs)
+            return NULL;
+        pool->jobs[i].z_ret = recompress_bitmap(pool->jobs + i, pool->level);
+    }
+}
+
+static int compare_jobs(const void *a, const void *b) {
+    // Largest first, so a big bitmap doesn't start last and hold everyone up
+    uint32_t size_a = ((const BitmapJob*)a)->tag->size, size_b = ((const BitmapJob*)b)->tag->size;
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+/**
+ * \brief Recompresses every lossless bitmap's zlib data, keeping the
+ * result wherever it's smaller.
+ */
+static SWFError recompress_bitmaps(SWF *swf, int level, unsigned threads) {
+    SWFError ret = SWF_OK;
+    BitmapPool pool = { .level = level };
+    for (unsigned i = 0; i < swf->nb_tags; i++)
+        if (swf->tags[i].type == SWF_DEFINE_BITS_LOSSLESS || swf->tags[i].type == SWF_DEFINE_BITS_LOSSLESS_2)
+            pool.nb_jobs++;
+    if (!pool.nb_jobs)
+        return SWF_OK;
+    if (!(pool.jobs = calloc(pool.nb_jobs, sizeof(BitmapJob))))
+        return set_error(swf, SWF_NOMEM, "recompress_bitmaps: Not enough memory for job list");
+    for (unsigned i = 0, j = 0; i < swf->nb_tags; i++)
+        if (swf->tags[i].type == SWF_DEFINE_BITS_LOSSLESS || swf->tags[i].type == SWF_DEFINE_BITS_LOSSLESS_2)
+            pool.jobs[j++].tag = swf->tags + i;
+    qsort(pool.jobs, pool.nb_jobs, sizeof(BitmapJob), compare_jobs);
+
+#if HAVE_THREADS
+    pthread_t *workers = NULL;
+    unsigned nb_workers = 0;
+    if (threads > pool.nb_jobs)
+        threads = pool.nb_jobs;
+    pthread_mutex_init(&pool.lock, NULL);
+    // The calling thread is one of the workers
+    if (threads > 1 && (workers = malloc((threads - 1) * sizeof(pthread_t))))
+        while (nb_workers < threads - 1 &&
+               !pthread_create(workers + nb_workers, NULL, bitmap_worker, &pool))
+            nb_workers++;
+    bitmap_worker(&pool);
+    for (unsigned i = 0; i < nb_workers; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&pool.lock);
+#else
+    bitmap_worker(&pool);
+#endif
+
+    for (unsigned i = 0; i < pool.nb_jobs; i++) {
+        BitmapJob *job = pool.jobs + i;
+        if (job->out)
+            swf_tag_set_payload(job->tag, job->out, job->out_size);
+        else if (job->z_ret == Z_MEM_ERROR && !ret)
+            ret = set_error(swf, SWF_NOMEM, "recompress_bitmaps: Not enough memory to recompress bitmap");
+        // Bitmaps we can't decode are left as they are
+    }
+    free(pool.jobs);
+    return ret;
+}
+
+#endif
+
+SWFError swf_optimize(SWF *swf, const SWFOptimizeSettings *settings) {
+    SWFError ret = SWF_OK;
+    SWFOptimizeSettings defaults = { 0 };
+    if (!settings)
+        settings = &defaults;
+    unsigned flags = settings->flags ? settings->flags : DEFAULT_FLAGS;
+    if ((ret = strip_tags(swf, flags)))
+        return ret;
+    if (flags & SWF_OPTIMIZE_BITMAPS) {
+#if HAVE_LIBZ
+        int level = settings->level > 0 && settings->level <= 9 ? settings->level : Z_BEST_COMPRESSION;
+        return recompress_bitmaps(swf, level, settings->threads);
+#else
+        return set_error(swf, SWF_RECOMPILE, "swf_optimize: Recompressing bitmaps requires ZLIB");
+#endif
+    }
+    return SWF_OK;
+}
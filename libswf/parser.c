@@ -33,14 +33,89 @@ static inline int check_header(SWFParser *parser) {
            get_8(&parser->buf) != 'S';
 }
 
+/**
+ * \brief Starts parser->buf with room for at least size bytes, taking over
+ * the allocation kept by swf_parser_reset if it's big enough.
+ */
+static SWFError start_buf(SWFParser *parser, size_t size) {
+    if (parser->spare && parser->spare_size >= size) {
+        buf_free(&parser->buf);
+        parser->buf.alloc_ptr = parser->buf.ptr = parser->spare;
+        parser->buf.alloc_size = parser->spare_size;
+        parser->spare = NULL;
+        parser->spare_size = 0;
+        buf_update_peak(&parser->buf);
+        return SWF_OK;
+    }
+    free(parser->spare);
+    parser->spare = NULL;
+    parser->spare_size = 0;
+    return buf_init(&parser->buf, size);
+}
+
+/**
+ * \brief Empties parser->buf, keeping its allocation (if it's the largest
+ * seen) for start_buf.
+ */
+static void park_buf(SWFParser *parser) {
+    if (parser->buf.alloc_size > parser->spare_size) {
+        free(parser->spare);
+        parser->spare = parser->buf.alloc_ptr;
+        parser->spare_size = parser->buf.alloc_size;
+        parser->buf.alloc_ptr = NULL;
+    }
+    buf_free(&parser->buf);
+}
+
+/**
+ * \brief Frees whichever decoder's state is in parser's union.
+ */
+static void end_decoder(SWFParser *parser) {
+    switch (parser->decoder) {
+#if HAVE_LIBZ
+    case SWF_ZLIB:
+        inflateEnd(&parser->zstrm);
+        break;
+#endif
+    case SWF_LZMA:
+        if (parser->lzma.dic == parser->buf.alloc_ptr)
+            // The dictionary is the buffer; don't free it twice
+            parser->lzma.dic = NULL;
+        LzmaDec_Free(&parser->lzma, &allocator);
+        break;
+    default:
+        break;
+    }
+    parser->decoder = 0;
+}
+
+/**
+ * \brief Runs a user callback, timing it for SWFParserStats.
+ */
+static SWFError run_callback(SWFParser *parser, SWFParserCallback cb, void *data) {
+    uint64_t start = stats_clock(parser);
+    SWFError ret = cb(parser, data, parser->callbacks.ctx);
+    parser->stats.callback_ns += stats_clock(parser) - start;
+    return ret;
+}
+
 static SWFError setup_decompression(SWFParser *parser) {
     SWF* swf = parser->swf;
     int ret;
     switch (swf->compression) {
         case SWF_ZLIB:
 #if HAVE_LIBZ
+            // A reset parser keeps its zlib state; inflateReset only clears it
+            if (parser->decoder == SWF_ZLIB && inflateReset(&parser->zstrm) == Z_OK) {
+                trace_decoder_init(&parser->trace, SWF_ZLIB, 0);
+                return SWF_OK;
+            }
+            end_decoder(parser);
+            memset(&parser->zstrm, 0, sizeof(parser->zstrm));
             switch ((ret = inflateInit(&parser->zstrm))) {
             case Z_OK:
+                parser->decoder = SWF_ZLIB;
+                trace_decoder_init(&parser->trace, SWF_ZLIB, 0);
                 return SWF_OK;
             case Z_MEM_ERROR:
                 return set_error(parser, SWF_NOMEM, "setup_decompression: inflateInit returned Z_MEM_ERROR");
@@ -55,7 +130,14 @@ static SWFError setup_decompression(SWFParser *parser) {
 #endif
         case SWF_LZMA:
             parser->state = PARSER_LZMA_HEADER;
-            LzmaDec_Construct(&parser->lzma);
+            // A reset parser keeps its probabilities and dictionary, which
+            // LzmaDec_Allocate reuses if the new properties allow
+            if (parser->decoder != SWF_LZMA) {
+                end_decoder(parser);
+                LzmaDec_Construct(&parser->lzma);
+                parser->decoder = SWF_LZMA;
+            }
+            return SWF_OK;
         default:
             return SWF_OK;
     }
@@ -72,9 +154,13 @@ static SWFError parse_swf_header(SWFParser *parser) {
         return set_error(parser, SWF_INVALID, "parse_swf_header: check_header reported an invalid header");
     swf->version = get_8(&parser->buf);
     swf->size = get_32(&parser->buf);
+    if (parser->limits.max_decompressed && swf->size > parser->limits.max_decompressed)
+        return set_error(parser, SWF_LIMIT, "parse_swf_header: Declared size is over the parser's max_decompressed");
+    parser->offset = 8;
     parser->state = PARSER_HEADER;
+    trace_header(&parser->trace, swf);
     if (parser->callbacks.header_cb) {
-        parser->callbacks.header_cb(parser, NULL, parser->callbacks.ctx);
+        run_callback(parser, parser->callbacks.header_cb, NULL);
     }
     return setup_decompression(parser);
 }
@@ -84,8 +170,11 @@ static SWFError parse_swf_rect(SWFParser *parser, SWFRect* rect) {
     if (buf->size < 1)
         return SWF_NEED_MORE_DATA;
     int size = buf_get_bits(buf, 5);
-    if (buf->size < (size * 4 + 5 + 7) >> 3)
+    if (buf->size < (size * 4 + 5 + 7) >> 3) {
+        // Start over from the size field once there's enough data
+        buf->index = 0;
         return SWF_NEED_MORE_DATA;
+    }
     rect->x_min = buf_get_sbits(buf, size);
     rect->x_max = buf_get_sbits(buf, size);
     rect->y_min = buf_get_sbits(buf, size);
@@ -106,9 +195,10 @@ static SWFError parse_compressed_header(SWFParser *parser) {
     }
     swf->frame_rate = get_16(&parser->buf);
     swf->frame_count = get_16(&parser->buf);
+    parser->offset += parser->buf.rollback;
     parser->state = PARSER_BODY;
     if (parser->callbacks.header2_cb) {
-        parser->callbacks.header2_cb(parser, NULL, parser->callbacks.ctx);
+        run_callback(parser, parser->callbacks.header2_cb, NULL);
     }
     return SWF_OK;
 }
@@ -124,11 +214,22 @@ SWFError swf_add_tag(SWF *swf, SWFTag *tag) {
         swf->max_tags *= 2;
         swf->tags = new_tags;
     }
-    memcpy(swf->tags + swf->nb_tags++, tag, sizeof(SWFTag));
+    memcpy(swf->tags + swf->nb_tags, tag, sizeof(SWFTag));
+    SWFError ret = index_tag(swf, swf->nb_tags);
+    if (ret < 0)
+        // The tag still belongs to the caller
+        return ret;
+    swf->nb_tags++;
     return SWF_OK;
 }
 
 static SWFError parse_payload(SWFParser *parser, SWFTag *tag) {
+    if (parser->flags & SWF_PARSER_HASH_TAGS) {
+        // The payload's about to be copied anyway; hashing it now saves
+        // another pass over it once it's gone cold
+        tag->hash = hash_64(parser->buf.ptr, tag->size);
+        tag->flags |= SWF_TAG_HASHED;
+    }
     if (!tag->size)
         // Short-circuit if the tag was just an ID (probably invalid)
         return SWF_OK;
@@ -136,6 +237,7 @@ static SWFError parse_payload(SWFParser *parser, SWFTag *tag) {
     if (!tag->payload)
         return set_error(parser, SWF_NOMEM, "parse_payload: malloc failed");
     memcpy(tag->payload, parser->buf.ptr, tag->size);
+    parser->stats.payload_bytes += tag->size;
     buf_advance(&parser->buf, tag->size);
     return SWF_OK;
 }
@@ -149,6 +251,7 @@ static SWFError parse_JPEG_tables(SWFParser *parser, SWFTag *tag) {
     if (!tables)
         return set_error(parser, SWF_NOMEM, "parse_JPEG_tables: malloc failed");
     memcpy(tables, tag->payload, tag->size);
+    parser->stats.payload_bytes += tag->size;
     swf->JPEG_tables = tables;
     return SWF_OK;
 }
@@ -161,6 +264,14 @@ static SWFError parse_id_payload(SWFParser *parser, SWFTag *tag) {
     return parse_payload(parser, tag);
 }
 
+/**
+ * \brief Fails on a tag whose header has been read, leaving the buffer at its start.
+ */
+static SWFError reject_tag(SWFParser *parser, SWFError code, const char *text) {
+    buf_rollback(&parser->buf);
+    return set_error(parser, code, text);
+}
+
 static SWFError parse_tag(SWFParser *parser) {
     buf_clear_rollback(&parser->buf);
     if (parser->buf.size < 2)
@@ -168,22 +279,39 @@ static SWFError parse_tag(SWFParser *parser) {
     uint16_t code_and_length = get_16(&parser->buf);
     uint32_t len = code_and_length & 0x3F;
     uint16_t code = code_and_length >> 6;
-    if (parser->buf.size < len) {
+    uint8_t flags = 0;
+    if (parser->limits.max_tags && code != SWF_END && parser->nb_tags >= parser->limits.max_tags)
+        return reject_tag(parser, SWF_LIMIT, "parse_tag: File has more tags than the parser's max_tags");
+    // A long header's length field has to arrive before the payload's size is known
+    if (parser->buf.size < (len == 0x3F ? 4 : len)) {
         buf_rollback(&parser->buf);
         return SWF_NEED_MORE_DATA;
     }
     if (len == 0x3F) {
         len = get_32(&parser->buf);
-        if (len > parser->buf.size) {
-            buf_rollback(&parser->buf);
-            return SWF_NEED_MORE_DATA;
-        }
+        flags |= SWF_TAG_LONG_HEADER;
+    }
+    // Limits are checked before waiting for the payload, so it's never buffered
+    uint64_t end = (uint64_t)parser->offset + parser->buf.rollback + len;
+    if (parser->limits.max_tag_size && len > parser->limits.max_tag_size)
+        return reject_tag(parser, SWF_LIMIT, "parse_tag: Tag is larger than the parser's max_tag_size");
+    if (parser->limits.max_decompressed && end > parser->limits.max_decompressed)
+        return reject_tag(parser, SWF_LIMIT, "parse_tag: Tag runs past the parser's max_decompressed");
+    if (parser->limits.strict_size && end > parser->swf->size)
+        return reject_tag(parser, SWF_INVALID, "parse_tag: Tag runs past the file's declared size");
+    if (tag_has_id(code) && len < 2)
+        return reject_tag(parser, SWF_INVALID, "parse_tag: Tag is too short for its character ID");
+    if (len > parser->buf.size) {
+        buf_rollback(&parser->buf);
+        return SWF_NEED_MORE_DATA;
     }
     SWFTag tag = {
         .type = code,
         .payload = NULL,
         .size = len,
         .id = 0,
+        .flags = flags,
+        .offset = parser->offset,
     };
     SWFError ret = SWF_OK;
     switch (code) {
@@ -193,50 +321,31 @@ static SWFError parse_tag(SWFParser *parser) {
             return ret;
         }
         break;
-    case SWF_DEFINE_SHAPE:
-    case SWF_DEFINE_BITS:
-    case SWF_DEFINE_BUTTON:
-    case SWF_DEFINE_FONT:
-    case SWF_DEFINE_TEXT:
-    case SWF_DEFINE_SOUND:
-    case SWF_DEFINE_BITS_LOSSLESS:
-    case SWF_DEFINE_BITS_JPEG_2:
-    case SWF_DEFINE_SHAPE_2:
-    case SWF_DEFINE_SHAPE_3:
-    case SWF_DEFINE_TEXT_2:
-    case SWF_DEFINE_BUTTON_2:
-    case SWF_DEFINE_BITS_JPEG_3:
-    case SWF_DEFINE_BITS_LOSSLESS_2:
-    case SWF_DEFINE_EDIT_TEXT:
-    case SWF_DEFINE_SPRITE:
-    case SWF_DEFINE_MORPH_SHAPE:
-    case SWF_DEFINE_FONT_2:
-    case SWF_DEFINE_VIDEO_STREAM:
-    case SWF_DEFINE_FONT_3:
-    case SWF_DEFINE_SHAPE_4:
-    case SWF_DEFINE_MORPH_SHAPE_2:
-    case SWF_DEFINE_BITS_JPEG_4:
-        if ((ret = parse_id_payload(parser, &tag))) {
-            buf_rollback(&parser->buf);
-            return ret;
-        }
-        break;
     case SWF_END:
+        if (parser->limits.strict_size && end < parser->swf->size)
+            return reject_tag(parser, SWF_INVALID, "parse_tag: File ends before its declared size");
+        parser->stats.tag_counts[code]++;
         parser->state = PARSER_FINISHED;
         buf_advance(&parser->buf, len);
+        parser->offset += parser->buf.rollback;
+        trace_tag(&parser->trace, &tag);
         if (parser->callbacks.end_cb) {
-            parser->callbacks.end_cb(parser, NULL, parser->callbacks.ctx);
+            run_callback(parser, parser->callbacks.end_cb, NULL);
         }
         return SWF_FINISHED;
     default:
-        if ((ret = parse_payload(parser, &tag))) {
+        if ((ret = tag_has_id(code) ? parse_id_payload(parser, &tag) : parse_payload(parser, &tag))) {
             buf_rollback(&parser->buf);
             return ret;
         }
         break;
     }
+    parser->stats.tag_counts[code]++;
+    parser->nb_tags++;
+    parser->offset += parser->buf.rollback;
+    trace_tag(&parser->trace, &tag);
     if (parser->callbacks.tag_cb) {
-        return parser->callbacks.tag_cb(parser, &tag, parser->callbacks.ctx);
+        return run_callback(parser, parser->callbacks.tag_cb, &tag);
     }
     return copy_error(parser, parser->swf, swf_add_tag(parser->swf, &tag));
 }
@@ -254,39 +363,181 @@ static SWFError parse_buf_inc(SWFParser *parser) {
     }
 }
 
-static SWFError parse_buf(SWFParser *parser) {
+SWFError parse_buf(SWFParser *parser) {
     int was_ok = 0;
     SWFError ret = SWF_OK;
+    uint64_t start = stats_clock(parser), callback_ns = parser->stats.callback_ns;
     while(ret == SWF_OK) {
         ret = parse_buf_inc(parser);
         if (ret == SWF_OK)
             was_ok = 1;
     }
+    parser->stats.parse_ns += stats_clock(parser) - start - (parser->stats.callback_ns - callback_ns);
     if (ret == SWF_NEED_MORE_DATA && was_ok)
         return SWF_OK;
     return ret;
 }
 
+#if HAVE_LIBZ
+/**
+ * \brief Tries to inflate the whole body at once, straight into a buffer
+ * of its declared size, before any of it has been streamed.
+ * \return SWF_NEED_MORE_DATA if the body has to be streamed after all.
+ */
+static SWFError inflate_whole(SWFParser *parser) {
+    SWFError ret = SWF_OK;
+    size_t out_size = parser->swf->size > 8 ? parser->swf->size - 8 : 0, produced = 0;
+    // Deflate can't do better than about 1032:1; if the declared size needs
+    // more than that, the rest of the input is still to come
+    if (!out_size || out_size / 1032 > parser->zstrm.avail_in)
+        return SWF_NEED_MORE_DATA;
+    // A body too big to buffer whole can still be streamed
+    if (parser->buf.max_size && out_size > parser->buf.max_size)
+        return SWF_NEED_MORE_DATA;
+    if ((ret = start_buf(parser, out_size)))
+        return copy_error(parser, &parser->buf, ret);
+    size_t avail_in = parser->zstrm.avail_in;
+    uint64_t start = stats_clock(parser), trace_start = trace_clock(&parser->trace);
+    ret = inflate_backend.decode_all(&parser->zstrm, parser, parser->buf.ptr, out_size, &produced);
+    parser->stats.decode_ns += stats_clock(parser) - start;
+    parser->stats.bytes_out += produced;
+    trace_decode(&parser->trace, trace_start, 0, avail_in - parser->zstrm.avail_in, produced);
+    parser->buf.size = produced;
+    if (ret != SWF_OK)
+        return ret;
+    parser->inflate_ended = 1;
+    return parse_buf(parser);
+}
+#endif
+
+/**
+ * \brief Doubles the size of a buffer that's also the LZMA dictionary, up to
+ * the body's declared size, and past it only if the body turns out larger.
+ * Unlike buf_grow, this keeps the already-parsed data, which later matches
+ * can still refer back to.
+ */
+static SWFError grow_lzma_dic(SWFParser *parser) {
+    Buffer *buf = &parser->buf;
+    // The buffer ends where the decoder is, so this is buf->ptr's offset
+    size_t start = parser->lzma.dicPos - buf->size, size = parser->lzma.dicBufSize * 2,
+           body_size = parser->swf->size - 8;
+    if (parser->lzma.dicBufSize < body_size)
+        size = size < body_size ? size : body_size;
+    else if (parser->limits.strict_size)
+        return set_error(parser, SWF_INVALID, "grow_lzma_dic: Body decompressed to more than its declared size");
+    if (buf->max_size && size > buf->max_size)
+        return set_error(parser, SWF_LIMIT, "grow_lzma_dic: Dictionary would be over the parser's limits");
+    if (size > buf->alloc_size) {
+        uint8_t *dic = realloc(buf->alloc_ptr, size);
+        if (!dic)
+            return set_error(parser, SWF_NOMEM, "grow_lzma_dic: Not enough memory to expand LZMA dictionary");
+        trace_buffer_grow(&parser->trace, buf->alloc_size, size, start + buf->size);
+        buf->alloc_ptr = dic;
+        buf->ptr = dic + start;
+        buf->alloc_size = size;
+        parser->stats.nb_buffer_grows++;
+        parser->stats.buffer_grow_bytes += size;
+        buf_update_peak(buf);
+    }
+    parser->lzma.dic = buf->alloc_ptr;
+    parser->lzma.dicBufSize = size;
+    return SWF_OK;
+}
+
+/**
+ * \brief Decodes LZMA input into parser->buf, which is the decoder's
+ * dictionary. The buffer grows to hold the whole body, so it's never shifted.
+ */
+static SWFError lzma_decode_direct(SWFParser *parser, const uint8_t *in, size_t len) {
+    SWFError ret = SWF_OK;
+    CLzmaDec *lzma = &parser->lzma;
+    for (;;) {
+        SizeT in_len = len, dic_pos = lzma->dicPos;
+        ELzmaStatus status;
+        uint64_t start = stats_clock(parser), trace_start = trace_clock(&parser->trace);
+        SRes lz_ret = LzmaDec_DecodeToDic(lzma, lzma->dicBufSize, in, &in_len, LZMA_FINISH_ANY, &status);
+        parser->stats.decode_ns += stats_clock(parser) - start;
+        parser->stats.bytes_out += lzma->dicPos - dic_pos;
+        trace_decode(&parser->trace, trace_start, 0, in_len, lzma->dicPos - dic_pos);
+        in += in_len;
+        len -= in_len;
+        parser->buf.size = lzma->dic + lzma->dicPos - parser->buf.ptr;
+        if (lz_ret == SZ_ERROR_DATA)
+            return set_error(parser, SWF_INVALID, "lzma_decode_direct: Data error in LzmaDec_DecodeToDic");
+        else if (lz_ret != SZ_OK)
+            return set_error(parser, SWF_UNKNOWN, "lzma_decode_direct: Unknown error in LzmaDec_DecodeToDic");
+        ret = parse_buf(parser);
+        if (ret < 0 || ret == SWF_FINISHED || !len || status == LZMA_STATUS_FINISHED_WITH_MARK)
+            return ret;
+        // Out of room, with input left
+        if ((ret = grow_lzma_dic(parser)))
+            return ret;
+    }
+}
+
+/**
+ * \brief Makes the LZMA dictionary in props fit the parser's limits.
+ * A dictionary never has to be larger than the body, so one that's over the
+ * limit is shrunk to the body's declared size if that fits; any match from
+ * further back than that is then rejected as a data error.
+ */
+static SWFError limit_lzma_dic(SWFParser *parser, uint8_t *props) {
+    size_t max = parser->buf.max_size,
+           body_size = parser->swf->size > 8 ? parser->swf->size - 8 : 0;
+    if (!max || read_32(props + 1) <= max)
+        return SWF_OK;
+    if (body_size > max || max < 4096)
+        return set_error(parser, SWF_LIMIT, "limit_lzma_dic: LZMA dictionary is over the parser's limits");
+    props[1] = body_size;
+    props[2] = body_size >> 8;
+    props[3] = body_size >> 16;
+    props[4] = body_size >> 24;
+    return SWF_OK;
+}
+
+#if HAVE_THREADS
+/**
+ * \brief Whether the rest of the body should go through the decoder thread.
+ * A stream that's already being decoded straight into the parse buffer
+ * stays that way.
+ */
+static int use_pipeline(SWFParser *parser) {
+    if (!(parser->flags & SWF_PARSER_PIPELINE))
+        return 0;
+    switch (parser->swf->compression) {
+#if HAVE_LIBZ
+    case SWF_ZLIB:
+        return !parser->inflate_ended;
+#endif
+    case SWF_LZMA:
+        return parser->lzma.dic != parser->buf.alloc_ptr;
+    default:
+        return 0;
+    }
+}
+#endif
+
 SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
     SWF *swf = parser->swf;
     const uint8_t *buf = buf_in;
     SWFError ret = SWF_OK;
+    parser->stats.bytes_in += len;
     if (parser->state == PARSER_STARTED) {
         // This is a really stupid setup to make sure we don't crash
         // if the first few packets are <8 bytes
         size_t bytes_left = 8 - parser->buf.size;
         bytes_left = bytes_left > 8 ? 8 : bytes_left;
         bytes_left = len < bytes_left ? len : bytes_left;
-        if (!parser->buf.alloc_ptr &&
-           (ret = buf_init_with_data(&parser->buf, buf, bytes_left)))
+        if (!parser->buf.alloc_ptr && (ret = start_buf(parser, 8)))
             return copy_error(parser, &parser->buf, ret);
+        buf_append_raw(&parser->buf, buf, bytes_left);
+        parser->stats.bytes_out += bytes_left;
         if (parser->buf.size < 8)
             return SWF_OK;
         ret = parse_swf_header(parser);
         if (ret != SWF_OK)
             return ret;
-        // This buf is really tiny, and probably not worth keeping
-        buf_free(&parser->buf);
+        park_buf(parser);
         buf += bytes_left;
         len -= bytes_left;
         // Fall through to the post-header parsing stage
@@ -296,20 +547,53 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
         size_t bytes_left = LZMA_HEADER_SIZE - parser->buf.size;
         bytes_left = bytes_left > LZMA_HEADER_SIZE ? LZMA_HEADER_SIZE : bytes_left;
         bytes_left = len < bytes_left ? len : bytes_left;
-        if (!parser->buf.alloc_ptr &&
-           (ret = buf_init_with_data(&parser->buf, buf, bytes_left)))
+        if (!parser->buf.alloc_ptr && (ret = start_buf(parser, LZMA_HEADER_SIZE)))
             return copy_error(parser, &parser->buf, ret);
+        buf_append_raw(&parser->buf, buf, bytes_left);
         if (parser->buf.size < LZMA_HEADER_SIZE)
             return SWF_OK;
         // Fall through to the post-header parsing stage
-        SRes lz_ret = LzmaDec_Allocate(&parser->lzma, parser->buf.ptr + 4, LZMA_PROPS_SIZE, &allocator);
-        // This buf is really tiny, and probably not worth keeping
-        buf_free(&parser->buf);
+        uint8_t props[LZMA_PROPS_SIZE];
+        memcpy(props, parser->buf.ptr + 4, LZMA_PROPS_SIZE);
+        park_buf(parser);
         buf += bytes_left;
         len -= bytes_left;
+        SRes lz_ret;
+        size_t out_size = swf->size > 8 ? swf->size - 8 : 0;
+#if HAVE_THREADS
+        // The decoder thread decodes into its own blocks
+        if (parser->flags & SWF_PARSER_PIPELINE)
+            out_size = 0;
+#endif
+        if ((ret = limit_lzma_dic(parser, props)))
+            return ret;
+        // A body too big to buffer whole is streamed through a smaller dictionary
+        if (parser->buf.max_size && out_size > parser->buf.max_size)
+            out_size = 0;
+        // The declared size alone isn't trusted with an allocation: start
+        // from a guess based on the input, and grow_lzma_dic doubles it
+        size_t dic_size = len * 4 > LZMA_DIRECT_MIN_SIZE ? len * 4 : LZMA_DIRECT_MIN_SIZE;
+        dic_size = dic_size < out_size ? dic_size : out_size;
+        if (out_size && !start_buf(parser, dic_size)) {
+            // Decode straight into a buffer that grows to hold the whole
+            // body, and doubles as the dictionary; nothing has to be copied
+            // out of a separate one
+            if (parser->lzma.dic) {
+                // Left over from a file before a reset
+                allocator.Free(&allocator, parser->lzma.dic);
+                parser->lzma.dic = NULL;
+            }
+            lz_ret = LzmaDec_AllocateProbs(&parser->lzma, props, LZMA_PROPS_SIZE, &allocator);
+            parser->lzma.dic = parser->buf.alloc_ptr;
+            // A spare buffer from swf_parser_reset may already be bigger
+            parser->lzma.dicBufSize = parser->buf.alloc_size < out_size ? parser->buf.alloc_size : out_size;
+        } else {
+            lz_ret = LzmaDec_Allocate(&parser->lzma, props, LZMA_PROPS_SIZE, &allocator);
+        }
         switch (lz_ret) {
         case SZ_OK:
             LzmaDec_Init(&parser->lzma);
+            trace_decoder_init(&parser->trace, SWF_LZMA, parser->lzma.dicBufSize);
             break;
         case SZ_ERROR_MEM:
             return set_error(parser, SWF_NOMEM, "setup_decompression: LzmaDec_Allocate returned SZ_ERROR_MEM");
@@ -320,33 +604,57 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
         }
         parser->state = PARSER_HEADER;
     }
+#if HAVE_THREADS
+    if (use_pipeline(parser)) {
+        if (parser->state == PARSER_FINISHED)
+            return SWF_FINISHED;
+        return pipeline_append(parser, buf, len);
+    }
+#endif
     int increase_space = 0;
     switch (swf->compression) {
     case SWF_UNCOMPRESSED:
+        if (!parser->buf.alloc_ptr && (ret = start_buf(parser, len)))
+            return copy_error(parser, &parser->buf, ret);
         if ((ret = buf_append(&parser->buf, buf, len)))
             return copy_error(parser, &parser->buf, ret);
+        parser->stats.bytes_out += len;
         return parse_buf(parser);
 #if HAVE_LIBZ
     case SWF_ZLIB:
+        if (parser->inflate_ended)
+            return parse_buf(parser);
+        parser->zstrm.avail_in = len;
+        parser->zstrm.next_in = (uint8_t*)buf;
+        if (!parser->buf.alloc_ptr && (ret = inflate_whole(parser)) != SWF_NEED_MORE_DATA)
+            return ret;
         if (!parser->buf.alloc_ptr)
             // No buffer yet. Allocate one, wild-guessing at the size
-            if ((ret = buf_init(&parser->buf, len * 4)))
+            if ((ret = start_buf(parser, buf_clamp(&parser->buf, len * 4, 1))))
                 return copy_error(parser, &parser->buf, ret);
-        parser->zstrm.avail_in = len;
-        parser->zstrm.next_in = (uint8_t*)buf;
         for (;;) {
             size_t avail_size = buf_shift(&parser->buf);
             if (!avail_size) {
-                if ((ret = buf_grow_by(&parser->buf, parser->zstrm.avail_in * 4)))
+                // Grow geometrically, so reaching a large size (or a limit) costs linear copying
+                size_t size = parser->buf.size, want = size + parser->zstrm.avail_in * 4;
+                want = want > size * 2 ? want : size * 2;
+                if ((ret = buf_grow_to(&parser->buf, buf_clamp(&parser->buf, want, size + 1))))
                     return copy_error(parser, &parser->buf, ret);
                 avail_size = parser->buf.alloc_size - parser->buf.size;
             }
             parser->zstrm.avail_out = avail_size;
             parser->zstrm.next_out = parser->buf.ptr + parser->buf.size;
+            size_t avail_in = parser->zstrm.avail_in;
+            uint64_t start = stats_clock(parser), trace_start = trace_clock(&parser->trace);
             int z_ret = inflate(&parser->zstrm, Z_NO_FLUSH);
+            parser->stats.decode_ns += stats_clock(parser) - start;
+            parser->stats.bytes_out += avail_size - parser->zstrm.avail_out;
+            trace_decode(&parser->trace, trace_start, 0, avail_in - parser->zstrm.avail_in,
+                         avail_size - parser->zstrm.avail_out);
             parser->buf.size += (avail_size - parser->zstrm.avail_out);
             switch (z_ret) {
             case Z_STREAM_END:
+                parser->inflate_ended = 1;
                 return parse_buf(parser);
             case Z_STREAM_ERROR:
                 return set_error(parser, SWF_INVALID, parser->zstrm.msg);
@@ -381,9 +689,11 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
         }
 #endif
     case SWF_LZMA:
+        if (parser->lzma.dic == parser->buf.alloc_ptr)
+            return lzma_decode_direct(parser, buf, len);
         if (!parser->buf.alloc_ptr)
             // No buffer yet. Allocate one, wild-guessing at the size
-            if ((ret = buf_init(&parser->buf, len * 4)))
+            if ((ret = start_buf(parser, buf_clamp(&parser->buf, len * 4, 1))))
                 return copy_error(parser, &parser->buf, ret);
         size_t avail_in = len;
         const uint8_t *next_in = buf;
@@ -391,7 +701,10 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
             size_t in_size = avail_in;
             size_t avail_size = buf_shift(&parser->buf);
             if (!avail_size) {
-                if ((ret = buf_grow_by(&parser->buf, avail_in * 4)))
+                // Grow geometrically, so reaching a large size (or a limit) costs linear copying
+                size_t size = parser->buf.size, want = size + avail_in * 4;
+                want = want > size * 2 ? want : size * 2;
+                if ((ret = buf_grow_to(&parser->buf, buf_clamp(&parser->buf, want, size + 1))))
                     return copy_error(parser, &parser->buf, ret);
                 avail_size = parser->buf.alloc_size - parser->buf.size;
             }
@@ -399,8 +712,12 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
             uint8_t *next_out = parser->buf.ptr + parser->buf.size;
             ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
             ELzmaStatus status;
+            uint64_t start = stats_clock(parser), trace_start = trace_clock(&parser->trace);
             SRes lz_ret = LzmaDec_DecodeToBuf(&parser->lzma, next_out, &avail_out,
                                               next_in, &avail_in, finishMode, &status);
+            parser->stats.decode_ns += stats_clock(parser) - start;
+            parser->stats.bytes_out += avail_out;
+            trace_decode(&parser->trace, trace_start, 0, avail_in, avail_out);
             parser->buf.size += avail_out;
             next_in += avail_in;
             avail_in = in_size - avail_in;
@@ -438,7 +755,6 @@ SWFError swf_parser_append(SWFParser *parser, const void *buf_in, size_t len) {
             if (!avail_in) {
                 return ret;
             }
-            fprintf(stderr, "LOOP ENDING: %i\n", (int)avail_in);
         }
     default:
         return set_error(parser, SWF_UNKNOWN, "swf_parser_append: unknown compression method");
@@ -454,6 +770,8 @@ SWFParser* swf_parser_init(void) {
         free(out);
         return NULL;
     }
+    out->buf.stats = &out->stats;
+    out->buf.trace = &out->trace;
     return out;
 }
 
@@ -465,21 +783,72 @@ SWFErrorDesc *swf_parser_get_error(SWFParser *parser) {
     return &parser->err;
 }
 
+void swf_parser_get_stats(SWFParser *parser, SWFParserStats *stats) {
+    *stats = parser->stats;
+}
+
+SWFError swf_parser_reset(SWFParser *parser) {
+    SWF *swf = swf_init();
+    if (!swf)
+        return set_error(parser, SWF_NOMEM, "swf_parser_reset: Not enough memory to allocate SWF");
+    if (parser->decoder == SWF_LZMA && parser->lzma.dic == parser->buf.alloc_ptr) {
+        // The buffer stops being the dictionary; it's kept as the spare
+        parser->lzma.dic = NULL;
+        parser->lzma.dicBufSize = 0;
+    }
+    park_buf(parser);
+#if HAVE_THREADS
+    pipeline_reset(parser);
+#endif
+    parser->swf = swf;
+    parser->state = PARSER_STARTED;
+    parser->offset = 0;
+    parser->inflate_ended = 0;
+    parser->nb_tags = 0;
+    parser->err.code = SWF_OK;
+    parser->err.text = NULL;
+    memset(&parser->stats, 0, sizeof(parser->stats));
+    return SWF_OK;
+}
+
 void swf_parser_free(SWFParser *parser) {
-    buf_free(&parser->buf);
-    switch (parser->swf->compression) {
-#if HAVE_ZLIB
-    case SWF_ZLIB:
-        inflateEnd(&parser->zstrm);
+#if HAVE_THREADS
+    pipeline_free(parser);
 #endif
-    case SWF_LZMA:
-        LzmaDec_Free(&parser->lzma, &allocator);
-    default:
-        break;
-    }
+    end_decoder(parser);
+    buf_free(&parser->buf);
+    free(parser->spare);
     free(parser);
 }
 
+SWFError swf_parser_set_trace(SWFParser *parser, const SWFParserTrace *trace) {
+#if HAVE_TRACE
+    if (trace)
+        parser->trace = *trace;
+    else
+        memset(&parser->trace, 0, sizeof(parser->trace));
+    return SWF_OK;
+#else
+    return set_error(parser, SWF_RECOMPILE, "swf_parser_set_trace: Tracing requires --enable-trace");
+#endif
+}
+
+void swf_parser_set_limits(SWFParser *parser, const SWFParserLimits *limits) {
+    if (limits)
+        parser->limits = *limits;
+    else
+        memset(&parser->limits, 0, sizeof(parser->limits));
+    // Nothing ever needs to buffer more than the whole file
+    size_t max = parser->limits.max_buffered;
+    if (parser->limits.max_decompressed && (!max || parser->limits.max_decompressed < max))
+        max = parser->limits.max_decompressed;
+    parser->buf.max_size = max;
+}
+
+void swf_parser_set_flags(SWFParser *parser, unsigned flags) {
+    parser->flags = flags;
+}
+
 void swf_parser_set_callbacks(SWFParser *parser, SWFParserCallbacks *callbacks) {
     parser->callbacks.tag_cb = callbacks->tag_cb;
     parser->callbacks.header_cb = callbacks->header_cb;
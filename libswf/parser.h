@@ -21,6 +21,8 @@
 #include "swf.h"
 #include "lzma/LzmaDec.h"
 #include "buffer.h"
+#include "trace.h"
+#include <time.h>
 
 #if HAVE_LIBZ
 #include <zlib.h>
@@ -46,6 +48,19 @@ struct SWF_Parser {
     SWF *swf;               ///< SWF being decoded to
     Buffer buf;             ///< Temporary buffer for uncompressed data
     SWFParserCallbacks callbacks; ///< User-provided callbacks
+    unsigned flags;         ///< SWFParserFlags
+    uint32_t offset;        ///< Offset of buf.ptr in the decompressed file
+    int inflate_ended;      ///< Nonzero once the whole zlib stream has been decoded
+    uint8_t *spare;         ///< Allocation kept by swf_parser_reset for the next buf
+    size_t spare_size;      ///< Size of spare
+    SWFCompression decoder; ///< Compression whose decoder state is in the union below, or 0
+    SWFParserStats stats;   ///< Counters for swf_parser_get_stats; buf points here
+    SWFParserTrace trace;   ///< Hooks from swf_parser_set_trace; buf points here
+    SWFParserLimits limits; ///< Limits from swf_parser_set_limits; buf has max_buffered
+    uint32_t nb_tags;       ///< Tags parsed from this file so far, END excluded
+#if HAVE_THREADS
+    struct ParserPipeline *pipeline; ///< Decoder thread for SWF_PARSER_PIPELINE, once started
+#endif
     union {
         CLzmaDec lzma;      ///< LZMA decoder struct
 #if HAVE_LIBZ
@@ -53,3 +68,71 @@ struct SWF_Parser {
 #endif
     };
 };
+
+/**
+ * \brief Smallest buffer an LZMA body is decoded straight into, when the
+ * declared size is larger; see swf_parser_append and swf_parse_memory
+ */
+#define LZMA_DIRECT_MIN_SIZE (64 * 1024)
+
+/**
+ * \brief Reads the clock for SWFParserStats' times.
+ * \return Monotonic time in nanoseconds if the parser has SWF_PARSER_TIME
+ * set; 0 otherwise, so differences between readings come out as 0.
+ */
+static inline uint64_t stats_clock(const SWFParser *parser) {
+    struct timespec ts;
+    if (!(parser->flags & SWF_PARSER_TIME))
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \brief Parses as much of parser->buf as possible.
+ * \return SWF_OK if anything was parsed, SWF_NEED_MORE_DATA if nothing could
+ * be, SWF_FINISHED at the END tag, or < 0 on error.
+ */
+SWFError parse_buf(SWFParser *parser);
+
+#if HAVE_LIBZ
+/**
+ * \brief Decoder for inflating a whole CWS body in one call
+ */
+typedef struct {
+    const char *name;
+    /**
+     * \brief Inflates from zstrm->next_in/avail_in, advancing them by what was used.
+     * \param[in]  zstrm    Initialized zlib stream, with no input consumed yet
+     * \param[in]  err      Struct starting with an SWFErrorDesc, for set_error
+     * \param[out] out      Where to put the decompressed body
+     * \param[in]  out_size Space in out; the body's declared size
+     * \param[out] produced Set to the number of bytes written to out
+     * \return SWF_OK if the stream ended; SWF_NEED_MORE_DATA if it didn't, in
+     * which case zstrm is left ready for inflate to carry on; < 0 on error.
+     */
+    SWFError (*decode_all)(z_stream *zstrm, void *err, uint8_t *out, size_t out_size, size_t *produced);
+} InflateBackend;
+
+/// \private Backend selected by configure's --with-inflate
+extern const InflateBackend inflate_backend;
+#endif
+
+#if HAVE_THREADS
+typedef struct ParserPipeline ParserPipeline;
+
+/**
+ * \brief Decompresses buf on the parser's decoder thread, parsing each block
+ * on the calling thread as it comes out. Starts the thread on first use.
+ * \return As swf_parser_append
+ */
+SWFError pipeline_append(SWFParser *parser, const uint8_t *buf, size_t len);
+/**
+ * \brief Readies the parser's decoder thread, if it has one, for a new file
+ */
+void pipeline_reset(SWFParser *parser);
+/**
+ * \brief Stops and joins the parser's decoder thread, if it has one
+ */
+void pipeline_free(SWFParser *parser);
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "writer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_LIBZ
+
+/*
+ * Block-parallel deflate, in the style of pigz.
+ * The body is cut into fixed-size blocks, and each is compressed as raw
+ * deflate on a worker thread, with the 32KiB before it as a preset
+ * dictionary. Every block but the last ends with a sync flush, so their
+ * outputs concatenate into one stream; the calling thread writes them out
+ * in order and combines their Adler-32s for the zlib trailer.
+ */
+
+#define BLOCK_SIZE (128 * 1024)
+#define DICT_SIZE (32 * 1024)
+
+typedef enum {
+    JOB_FREE,    ///< Slot is unused
+    JOB_QUEUED,  ///< Block is waiting for a worker
+    JOB_RUNNING, ///< A worker is compressing the block
+    JOB_DONE,    ///< Output is ready to write
+} JobState;
+
+typedef struct {
+    JobState state;
+    int last;         ///< Nonzero if this is the final block
+    uint8_t *in;      ///< DICT_SIZE bytes for the dictionary, then the block
+    size_t dict_size; ///< Bytes of dictionary, ending at in + DICT_SIZE
+    size_t in_size;   ///< Bytes of block, starting at in + DICT_SIZE
+    uint8_t *out;     ///< Compressed block
+    size_t out_size;
+    uLong check;      ///< Adler-32 of the block
+    int z_ret;        ///< Result of compressing the block
+} DeflateJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;  ///< Signaled when a job is queued, or on exit
+    pthread_cond_t done;    ///< Signaled when a job is done
+    DeflateJob *jobs;       ///< Ring of jobs; block n uses jobs[n % nb_jobs]
+    unsigned nb_jobs;
+    uint64_t next_run;      ///< Next block for a worker to take
+    int exit;
+    int level;
+    size_t out_cap;         ///< Size of each job's output buffer
+} DeflatePool;
+
+static int compress_block(z_stream *zstrm, DeflatePool *pool, DeflateJob *job) {
+    int z_ret = deflateReset(zstrm);
+    if (z_ret == Z_OK && job->dict_size)
+        z_ret = deflateSetDictionary(zstrm, job->in + DICT_SIZE - job->dict_size, job->dict_size);
+    if (z_ret != Z_OK)
+        return z_ret;
+    zstrm->next_in = job->in + DICT_SIZE;
+    zstrm->avail_in = job->in_size;
+    zstrm->next_out = job->out;
+    zstrm->avail_out = pool->out_cap;
+    z_ret = deflate(zstrm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+    job->out_size = pool->out_cap - zstrm->avail_out;
+    job->check = adler32(adler32(0, NULL, 0), job->in + DICT_SIZE, job->in_size);
+    // out_cap is deflateBound() plus room for the flush marker, so one call always completes
+    if (job->last)
+        return z_ret == Z_STREAM_END ? Z_OK : Z_BUF_ERROR;
+    return z_ret == Z_OK && !zstrm->avail_in && zstrm->avail_out ? Z_OK : Z_BUF_ERROR;
+}
+
+static void *deflate_worker(void *arg) {
+    DeflatePool *pool = arg;
+    z_stream zstrm = { .zalloc = Z_NULL };
+    int init_ret = deflateInit2(&zstrm, pool->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        DeflateJob *job = pool->jobs + pool->next_run % pool->nb_jobs;
+        if (pool->exit)
+            break;
+        if (job->state != JOB_QUEUED) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+            continue;
+        }
+        job->state = JOB_RUNNING;
+        pool->next_run++;
+        pthread_mutex_unlock(&pool->lock);
+        int z_ret = init_ret == Z_OK ? compress_block(&zstrm, pool, job) : init_ret;
+        pthread_mutex_lock(&pool->lock);
+        job->z_ret = z_ret;
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (init_ret == Z_OK)
+        deflateEnd(&zstrm);
+    return NULL;
+}
+
+/**
+ * \brief Fills a job's block from the writer's source.
+ * \param[out] eof Set to 1 if the source has no more data after this block
+ */
+static SWFError fill_block(SWFWriter *writer, DeflateJob *job, int *eof) {
+    SWFError ret = SWF_OK;
+    WriterChunk *pending = &writer->pending;
+    job->in_size = 0;
+    for (;;) {
+        if (!pending->size) {
+            if ((ret = writer_next_chunk(writer, pending)) == SWF_FINISHED) {
+                *eof = 1;
+                return SWF_OK;
+            } else if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+        // Stop only once there's more data, so the final block is never empty
+        if (job->in_size == BLOCK_SIZE)
+            return SWF_OK;
+        size_t copy = BLOCK_SIZE - job->in_size < pending->size ? BLOCK_SIZE - job->in_size : pending->size;
+        memcpy(job->in + DICT_SIZE + job->in_size, pending->ptr, copy);
+        pending->ptr += copy;
+        pending->size -= copy;
+        job->in_size += copy;
+    }
+}
+
+/**
+ * \brief Waits for the job in a slot to finish, then writes its output.
+ */
+static SWFError finish_job(SWFWriter *writer, DeflatePool *pool, DeflateJob *job, uLong *check) {
+    pthread_mutex_lock(&pool->lock);
+    while (job->state != JOB_DONE)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    job->state = JOB_FREE;
+    pthread_mutex_unlock(&pool->lock);
+    if (job->z_ret != Z_OK)
+        return writer_zlib_error(writer, job->z_ret);
+    *check = adler32_combine(*check, job->check, job->in_size);
+    return writer_output(writer, job->out, job->out_size);
+}
+
+SWFError write_zlib_parallel(SWFWriter *writer) {
+    SWFError ret = SWF_OK;
+    unsigned nb_threads = writer->settings.threads, nb_started = 0;
+    int level = writer->settings.level < 0 ? Z_DEFAULT_COMPRESSION : writer->settings.level;
+    DeflatePool pool = {
+        .nb_jobs = nb_threads * 2,
+        .level = level > 9 ? 9 : level,
+        .out_cap = compressBound(BLOCK_SIZE) + 16,
+    };
+    pthread_t *threads = calloc(nb_threads, sizeof(pthread_t));
+    pool.jobs = calloc(pool.nb_jobs, sizeof(DeflateJob));
+    if (!threads || !pool.jobs) {
+        free(threads);
+        free(pool.jobs);
+        return set_error(writer, SWF_NOMEM, "write_zlib_parallel: Not enough memory for thread pool");
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.queued, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    for (unsigned i = 0; i < pool.nb_jobs; i++) {
+        if (!(pool.jobs[i].in = malloc(DICT_SIZE + BLOCK_SIZE)) ||
+            !(pool.jobs[i].out = malloc(pool.out_cap))) {
+            ret = set_error(writer, SWF_NOMEM, "write_zlib_parallel: Not enough memory for blocks");
+            goto end;
+        }
+    }
+    for (; nb_started < nb_threads; nb_started++) {
+        if (pthread_create(threads + nb_started, NULL, deflate_worker, &pool)) {
+            ret = set_error(writer, SWF_UNKNOWN, "write_zlib_parallel: Couldn't start worker thread");
+            goto end;
+        }
+    }
+
+    // zlib header for a 32KiB window, with FLEVEL set the way deflate() would
+    int flevel = pool.level < 0 ? 6 : pool.level;
+    unsigned header = 0x7800 | (flevel < 2 ? 0 : flevel < 6 ? 1 : flevel == 6 ? 2 : 3) << 6;
+    header += 31 - header % 31;
+    uint8_t bytes[4] = { header >> 8, header & 0xFF };
+    if ((ret = writer_output(writer, bytes, 2)))
+        goto end;
+
+    uLong check = adler32(0, NULL, 0);
+    uint64_t block = 0;
+    int eof = 0;
+    DeflateJob *prev = NULL;
+    writer->pending.size = 0;
+    while (!eof) {
+        DeflateJob *job = pool.jobs + block % pool.nb_jobs;
+        if (block >= pool.nb_jobs && (ret = finish_job(writer, &pool, job, &check)))
+            goto end;
+        // The previous block can still be compressing; it's only read from
+        job->dict_size = 0;
+        if (prev) {
+            job->dict_size = prev->in_size < DICT_SIZE ? prev->in_size : DICT_SIZE;
+            memcpy(job->in + DICT_SIZE - job->dict_size,
+                   prev->in + DICT_SIZE + prev->in_size - job->dict_size, job->dict_size);
+        }
+        if ((ret = fill_block(writer, job, &eof)))
+            goto end;
+        job->last = eof;
+        pthread_mutex_lock(&pool.lock);
+        job->state = JOB_QUEUED;
+        pthread_cond_signal(&pool.queued);
+        pthread_mutex_unlock(&pool.lock);
+        prev = job;
+        block++;
+    }
+    for (uint64_t i = block > pool.nb_jobs ? block - pool.nb_jobs : 0; i < block; i++) {
+        if ((ret = finish_job(writer, &pool, pool.jobs + i % pool.nb_jobs, &check)))
+            goto end;
+    }
+    bytes[0] = check >> 24;
+    bytes[1] = check >> 16;
+    bytes[2] = check >> 8;
+    bytes[3] = check;
+    ret = writer_output(writer, bytes, 4);
+
+end:
+    pthread_mutex_lock(&pool.lock);
+    pool.exit = 1;
+    pthread_cond_broadcast(&pool.queued);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < nb_started; i++)
+        pthread_join(threads[i], NULL);
+    for (unsigned i = 0; i < pool.nb_jobs; i++) {
+        free(pool.jobs[i].in);
+        free(pool.jobs[i].out);
+    }
+    pthread_cond_destroy(&pool.queued);
+    pthread_cond_destroy(&pool.done);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.jobs);
+    free(threads);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Pipelined decoding for SWF_PARSER_PIPELINE.
+ * A decoder thread owns the parser's zlib or LZMA state, and decompresses
+ * each appended buffer into a ring of fixed-size blocks. The calling
+ * thread takes blocks off the ring and parses them (running callbacks)
+ * while the next ones are being decoded. The ring is single-producer,
+ * single-consumer: each index is only written by one side, and published
+ * with atomics, so the mutex is only touched when one side has to sleep
+ * because the ring is empty or full.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "parser.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define BLOCK_SIZE (256 * 1024)
+#define NB_BLOCKS 4
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    int last;           ///< Nonzero if this is the final block for the current input
+    SWFError err;       ///< Set if decoding failed; the block is also the last
+    const char *msg;    ///< Error text for err
+    uint64_t decode_ns; ///< Time spent decoding the block, for SWFParserStats
+    uint64_t trace_start, trace_end; ///< When decoding started and ended, for trace_decode
+    size_t in_size;     ///< Input bytes used for the block, for trace_decode
+} Block;
+
+struct ParserPipeline {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t decoder_cond;
+    pthread_cond_t parser_cond;
+    Block blocks[NB_BLOCKS];
+    unsigned write;     ///< Blocks published by the decoder; only it writes this
+    unsigned read;      ///< Blocks released by the parser; only it writes this
+    int decoder_waiting; ///< Nonzero while the decoder is (about to be) asleep
+    int parser_waiting; ///< Nonzero while the parser is (about to be) asleep
+    unsigned nb_inputs; ///< Inputs handed to the decoder; only the parser writes this
+    unsigned nb_done;   ///< Inputs the decoder has started on; only it writes this
+    int exit;           ///< Set by the parser to stop the decoder
+    int abort;          ///< Set by the parser to make the decoder drop the rest of an input
+    const uint8_t *in;  ///< Current input
+    size_t in_len;
+    int ended;          ///< Nonzero once the compressed stream has ended
+};
+
+static inline unsigned load(unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void store(unsigned *p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int load_flag(int *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * \brief Sleeps on cv until cond(pl) is true. The check is repeated under
+ * the lock after announcing the wait, so a wakeup can't be missed.
+ */
+static void wait_for(ParserPipeline *pl, int (*cond)(ParserPipeline*), pthread_cond_t *cv, int *waiting) {
+    if (cond(pl))
+        return;
+    pthread_mutex_lock(&pl->lock);
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    while (!cond(pl))
+        pthread_cond_wait(cv, &pl->lock);
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+/**
+ * \brief Wakes the side sleeping on cv, if any; called after publishing an index.
+ */
+static void wake(ParserPipeline *pl, pthread_cond_t *cv, int *waiting) {
+    if (!__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&pl->lock);
+    pthread_cond_signal(cv);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+#define WAIT_DECODER(pl, cond) wait_for(pl, cond, &(pl)->decoder_cond, &(pl)->decoder_waiting)
+#define WAIT_PARSER(pl, cond) wait_for(pl, cond, &(pl)->parser_cond, &(pl)->parser_waiting)
+#define WAKE_DECODER(pl) wake(pl, &(pl)->decoder_cond, &(pl)->decoder_waiting)
+#define WAKE_PARSER(pl) wake(pl, &(pl)->parser_cond, &(pl)->parser_waiting)
+
+static int has_input(ParserPipeline *pl) {
+    return load_flag(&pl->exit) || load(&pl->nb_inputs) != pl->nb_done;
+}
+
+static int has_free_block(ParserPipeline *pl) {
+    return pl->write - load(&pl->read) < NB_BLOCKS;
+}
+
+static int has_block(ParserPipeline *pl) {
+    return load(&pl->write) != pl->read;
+}
+
+/**
+ * \brief Decodes into block from pl->in, advancing it.
+ * \return SWF_OK if the block is full or the input is used up,
+ * SWF_FINISHED if the stream ended, or SWFError < 0 with block->msg set.
+ */
+static SWFError decode_block(SWFParser *parser, ParserPipeline *pl, Block *block) {
+    switch (parser->swf->compression) {
+#if HAVE_LIBZ
+    case SWF_ZLIB: {
+        z_stream *zstrm = &parser->zstrm;
+        zstrm->next_in = (uint8_t*)pl->in;
+        zstrm->avail_in = pl->in_len;
+        zstrm->next_out = block->data;
+        zstrm->avail_out = BLOCK_SIZE;
+        int z_ret = inflate(zstrm, Z_NO_FLUSH);
+        block->size = BLOCK_SIZE - zstrm->avail_out;
+        pl->in = zstrm->next_in;
+        pl->in_len = zstrm->avail_in;
+        switch (z_ret) {
+        case Z_OK:
+        case Z_BUF_ERROR:
+            return SWF_OK;
+        case Z_STREAM_END:
+            return SWF_FINISHED;
+        case Z_MEM_ERROR:
+            block->msg = zstrm->msg;
+            return SWF_NOMEM;
+        default:
+            block->msg = zstrm->msg;
+            return SWF_INVALID;
+        }
+    }
+#endif
+    case SWF_LZMA: {
+        SizeT out_len = BLOCK_SIZE, in_len = pl->in_len;
+        ELzmaStatus status;
+        SRes lz_ret = LzmaDec_DecodeToBuf(&parser->lzma, block->data, &out_len, pl->in, &in_len,
+                                          LZMA_FINISH_ANY, &status);
+        block->size = out_len;
+        pl->in += in_len;
+        pl->in_len -= in_len;
+        if (lz_ret == SZ_ERROR_DATA) {
+            block->msg = "decode_block: Data error in LzmaDec_DecodeToBuf";
+            return SWF_INVALID;
+        } else if (lz_ret != SZ_OK) {
+            block->msg = "decode_block: Unknown error in LzmaDec_DecodeToBuf";
+            return SWF_UNKNOWN;
+        }
+        return status == LZMA_STATUS_FINISHED_WITH_MARK ? SWF_FINISHED : SWF_OK;
+    }
+    default:
+        block->msg = "decode_block: Unsupported compression";
+        return SWF_INTERNAL_ERROR;
+    }
+}
+
+static void *decoder_thread(void *arg) {
+    SWFParser *parser = arg;
+    ParserPipeline *pl = parser->pipeline;
+    for (;;) {
+        WAIT_DECODER(pl, has_input);
+        if (load_flag(&pl->exit))
+            return NULL;
+        pl->nb_done++;
+        // Blocks are published until one comes out marked last
+        for (int last = 0; !last;) {
+            WAIT_DECODER(pl, has_free_block);
+            Block *block = pl->blocks + pl->write % NB_BLOCKS;
+            block->size = 0;
+            block->err = SWF_OK;
+            SWFError ret = SWF_OK;
+            size_t in_len = pl->in_len;
+            uint64_t start = stats_clock(parser);
+            block->trace_start = trace_clock(&parser->trace);
+            if (!pl->ended && !load_flag(&pl->abort))
+                ret = decode_block(parser, pl, block);
+            block->decode_ns = stats_clock(parser) - start;
+            block->trace_end = trace_clock(&parser->trace);
+            block->in_size = in_len - pl->in_len;
+            if (ret == SWF_FINISHED)
+                pl->ended = 1;
+            else if (ret < 0)
+                block->err = ret;
+            // Input is used up when it's all consumed and the block isn't full
+            last = block->last = ret || pl->ended || load_flag(&pl->abort) ||
+                                 (!pl->in_len && block->size < BLOCK_SIZE);
+            store(&pl->write, pl->write + 1);
+            WAKE_PARSER(pl);
+        }
+    }
+}
+
+static SWFError pipeline_init(SWFParser *parser) {
+    ParserPipeline *pl = calloc(1, sizeof(ParserPipeline));
+    if (!pl)
+        return set_error(parser, SWF_NOMEM, "pipeline_init: Not enough memory for pipeline");
+    for (unsigned i = 0; i < NB_BLOCKS; i++) {
+        if (!(pl->blocks[i].data = malloc(BLOCK_SIZE))) {
+            for (unsigned j = 0; j < i; j++)
+                free(pl->blocks[j].data);
+            free(pl);
+            return set_error(parser, SWF_NOMEM, "pipeline_init: Not enough memory for pipeline blocks");
+        }
+    }
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->decoder_cond, NULL);
+    pthread_cond_init(&pl->parser_cond, NULL);
+    parser->pipeline = pl;
+    if (pthread_create(&pl->thread, NULL, decoder_thread, parser)) {
+        parser->pipeline = NULL;
+        pthread_mutex_destroy(&pl->lock);
+        pthread_cond_destroy(&pl->decoder_cond);
+        pthread_cond_destroy(&pl->parser_cond);
+        for (unsigned i = 0; i < NB_BLOCKS; i++)
+            free(pl->blocks[i].data);
+        free(pl);
+        return set_error(parser, SWF_UNKNOWN, "pipeline_init: Couldn't start decoder thread");
+    }
+    return SWF_OK;
+}
+
+SWFError pipeline_append(SWFParser *parser, const uint8_t *buf, size_t len) {
+    SWFError ret = SWF_OK, parse_ret = SWF_NEED_MORE_DATA;
+    int parsed = 0;
+    if (!parser->pipeline && (ret = pipeline_init(parser)))
+        return ret;
+    ParserPipeline *pl = parser->pipeline;
+    // The decoder only reads the input during this call, so it needn't be copied
+    pl->in = buf;
+    pl->in_len = len;
+    __atomic_store_n(&pl->abort, 0, __ATOMIC_SEQ_CST);
+    store(&pl->nb_inputs, pl->nb_inputs + 1);
+    WAKE_DECODER(pl);
+    for (int last = 0; !last;) {
+        WAIT_PARSER(pl, has_block);
+        Block *block = pl->blocks + pl->read % NB_BLOCKS;
+        last = block->last;
+        parser->stats.decode_ns += block->decode_ns;
+        parser->stats.bytes_out += block->size;
+        trace_decode(&parser->trace, block->trace_start, block->trace_end, block->in_size, block->size);
+        if (block->err < 0 && !ret)
+            ret = set_error(parser, block->err, block->msg);
+        if (!ret && block->size && (ret = buf_append(&parser->buf, block->data, block->size)))
+            ret = copy_error(parser, &parser->buf, ret);
+        store(&pl->read, pl->read + 1);
+        WAKE_DECODER(pl);
+        if (!ret) {
+            parse_ret = parse_buf(parser);
+            if (parse_ret == SWF_OK)
+                parsed = 1;
+            else if (parse_ret < 0 || parse_ret == SWF_FINISHED)
+                ret = parse_ret;
+        }
+        if (ret)
+            // Nothing more from this input is wanted; the decoder stops at its next block
+            __atomic_store_n(&pl->abort, 1, __ATOMIC_SEQ_CST);
+    }
+    if (ret)
+        return ret;
+    return parse_ret == SWF_NEED_MORE_DATA && parsed ? SWF_OK : parse_ret;
+}
+
+void pipeline_reset(SWFParser *parser) {
+    // The decoder is idle between appends, and sees this once it's handed
+    // the next input
+    if (parser->pipeline)
+        parser->pipeline->ended = 0;
+}
+
+void pipeline_free(SWFParser *parser) {
+    ParserPipeline *pl = parser->pipeline;
+    if (!pl)
+        return;
+    __atomic_store_n(&pl->exit, 1, __ATOMIC_SEQ_CST);
+    WAKE_DECODER(pl);
+    pthread_join(pl->thread, NULL);
+    pthread_mutex_destroy(&pl->lock);
+    pthread_cond_destroy(&pl->decoder_cond);
+    pthread_cond_destroy(&pl->parser_cond);
+    for (unsigned i = 0; i < NB_BLOCKS; i++)
+        free(pl->blocks[i].data);
+    free(pl);
+    parser->pipeline = NULL;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include <string.h>
+
+/**
+ * \brief Bounds-checked cursor over a complete, in-memory tag payload.
+ * Unlike Buffer, a Reader never needs more data: reading past the end
+ * returns zeroes and sets overrun, so callers can check once at the end.
+ */
+typedef struct {
+    const uint8_t *ptr;
+    size_t size;
+    size_t pos;     ///< Byte position
+    unsigned bit;   ///< Bit position within ptr[pos] for bit-level reads
+    int overrun;    ///< Set if any read went past the end of the data
+} Reader;
+
+static inline void rd_init(Reader *rd, const uint8_t *ptr, size_t size) {
+    rd->ptr = ptr;
+    rd->size = size;
+    rd->pos = 0;
+    rd->bit = 0;
+    rd->overrun = 0;
+}
+
+static inline size_t rd_left(Reader *rd) {
+    return rd->pos < rd->size ? rd->size - rd->pos : 0;
+}
+
+static inline int rd_check(Reader *rd, size_t bytes) {
+    if (rd->overrun || bytes > rd_left(rd)) {
+        rd->overrun = 1;
+        rd->pos = rd->size;
+        return 0;
+    }
+    return 1;
+}
+
+static inline void rd_align(Reader *rd) {
+    if (rd->bit) {
+        rd->pos++;
+        rd->bit = 0;
+    }
+}
+
+static inline void rd_skip(Reader *rd, size_t bytes) {
+    rd_align(rd);
+    if (rd_check(rd, bytes))
+        rd->pos += bytes;
+}
+
+static inline const uint8_t *rd_ptr(Reader *rd) {
+    return rd->ptr + rd->pos;
+}
+
+static inline uint8_t rd_8(Reader *rd) {
+    rd_align(rd);
+    if (!rd_check(rd, 1))
+        return 0;
+    return rd->ptr[rd->pos++];
+}
+
+static inline uint16_t rd_16(Reader *rd) {
+    rd_align(rd);
+    if (!rd_check(rd, 2))
+        return 0;
+    uint16_t tmp = read_16((uint8_t*)rd->ptr + rd->pos);
+    rd->pos += 2;
+    return tmp;
+}
+
+static inline uint32_t rd_32(Reader *rd) {
+    rd_align(rd);
+    if (!rd_check(rd, 4))
+        return 0;
+    uint32_t tmp = read_32((uint8_t*)rd->ptr + rd->pos);
+    rd->pos += 4;
+    return tmp;
+}
+
+/**
+ * \brief Reads an ABC variable-length integer (u30/u32/s32 encoding).
+ */
+static inline uint32_t rd_u30(Reader *rd) {
+    uint32_t out = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = rd_8(rd);
+        out |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    return out;
+}
+
+/**
+ * \brief Reads a NUL-terminated STRING.
+ * \param[out] len Length of the string, not including the terminator
+ * \return Pointer to the string within the payload, or NULL if it's unterminated
+ */
+static inline const char *rd_string(Reader *rd, size_t *len) {
+    rd_align(rd);
+    const uint8_t *start = rd->ptr + rd->pos;
+    const uint8_t *end = rd->overrun ? NULL : memchr(start, 0, rd_left(rd));
+    if (!end) {
+        rd->overrun = 1;
+        rd->pos = rd->size;
+        *len = 0;
+        return NULL;
+    }
+    *len = end - start;
+    rd->pos += *len + 1;
+    return (const char*)start;
+}
+
+static inline uint32_t rd_bits(Reader *rd, unsigned nb_bits) {
+    uint32_t out = 0;
+    while (nb_bits) {
+        if (!rd_check(rd, 1))
+            return 0;
+        unsigned avail = 8 - rd->bit;
+        unsigned take = nb_bits < avail ? nb_bits : avail;
+        uint8_t byte = rd->ptr[rd->pos] >> (avail - take);
+        out = out << take | (byte & ((1 << take) - 1));
+        nb_bits -= take;
+        rd->bit += take;
+        if (rd->bit == 8) {
+            rd->bit = 0;
+            rd->pos++;
+        }
+    }
+    return out;
+}
+
+static inline int32_t rd_sbits(Reader *rd, unsigned nb_bits) {
+    uint32_t tmp = rd_bits(rd, nb_bits);
+    if (nb_bits && nb_bits < 32 && tmp >> (nb_bits - 1))
+        tmp |= 0xFFFFFFFF << nb_bits;
+    return (int32_t)tmp;
+}
+
+static inline void rd_rect(Reader *rd, SWFRect *rect) {
+    rd_align(rd);
+    unsigned nb_bits = rd_bits(rd, 5);
+    rect->x_min = rd_sbits(rd, nb_bits);
+    rect->x_max = rd_sbits(rd, nb_bits);
+    rect->y_min = rd_sbits(rd, nb_bits);
+    rect->y_max = rd_sbits(rd, nb_bits);
+    rd_align(rd);
+}
+
+/**
+ * \brief Reads a tag's RECORDHEADER from an in-memory tag stream (e.g. a sprite).
+ * \param[out] code Tag type
+ * \param[out] len  Payload length, including any ID
+ * \return 0 if the header or its payload doesn't fit in the remaining data
+ */
+static inline int rd_tag_header(Reader *rd, uint16_t *code, uint32_t *len) {
+    uint16_t code_and_length = rd_16(rd);
+    *code = code_and_length >> 6;
+    *len = code_and_length & 0x3F;
+    if (*len == 0x3F)
+        *len = rd_32(rd);
+    return !rd->overrun && *len <= rd_left(rd);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "reader.h"
+#include <stdlib.h>
+
+/**
+ * \brief Walks the tag headers in a sprite's payload.
+ * If out->tags and out->frames are NULL, this just counts them.
+ */
+static void walk_sprite(const SWFTag *tag, SWFSprite *out) {
+    Reader rd;
+    // Offset in the file of tag->payload, which starts after the ID
+    uint32_t base = tag->offset ? tag->offset + (tag->flags & SWF_TAG_LONG_HEADER ? 6 : 2) + 2 : 0;
+    rd_init(&rd, tag->payload, tag->size);
+    rd_skip(&rd, 2); // FrameCount
+    out->nb_tags = out->nb_frames = 0;
+    for (;;) {
+        uint16_t code;
+        uint32_t len;
+        size_t start = rd.pos;
+        if (!rd_tag_header(&rd, &code, &len) || code == SWF_END)
+            return;
+        if (out->tags) {
+            SWFTag *sub = out->tags + out->nb_tags;
+            sub->type = code;
+            sub->payload = (uint8_t*)rd_ptr(&rd);
+            sub->size = len;
+            sub->id = 0;
+            sub->flags = SWF_TAG_BORROWED | (rd.pos - start == 6 ? SWF_TAG_LONG_HEADER : 0);
+            sub->raw_header = rd.pos - start;
+            sub->offset = base ? base + start : 0;
+            sub->sprite = NULL;
+            if (tag_has_id(code) && len >= 2) {
+                sub->id = read_16(sub->payload);
+                sub->payload += 2;
+                sub->size -= 2;
+                sub->raw_header += 2;
+            }
+            if (!sub->size) {
+                sub->payload = NULL;
+                sub->raw_header = 0;
+            }
+        }
+        if (code == SWF_SHOW_FRAME) {
+            if (out->frames)
+                out->frames[out->nb_frames] = (SWFFrame){
+                    .tag = out->nb_tags,
+                    .offset = base ? base + start : 0,
+                };
+            out->nb_frames++;
+        }
+        out->nb_tags++;
+        rd_skip(&rd, len);
+    }
+}
+
+SWFError swf_tag_get_sprite(SWF *swf, SWFTag *tag, SWFSprite **sprite) {
+    if (tag->sprite) {
+        *sprite = tag->sprite;
+        return SWF_OK;
+    }
+    if (tag->type != SWF_DEFINE_SPRITE)
+        return set_error(swf, SWF_INVALID, "swf_tag_get_sprite: Not a DefineSprite tag");
+    if (tag->size < 2)
+        return set_error(swf, SWF_INVALID, "swf_tag_get_sprite: DefineSprite is too short");
+    SWFSprite *out = calloc(1, sizeof(SWFSprite));
+    if (!out)
+        return set_error(swf, SWF_NOMEM, "swf_tag_get_sprite: Not enough memory to allocate SWFSprite");
+    out->frame_count = read_16(tag->payload);
+    // Count first, so the arrays are allocated exactly once
+    walk_sprite(tag, out);
+    out->max_tags = out->nb_tags;
+    if ((out->nb_tags && !(out->tags = malloc(out->nb_tags * sizeof(SWFTag)))) ||
+        (out->nb_frames && !(out->frames = malloc(out->nb_frames * sizeof(SWFFrame))))) {
+        free(out->tags);
+        free(out);
+        return set_error(swf, SWF_NOMEM, "swf_tag_get_sprite: Not enough memory to allocate sprite");
+    }
+    walk_sprite(tag, out);
+    *sprite = tag->sprite = out;
+    return SWF_OK;
+}
+
+void sprite_free(SWFSprite *sprite) {
+    if (!sprite)
+        return;
+    for (unsigned i = 0; i < sprite->nb_tags; i++)
+        swf_tag_free(sprite->tags + i);
+    free(sprite->tags);
+    free(sprite->frames);
+    free(sprite);
+}
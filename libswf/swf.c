@@ -17,11 +17,18 @@
  */
 
 #include "internal.h"
+#include "lzma/LzmaDec.h"
 #include <stdlib.h>
 static void *Alloc(void *p, size_t size) { return malloc(size); }
 static void Free(void *p, void *address) { free(address); }
 ISzAlloc allocator = { Alloc, Free };
 
+SWFError swf_set_lzma_kernel(SWFLzmaKernel kernel) {
+    if (!LzmaDec_SetFast(kernel != SWF_LZMA_KERNEL_REFERENCE))
+        return kernel == SWF_LZMA_KERNEL_AUTO && LzmaDec_SetFast(0) ? SWF_OK : SWF_RECOMPILE;
+    return SWF_OK;
+}
+
 SWF *swf_init(void) {
     return calloc(1, sizeof(SWF));
 }
@@ -29,11 +36,24 @@ SWF *swf_init(void) {
 void swf_tag_free(SWFTag *tag) {
     if (!tag)
         return;
+    if (tag->sprite) {
+        sprite_free(tag->sprite);
+        tag->sprite = NULL;
+    }
     if (tag->payload) {
-        // TODO: Free any deeper data structures if necessary
-        free(tag->payload);
+        if (!(tag->flags & SWF_TAG_BORROWED))
+            free(tag->payload);
         tag->payload = NULL;
     }
+    tag->raw_header = 0;
+}
+
+void swf_tag_set_payload(SWFTag *tag, uint8_t *payload, uint32_t size) {
+    swf_tag_free(tag);
+    tag->payload = payload;
+    tag->size = size;
+    tag->flags &= ~(SWF_TAG_BORROWED | SWF_TAG_HASHED);
+    tag->hash = 0;
 }
 
 void swf_free(SWF *swf) {
@@ -46,6 +66,8 @@ void swf_free(SWF *swf) {
         free(swf->tags);
         swf->tags = NULL;
     }
+    index_free(swf);
+    free(swf->body);
     if (swf->JPEG_tables) {
         free(swf->JPEG_tables);
         swf->JPEG_tables = NULL;
@@ -47,8 +47,9 @@ typedef enum {
     SWF_INTERNAL_ERROR,     ///< This means there's a bug in libswf. Patches welcome.
     SWF_NOMEM,              ///< Not enough memory was available to complete the operation.
                             ///< You should be able to retry the operation after freeing some.
-    SWF_RECOMPILE           ///< You attempted to use a feature that requires an external
+    SWF_RECOMPILE,          ///< You attempted to use a feature that requires an external
                             ///< library that this libswf was not built with.
+    SWF_LIMIT               ///< A limit from SWFParserLimits was exceeded
 } SWFError;
 
 /**
@@ -109,6 +110,7 @@ typedef enum {
     SWF_DEFINE_VIDEO_STREAM     = 60,
     SWF_VIDEO_FRAME             = 61,
     SWF_DEFINE_FONT_INFO_2      = 62,
+    SWF_DEBUG_ID                = 63, // Undocumented; UUID matching the SWD file written by the compiler
     SWF_ENABLE_DEBUGGER_2       = 64,
     SWF_SCRIPT_LIMITS           = 65,
     SWF_SET_TAB_INDEX           = 66,
@@ -146,25 +148,63 @@ typedef enum {
     SWF_LZMA            = 'Z', ///< LZMA compression (builtin to libswf).
 } SWFCompression;
 
+/**
+ * \brief Flags describing an SWFTag
+ */
+typedef enum {
+    SWF_TAG_BORROWED = 1, ///< The payload points into memory owned by something
+                          ///< else (e.g. the DefineSprite a tag is nested in),
+                          ///< and won't be freed by swf_tag_free.
+    SWF_TAG_LONG_HEADER = 2, ///< The tag was stored with a long (6-byte) header
+    SWF_TAG_HASHED = 4,   ///< SWFTag.hash is set
+} SWFTagFlags;
+
+struct SWF_Sprite;
+
 /**
  * \brief SWF tag structure
  */
 typedef struct {
     SWFTagType type;    ///< Tag type
     uint32_t size;      ///< Size of payload (NOT the total size of the tag in-file)
-    uint8_t *payload;   ///< Pointer to a buffer containing the contents of the tag
+    uint8_t *payload;   ///< Pointer to a buffer containing the contents of the tag.
+                        ///< Unless SWF_TAG_BORROWED is set, it was allocated with
+                        ///< malloc, and is owned by the tag. To replace it, use
+                        ///< swf_tag_set_payload, or clear raw_header as well.
     uint16_t id;        ///< 16-bit ID pulled from tag; 0 indicates no ID. This
                         ///< value is not included in the payload.
+    uint8_t flags;      ///< SWFTagFlags
+    uint8_t raw_header; ///< Size of the tag's original header (and ID), if it's
+                        ///< still just before a borrowed payload, in the file's
+                        ///< data; 0 otherwise. Lets an unmodified tag be written
+                        ///< back in one piece. MUST be 0 if payload is changed.
+    uint32_t offset;    ///< Offset of the tag's header in the decompressed file;
+                        ///< 0 if the tag wasn't parsed from a file.
+    struct SWF_Sprite *sprite; ///< \protected Decoded sprite, for DefineSprite tags.
+                               ///< Populated on first call to swf_tag_get_sprite.
+    uint64_t hash;      ///< XXH64 (seed 0) of the payload, not including the ID,
+                        ///< if the parser had SWF_PARSER_HASH_TAGS set; see SWF_TAG_HASHED.
 } SWFTag;
 
 /**
- * \brief Parsed SWF sprite
+ * \brief Location of a frame's ShowFrame tag
  */
 typedef struct {
+    unsigned tag;           ///< Index of the ShowFrame tag in the tag array
+    uint32_t offset;        ///< SWFTag.offset of the ShowFrame tag
+} SWFFrame;
+
+/**
+ * \brief Parsed SWF sprite
+ */
+typedef struct SWF_Sprite {
     uint16_t frame_count;   ///< Number of frames in sprite
-    SWFTag* tags;           ///< Pointer to array of sub-tags
+    SWFTag* tags;           ///< Pointer to array of sub-tags. Their payloads
+                            ///< point into the DefineSprite tag's payload.
     unsigned nb_tags;       ///< Number of SWFTags
     unsigned max_tags;      ///< Number of tags that can fit in the space allocated
+    SWFFrame *frames;       ///< Pointer to array of frames, one per ShowFrame in tags
+    unsigned nb_frames;     ///< Number of SWFFrames
 } SWFSprite;
 
 /**
@@ -187,6 +227,11 @@ typedef struct {
     unsigned nb_tags;       ///< Number of SWFTags
                             ///< This should be considered read-only to the user.
     unsigned max_tags;      ///< \protected Number of tags that can fit in the space allocated
+    SWFFrame *frames;       ///< Pointer to array of frames, one per ShowFrame tag in tags.
+                            ///< This should be considered read-only to the user.
+    unsigned nb_frames;     ///< Number of SWFFrames
+                            ///< This should be considered read-only to the user.
+    unsigned max_frames;    ///< \protected Number of frames that can fit in the space allocated
 
     SWFCompression compression; ///< Type of compression used in file.
                                 ///< For input, this is set by the parser, and MUST NOT
@@ -197,11 +242,22 @@ typedef struct {
                             ///< This is set by the library during both parsing
                             ///< and writing.
     SWFRect frame_size;     ///< Frame size in twips; min_x and min_y are ignored.
+                            ///< Writing fails with SWF_INVALID unless every coordinate
+                            ///< is from -2^30 to 2^30 - 1, which is what a RECT can hold.
     uint16_t frame_rate;    ///< Frame delay in 8.8 fixed-point
     uint16_t frame_count;   ///< Number of frames in file
 
     uint8_t *JPEG_tables;   ///< \protected JPEG tables used by DefineBits tags.
                             ///< This MUST be set before attempting to write a DefineBits.
+
+    uint32_t *characters;   ///< \private Open-addressed hash table of tag indices + 1,
+                            ///< keyed by character ID. Use swf_get_character.
+    unsigned nb_characters; ///< \private Number of entries in characters
+    unsigned max_characters; ///< \private Number of slots in characters
+    struct SWF_SymbolTable *symbols; ///< \private Symbol name tables. Use
+                                     ///< swf_get_symbol_id and swf_get_symbol_name.
+    uint8_t *body;          ///< \private Decompressed body that tag payloads point
+                            ///< into, for SWFs from swf_parse_memory.
 } SWF;
 
 /**
@@ -228,6 +284,9 @@ typedef struct {
                                     ///< user calls swf_add_tag(swf, data), and
                                     ///< if swf_add_tag is not called, the user
                                     ///< is responsible for calling swf_tag_free.
+                                    ///< The payload is a block of its own from
+                                    ///< malloc, so the user may take it (setting
+                                    ///< payload to NULL) and later free() it.
                                     ///< This callback is not called for END tags.
     SWFParserCallback header_cb;    ///< Called when the uncompressed header is parsed. data=NULL
     SWFParserCallback header2_cb;   ///< Called when the compressed header is parsed. data=NULL
@@ -237,6 +296,100 @@ typedef struct {
                                     ///< third argument to all callbacks.
 } SWFParserCallbacks;
 
+/**
+ * \brief Options for an SWFParser
+ */
+typedef enum {
+    SWF_PARSER_HASH_TAGS = 1, ///< Hash each tag's payload as it's copied out of
+                              ///< the decompression buffer, into SWFTag.hash.
+    SWF_PARSER_PIPELINE  = 2, ///< Decompress on a separate thread, while the calling
+                              ///< thread parses and runs callbacks. Ignored for
+                              ///< uncompressed files, or without thread support.
+                              ///< Only worth it with a spare core, callbacks that do
+                              ///< real work, and appends of tens of KB or more;
+                              ///< each append is a round trip to the other thread.
+    SWF_PARSER_TIME      = 4, ///< Measure the time spent decoding, parsing and in
+                              ///< callbacks, for swf_parser_get_stats. Costs
+                              ///< a clock read before and after each callback.
+} SWFParserFlags;
+
+/**
+ * \brief Number of entries in SWFParserStats.tag_counts; tag types are 10 bits
+ */
+#define SWF_PARSER_STATS_TAG_TYPES 1024
+
+/**
+ * \brief Counters describing the work an SWFParser has done
+ */
+typedef struct {
+    uint64_t bytes_in;          ///< Bytes passed to swf_parser_append
+    uint64_t bytes_out;         ///< Bytes of the file after decompression, header included
+    uint64_t decode_ns;         ///< Time spent decompressing, if SWF_PARSER_TIME is set.
+                                ///< With SWF_PARSER_PIPELINE, this is time on the
+                                ///< decoder thread, which overlaps with the rest.
+    uint64_t parse_ns;          ///< Time spent parsing tags, not counting callbacks,
+                                ///< if SWF_PARSER_TIME is set
+    uint64_t callback_ns;       ///< Time spent in callbacks, if SWF_PARSER_TIME is set
+    uint64_t nb_buffer_grows;   ///< Times the parse buffer was reallocated to grow it
+    uint64_t buffer_grow_bytes; ///< Bytes allocated by those reallocations
+    uint64_t shifted_bytes;     ///< Bytes moved to the front of the parse buffer to make room
+    uint64_t payload_bytes;     ///< Bytes copied out of the parse buffer into tag payloads
+    size_t peak_buffer_size;    ///< Largest the parse buffer's allocation has been
+    uint32_t tag_counts[SWF_PARSER_STATS_TAG_TYPES]; ///< Tags parsed, by SWFTagType,
+                                                     ///< END included
+} SWFParserStats;
+
+/**
+ * \brief Hooks an SWFParser calls as it works through a file, to show where
+ * the time goes. Times are CLOCK_MONOTONIC nanoseconds. Every hook is
+ * optional, and all run on the thread calling swf_parser_append.
+ * Requires libswf to be configured with --enable-trace.
+ */
+typedef struct {
+    void (*header)(void *ctx, uint64_t ns, const SWF *swf);
+                                    ///< The uncompressed header was parsed; swf's
+                                    ///< compression, version and size are set
+    void (*decoder_init)(void *ctx, uint64_t ns, SWFCompression compression, size_t dic_size);
+                                    ///< A decoder was set up; dic_size is the LZMA
+                                    ///< dictionary's size, or 0 for zlib
+    void (*buffer_grow)(void *ctx, uint64_t ns, size_t old_size, size_t new_size, size_t used);
+                                    ///< The parse buffer was reallocated; used is the
+                                    ///< number of bytes in it that were kept
+    void (*tag)(void *ctx, uint64_t ns, const SWFTag *tag);
+                                    ///< A tag was parsed, END included, before any
+                                    ///< callback sees it
+    void (*decode)(void *ctx, uint64_t start_ns, uint64_t end_ns, size_t in_bytes, size_t out_bytes);
+                                    ///< A decoder call returned. With SWF_PARSER_PIPELINE,
+                                    ///< this is reported once the parser takes the block.
+    void *ctx;                      ///< User-provided pointer, passed as the
+                                    ///< first argument to all hooks
+} SWFParserTrace;
+
+/**
+ * \brief Caps on the resources parsing one file may use, so that a hostile
+ * file fails quickly rather than exhausting memory. 0 means no limit.
+ * Exceeding one fails with SWF_LIMIT. Taken by swf_parser_set_limits,
+ * swf_parse_memory and SWFBatchSettings.
+ */
+typedef struct {
+    uint64_t max_decompressed;  ///< Most bytes the file may decompress to, header included.
+                                ///< The declared size is checked as soon as it's parsed,
+                                ///< and each tag's end as soon as its header is.
+    uint32_t max_tag_size;      ///< Largest tag, not counting its header. Checked as soon
+                                ///< as the header is parsed, before the payload is buffered.
+    size_t max_buffered;        ///< Largest allocation for decompressed data: the parse
+                                ///< buffer, which must fit the largest tag, and the LZMA
+                                ///< dictionary. Files whose body is larger are streamed
+                                ///< rather than decoded whole; swf_parse_memory, which
+                                ///< can't stream, fails on them instead. max_decompressed,
+                                ///< if smaller, also caps these.
+    uint32_t max_tags;          ///< Most tags in the file, not counting END
+    int strict_size;            ///< Nonzero to fail with SWF_INVALID unless the tags end
+                                ///< exactly at the file's declared size: if a tag runs
+                                ///< past it, or the END tag comes before it. Otherwise
+                                ///< the tags are trusted.
+} SWFParserLimits;
+
 /**
  * \brief Allocates an SWFParser and accompanying SWF.
  * \return Pointer if the parser and SWF could be allocated; NULL otherwise.
@@ -267,6 +420,65 @@ SWF* swf_parser_get_swf(SWFParser *parser);
  * \return Pointer to SWFErrorDesc from parser
  */
 SWFErrorDesc *swf_parser_get_error(SWFParser *parser);
+/**
+ * \brief Gets the counters for everything a parser has done since it was
+ * allocated or last reset.
+ * \param[in]  parser Parser to get counters from
+ * \param[out] stats  Set to the parser's counters
+ */
+void swf_parser_get_stats(SWFParser *parser, SWFParserStats *stats);
+/**
+ * \brief Sets trace hooks for an SWFParser, replacing any set before.
+ * Builds with --enable-trace also have USDT probes (provider libswf) at the
+ * same points, where <sys/sdt.h> is available.
+ * \param[in] parser SWFParser to set hooks for
+ * \param[in] trace  SWFParserTrace to set; copied. NULL to remove them.
+ * \return SWF_RECOMPILE if libswf was configured without --enable-trace.
+ */
+SWFError swf_parser_set_trace(SWFParser *parser, const SWFParserTrace *trace);
+/**
+ * \brief Sets limits for an SWFParser, replacing any set before.
+ * Must be called before the first swf_parser_append for a file.
+ * \param[in] parser SWFParser to set limits for
+ * \param[in] limits SWFParserLimits to set; copied. NULL to remove them.
+ */
+void swf_parser_set_limits(SWFParser *parser, const SWFParserLimits *limits);
+/**
+ * \brief Parses a complete SWF file that's already in memory.
+ * The body is decompressed in one call (or not at all, for FWS) and its
+ * tags are walked directly, without an SWFParser. Tag payloads are
+ * SWF_TAG_BORROWED: they point into the SWF's own copy of the body for
+ * compressed files, and into data for uncompressed ones, so data MUST stay
+ * valid until the SWF is freed. A compressed body is never decoded past
+ * the file's declared size. Memory for it grows with what the input can
+ * really decompress to, rather than being taken from the declared size.
+ * \param[in]  data   The whole file
+ * \param[in]  len    Size of data
+ * \param[in]  flags  SWFParserFlags
+ * \param[in]  limits Limits to parse within; NULL for none
+ * \param[out] out    Set to the new SWF, even on failure, so its err can be
+ *                    checked; free it with swf_free either way. NULL if it
+ *                    couldn't be allocated.
+ * \return < 0 if something went wrong, including if the file is truncated.
+ */
+SWFError swf_parse_memory(const void *data, size_t len, unsigned flags, const SWFParserLimits *limits,
+                          SWF **out);
+/**
+ * \brief Kernels for decoding LZMA (ZWS) bodies
+ */
+typedef enum {
+    SWF_LZMA_KERNEL_AUTO,       ///< The fastest one built in
+    SWF_LZMA_KERNEL_REFERENCE,  ///< The LZMA SDK's portable decoder
+    SWF_LZMA_KERNEL_FAST,       ///< Decoder optimized for x86-64 and AArch64
+} SWFLzmaKernel;
+
+/**
+ * \brief Picks the kernel used for all LZMA decoding from now on, for
+ * benchmarking or debugging. Must not be called while anything is being decoded.
+ * \param[in] kernel Kernel to use
+ * \return SWF_RECOMPILE if the kernel isn't available on this platform.
+ */
+SWFError swf_set_lzma_kernel(SWFLzmaKernel kernel);
 /**
  * \brief Allocates a SWF
  * \return Pointer if the SWF could be allocated; NULL otherwise.
@@ -282,6 +494,26 @@ void swf_free(SWF *swf);
  * \param[in] tag SWFtag to free
  */
 void swf_tag_free(SWFTag *tag);
+/**
+ * \brief Replaces a tag's payload, freeing the old one if the tag owns it.
+ * The header form (short or long) is kept if the new size allows.
+ * \param[in] tag     SWFTag to modify
+ * \param[in] payload New payload, allocated with malloc; the tag takes ownership
+ * \param[in] size    Size of payload, not including any ID
+ */
+void swf_tag_set_payload(SWFTag *tag, uint8_t *payload, uint32_t size);
+/**
+ * \brief Readies an SWFParser for another file, keeping the memory it's
+ * already allocated: its buffer, its zlib state, and its LZMA probabilities
+ * and dictionary (where the new file's properties allow). Callbacks, trace
+ * hooks, limits and flags are kept too; the counters from swf_parser_get_stats start over.
+ * The parser's current SWF is left to the caller, who should have gotten it
+ * with swf_parser_get_swf, and must still free it with swf_free; a new one
+ * is allocated for the next file.
+ * \param[in] parser SWFParser to reset
+ * \return < 0 if something went wrong, in which case the parser is unchanged.
+ */
+SWFError swf_parser_reset(SWFParser *parser);
 /**
  * \brief Frees an SWFParser and all associated data.
  * \param[in] parser SWFParser to free
@@ -293,6 +525,12 @@ void swf_parser_free(SWFParser *parser);
  * \param[in] callbacks SWFParserCallbacks to set
  */
 void swf_parser_set_callbacks(SWFParser *parser, SWFParserCallbacks *callbacks);
+/**
+ * \brief Sets options for an SWFParser. Affects tags parsed after the call.
+ * \param[in] parser SWFParser to set options for
+ * \param[in] flags  Bitwise OR of SWFParserFlags
+ */
+void swf_parser_set_flags(SWFParser *parser, unsigned flags);
 /**
  * \brief Adds an SWFTag to an SWF
  * \param[in] swf SWF to add a tag to
@@ -300,3 +538,481 @@ void swf_parser_set_callbacks(SWFParser *parser, SWFParserCallbacks *callbacks);
  * \return < 0 if something went wrong.
  */
 SWFError swf_add_tag(SWF *swf, SWFTag *tag);
+/**
+ * \brief Looks up the tag that defines a character.
+ * This is a constant-time lookup in a table built by swf_add_tag. Tags are
+ * indexed by SWFTag.id, or for DefineBinaryData and DefineFont4, whose ID
+ * is left in the payload, by the payload's first 2 bytes.
+ * \param[in] swf SWF to search
+ * \param[in] id  Character ID
+ * \return Pointer to the first tag in swf->tags with the given ID, or NULL if there isn't one.
+ */
+SWFTag *swf_get_character(SWF *swf, uint16_t id);
+/**
+ * \brief Namespaces that map names to character IDs
+ */
+typedef enum {
+    SWF_SYMBOL_CLASS_NAME,  ///< ActionScript class names, from SymbolClass
+    SWF_SYMBOL_EXPORT,      ///< Exported names, from ExportAssets
+    SWF_SYMBOL_IMPORT,      ///< Imported names, from ImportAssets and ImportAssets2
+} SWFSymbolKind;
+
+/**
+ * \brief Looks up the character ID a symbol name maps to.
+ * Names are indexed by swf_add_tag, so this is a single hash table lookup.
+ * If a name is mapped more than once, the first mapping wins.
+ * \param[in] swf  SWF to search
+ * \param[in] kind Namespace to search
+ * \param[in] name NUL-terminated name to look up
+ * \return Character ID, or -1 if the name isn't mapped.
+ */
+int swf_get_symbol_id(SWF *swf, SWFSymbolKind kind, const char *name);
+/**
+ * \brief Looks up the first symbol name mapped to a character ID.
+ * \param[in] swf  SWF to search
+ * \param[in] kind Namespace to search
+ * \param[in] id   Character ID
+ * \return NUL-terminated name, or NULL if the ID isn't mapped. This is
+ * owned by the SWF, and is valid until the next call to swf_add_tag.
+ */
+const char *swf_get_symbol_name(SWF *swf, SWFSymbolKind kind, uint16_t id);
+/**
+ * \brief Finds the tags that make up a frame, using the frame index built by swf_add_tag.
+ * \param[in]  swf   SWF to search
+ * \param[in]  n     Frame number, starting from 0
+ * \param[out] first Index in swf->tags of the frame's first tag
+ * \param[out] end   Index in swf->tags after the frame's ShowFrame tag
+ * \return SWF_OK, or SWF_INVALID if there's no nth frame.
+ */
+SWFError swf_frame_tag_range(SWF *swf, unsigned n, unsigned *first, unsigned *end);
+/**
+ * \brief Finds the tags that make up a frame of a sprite.
+ * \param[in]  sprite Sprite to search, from swf_tag_get_sprite
+ * \param[in]  n      Frame number, starting from 0
+ * \param[out] first  Index in sprite->tags of the frame's first tag
+ * \param[out] end    Index in sprite->tags after the frame's ShowFrame tag
+ * \return SWF_OK, or SWF_INVALID if there's no nth frame.
+ */
+SWFError swf_sprite_frame_tag_range(SWFSprite *sprite, unsigned n, unsigned *first, unsigned *end);
+/**
+ * \brief Gets the decoded timeline of a DefineSprite tag.
+ * The sprite is decoded on the first call for a given tag, and cached in it.
+ * Nested tags aren't copied; they reference the DefineSprite's payload.
+ * \param[in]  swf    SWF the tag belongs to; errors are reported here
+ * \param[in]  tag    DefineSprite tag to decode
+ * \param[out] sprite Set to the decoded SWFSprite, which is owned by the tag
+ * \return < 0 if something went wrong.
+ */
+SWFError swf_tag_get_sprite(SWF *swf, SWFTag *tag, SWFSprite **sprite);
+
+/**
+ * \brief Where a span of text reported by the text extractor came from
+ */
+typedef enum {
+    SWF_TEXT_GLYPHS,        ///< A DefineText/DefineText2 glyph run, mapped through its font
+    SWF_TEXT_EDIT_TEXT,     ///< DefineEditText initial text
+    SWF_TEXT_EDIT_HTML,     ///< DefineEditText initial text with the HTML flag set
+    SWF_TEXT_ABC_STRING,    ///< A string from a DoABC constant pool
+    SWF_TEXT_CONSTANT_POOL, ///< A string from an AVM1 ActionConstantPool
+    SWF_TEXT_FRAME_LABEL,   ///< A FrameLabel name
+    SWF_TEXT_EXPORT_NAME,   ///< An ExportAssets name
+    SWF_TEXT_METADATA,      ///< Metadata XML
+} SWFTextSource;
+
+/**
+ * \brief A span of UTF-8 text found in an SWF
+ */
+typedef struct {
+    const char *text;       ///< UTF-8 text. This is NOT NUL-terminated.
+    size_t size;            ///< Length of text in bytes
+    SWFTextSource source;   ///< What kind of data the text came from
+    const SWFTag *tag;      ///< Tag the text came from. For tags nested in a
+                            ///< sprite, this is only valid during the callback.
+    uint16_t id;            ///< Character ID the text belongs to, if any; 0 otherwise
+    int borrowed;           ///< Nonzero if text points into tag->payload, and
+                            ///< is valid as long as the payload is. Otherwise,
+                            ///< text was converted, and is only valid during the callback.
+} SWFTextSpan;
+
+/**
+ * \brief Function prototype used by the text extractor
+ * \param[in] span Span of text found
+ * \param[in] ctx  User-provided pointer
+ * \return SWF_OK to continue; anything else stops extraction.
+ */
+typedef SWFError (*SWFTextCallback)(SWFTextSpan *span, void *ctx);
+
+/**
+ * \brief Opaque struct containing state used by the text extractor.
+ * Font code tables are kept here, so glyph runs can be mapped to text
+ * in a single pass even if tags are freed as they're parsed.
+ */
+typedef struct SWF_TextExtractor SWFTextExtractor;
+
+/**
+ * \brief Allocates an SWFTextExtractor.
+ * \param[in] cb  Callback to call for each span of text
+ * \param[in] ctx User-provided pointer, passed to cb
+ * \return Pointer if the extractor could be allocated; NULL otherwise.
+ */
+SWFTextExtractor *swf_text_extractor_init(SWFTextCallback cb, void *ctx);
+/**
+ * \brief Extracts text from a tag. Tags must be passed in file order, and
+ * malformed payloads are skipped rather than treated as errors.
+ * This can be called from a SWFParserCallbacks tag_cb.
+ * \param[in] ex  SWFTextExtractor to use
+ * \param[in] tag Tag to extract text from
+ * \return SWF_OK on success; otherwise, whatever the callback returned,
+ * or SWFError < 0 if something went wrong.
+ */
+SWFError swf_text_extractor_add_tag(SWFTextExtractor *ex, const SWFTag *tag);
+/**
+ * \brief Gets the SWFErrorDesc from a text extractor
+ * \param[in] ex SWFTextExtractor to get an error from
+ * \return Pointer to SWFErrorDesc from the extractor
+ */
+SWFErrorDesc *swf_text_extractor_get_error(SWFTextExtractor *ex);
+/**
+ * \brief Frees an SWFTextExtractor and all associated data.
+ * \param[in] ex SWFTextExtractor to free
+ */
+void swf_text_extractor_free(SWFTextExtractor *ex);
+/**
+ * \brief Extracts text from every tag in swf->tags, in a single pass.
+ * \param[in] swf SWF to extract text from
+ * \param[in] cb  Callback to call for each span of text
+ * \param[in] ctx User-provided pointer, passed to cb
+ * \return SWF_OK on success, or SWFError < 0 if something went wrong.
+ */
+SWFError swf_extract_text(SWF *swf, SWFTextCallback cb, void *ctx);
+
+/**
+ * \brief Transformation matrix
+ */
+typedef struct {
+    int32_t scale_x;        ///< X scale in 16.16 fixed-point
+    int32_t scale_y;        ///< Y scale in 16.16 fixed-point
+    int32_t rotate_skew_0;  ///< First rotate/skew term in 16.16 fixed-point
+    int32_t rotate_skew_1;  ///< Second rotate/skew term in 16.16 fixed-point
+    int32_t translate_x;    ///< X translation in twips
+    int32_t translate_y;    ///< Y translation in twips
+} SWFMatrix;
+
+/**
+ * \brief Color transform
+ */
+typedef struct {
+    int16_t mult[4];        ///< Red, green, blue and alpha multiply terms in 8.8 fixed-point
+    int16_t add[4];         ///< Red, green, blue and alpha addition terms
+} SWFColorTransform;
+
+/**
+ * \brief A character placed on the display list
+ */
+typedef struct {
+    uint16_t depth;         ///< Depth the character is placed at
+    uint16_t character;     ///< ID of the character
+    uint16_t ratio;         ///< Morph ratio
+    uint16_t clip_depth;    ///< Top depth masked by this character; 0 if it isn't a mask
+    SWFMatrix matrix;       ///< Transformation matrix
+    SWFColorTransform cxform; ///< Color transform
+} SWFDisplayObject;
+
+/**
+ * \brief Types of change made to a display list
+ */
+typedef enum {
+    SWF_DISPLAY_PLACE,      ///< A character was placed at an empty depth
+    SWF_DISPLAY_MODIFY,     ///< The object at a depth was moved, transformed, or had its character replaced
+    SWF_DISPLAY_REMOVE,     ///< The object at a depth was removed
+} SWFDisplayChangeType;
+
+/**
+ * \brief A change made to a display list by a frame
+ */
+typedef struct {
+    SWFDisplayChangeType type;  ///< Type of change
+    SWFDisplayObject object;    ///< Object after the change; for removals, before it
+} SWFDisplayChange;
+
+/**
+ * \brief Opaque struct containing a display list simulator.
+ * The display list is kept as an array sorted by depth, and is updated
+ * incrementally by each frame's PlaceObject and RemoveObject tags.
+ * Snapshots are kept every keyframe_interval frames, so seeking only has
+ * to replay the frames since the nearest one.
+ */
+typedef struct SWF_DisplayList SWFDisplayList;
+
+/**
+ * \brief Allocates an SWFDisplayList for a timeline.
+ * The timeline's frame index is used to find each frame's tags, so the
+ * SWF must have been parsed with its tags added to it, and the SWF (or
+ * sprite) MUST outlive the SWFDisplayList.
+ * \param[in] swf               SWF to simulate
+ * \param[in] sprite            Sprite to simulate, from swf_tag_get_sprite;
+ *                              NULL for the main timeline
+ * \param[in] keyframe_interval Number of frames between snapshots; 0 for the default
+ * \return Pointer if the SWFDisplayList could be allocated; NULL otherwise.
+ */
+SWFDisplayList *swf_display_list_init(SWF *swf, SWFSprite *sprite, unsigned keyframe_interval);
+/**
+ * \brief Applies the next frame's tags to a display list.
+ * \param[in]  dl         SWFDisplayList to advance
+ * \param[out] changes    Set to the changes made by the frame, in tag order.
+ *                        These are valid until the SWFDisplayList is next used.
+ * \param[out] nb_changes Set to the number of changes
+ * \return SWF_OK, SWF_FINISHED if there are no more frames, or SWFError < 0 if something went wrong.
+ */
+SWFError swf_display_list_next_frame(SWFDisplayList *dl, const SWFDisplayChange **changes,
+                                     unsigned *nb_changes);
+/**
+ * \brief Sets a display list to its state after a given frame.
+ * \param[in] dl    SWFDisplayList to seek
+ * \param[in] frame Frame number, starting from 0
+ * \return < 0 if something went wrong.
+ */
+SWFError swf_display_list_seek(SWFDisplayList *dl, unsigned frame);
+/**
+ * \brief Gets the current contents of a display list.
+ * \param[in]  dl         SWFDisplayList to read
+ * \param[out] nb_objects Set to the number of objects
+ * \return Array of objects sorted by depth, valid until the SWFDisplayList is next used.
+ */
+const SWFDisplayObject *swf_display_list_get_objects(SWFDisplayList *dl, unsigned *nb_objects);
+/**
+ * \brief Gets the last frame applied to a display list.
+ * \param[in] dl SWFDisplayList to read
+ * \return Frame number, or -1 if no frames have been applied.
+ */
+int swf_display_list_get_frame(SWFDisplayList *dl);
+/**
+ * \brief Gets the SWFErrorDesc from a display list
+ * \param[in] dl SWFDisplayList to get an error from
+ * \return Pointer to SWFErrorDesc from the SWFDisplayList
+ */
+SWFErrorDesc *swf_display_list_get_error(SWFDisplayList *dl);
+/**
+ * \brief Frees an SWFDisplayList and all associated data.
+ * \param[in] dl SWFDisplayList to free
+ */
+void swf_display_list_free(SWFDisplayList *dl);
+
+/**
+ * \brief Called to write out part of an SWF file.
+ * \param[in] ctx User-provided pointer from SWFWriterOutput
+ * \param[in] buf Data to write
+ * \param[in] len Number of bytes in buf
+ * \return < 0 if something went wrong.
+ */
+typedef SWFError (*SWFWriteCallback)(void *ctx, const void *buf, size_t len);
+
+/**
+ * \brief Called to move the output position to an absolute offset.
+ * \param[in] ctx    User-provided pointer from SWFWriterOutput
+ * \param[in] offset Offset from the start of the file
+ * \return < 0 if something went wrong.
+ */
+typedef SWFError (*SWFSeekCallback)(void *ctx, uint64_t offset);
+
+/**
+ * \brief One piece of a gathered write
+ */
+typedef struct {
+    const void *base;       ///< Start of the data
+    size_t len;             ///< Number of bytes
+} SWFIOVec;
+
+/**
+ * \brief Called to write out several pieces of an SWF file at once, in order.
+ * \param[in] ctx    User-provided pointer from SWFWriterOutput
+ * \param[in] iov    Pieces to write
+ * \param[in] iovcnt Number of pieces
+ * \return < 0 if something went wrong.
+ */
+typedef SWFError (*SWFWritevCallback)(void *ctx, const SWFIOVec *iov, unsigned iovcnt);
+
+/**
+ * \brief Where an SWFWriter sends its output
+ */
+typedef struct {
+    SWFWriteCallback write; ///< Receives the file's bytes, in order
+    SWFSeekCallback seek;   ///< Optional; used to fill in header fields that
+                            /// aren't known until the end (file size, LZMA length)
+    void *ctx;              ///< Passed to write, seek and writev
+    SWFWritevCallback writev; ///< Optional; used by swf_writer_write for uncompressed
+                              /// output, pointing straight at tag payloads
+} SWFWriterOutput;
+
+/**
+ * \brief Settings for an SWFWriter
+ */
+typedef struct {
+    SWFCompression compression; ///< Compression to write; 0 to keep the SWF's,
+                                /// or the best its version supports if that's unset too
+    int level;                  ///< Compression level from 0 to 9; -1 for the default
+    uint32_t lzma_dict_size;    ///< LZMA dictionary size; 0 for the level's default.
+                                /// Never larger than the data needs.
+    unsigned threads;           ///< Threads compression may use; 0 or 1 for just the
+                                /// calling thread. ZLIB compresses blocks on this many
+                                /// threads; LZMA's match finder uses 2 at levels 5 and up.
+                                /// Ignored if libswf was configured with --disable-threads.
+} SWFWriterSettings;
+
+/**
+ * \brief Private data used when writing an SWF file
+ */
+typedef struct SWF_Writer SWFWriter;
+
+/**
+ * \brief Called to get the next tag when streaming tags to an SWFWriter.
+ * \param[in]  writer SWFWriter asking for a tag
+ * \param[out] tag    Set to the next tag, or to NULL after the last one.
+ *                    The tag MUST stay valid until the next call.
+ * \param[in]  ctx    User-provided pointer
+ * \return < 0 if something went wrong.
+ */
+typedef SWFError (*SWFWriterTagCallback)(SWFWriter *writer, SWFTag **tag, void *ctx);
+
+/**
+ * \brief Allocates an SWFWriter.
+ * Memory use is bounded and independent of the size of the file written.
+ * \param[in] output   Where to send output; copied
+ * \param[in] settings Settings to use; copied. NULL for the defaults.
+ * \return Pointer if the SWFWriter could be allocated; NULL otherwise.
+ */
+SWFWriter *swf_writer_init(SWFWriterOutput *output, SWFWriterSettings *settings);
+/**
+ * \brief Writes an SWF, with the tags in its tags array.
+ * The header's size field is computed from the tags; swf->size and
+ * swf->compression are set to what was written.
+ * An END tag is added after the last tag, so the array shouldn't end with one.
+ * \param[in] writer SWFWriter to write with
+ * \param[in] swf    SWF to write
+ * \return < 0 if something went wrong.
+ */
+SWFError swf_writer_write(SWFWriter *writer, SWF *swf);
+/**
+ * \brief Writes an SWF, with tags from a callback rather than its tags array.
+ * Only one tag needs to be in memory at a time.
+ * If swf->size is 0 or wrong, output.seek is used to patch the header afterwards;
+ * without it, the write fails.
+ * \param[in] writer   SWFWriter to write with
+ * \param[in] swf      SWF whose header fields are written
+ * \param[in] next_tag Called to get each tag in turn
+ * \param[in] ctx      User-provided pointer passed to next_tag
+ * \return < 0 if something went wrong.
+ */
+SWFError swf_writer_write_stream(SWFWriter *writer, SWF *swf,
+                                 SWFWriterTagCallback next_tag, void *ctx);
+/**
+ * \brief Called to read more of an input file.
+ * \param[in]     ctx User-provided pointer
+ * \param[out]    buf Buffer to read into
+ * \param[in,out] len Space in buf; set to the number of bytes read, or 0 at the end of the input
+ * \return < 0 if something went wrong.
+ */
+typedef SWFError (*SWFReadCallback)(void *ctx, void *buf, size_t *len);
+/**
+ * \brief Re-encodes an SWF file's body with the writer's compression settings.
+ * The input is decompressed and fed straight to the encoder; tags are never
+ * parsed, so memory use is bounded regardless of the file's size.
+ * A compression setting of 0 picks the best one the file's version allows.
+ * \param[in] writer SWFWriter to write with
+ * \param[in] read   Called to read the input file, in order
+ * \param[in] ctx    User-provided pointer passed to read
+ * \return < 0 if something went wrong, including if the input is truncated.
+ */
+SWFError swf_writer_transcode(SWFWriter *writer, SWFReadCallback read, void *ctx);
+/**
+ * \brief Gets the SWFErrorDesc from a writer
+ * \param[in] writer SWFWriter to get an error from
+ * \return Pointer to SWFErrorDesc from the SWFWriter
+ */
+SWFErrorDesc *swf_writer_get_error(SWFWriter *writer);
+/**
+ * \brief Frees an SWFWriter.
+ * \param[in] writer SWFWriter to free
+ */
+void swf_writer_free(SWFWriter *writer);
+
+/**
+ * \brief What swf_optimize does
+ */
+typedef enum {
+    SWF_OPTIMIZE_STRIP_DEBUG    = 1, ///< Drop EnableDebugger(2), DebugID and EnableTelemetry tags
+    SWF_OPTIMIZE_STRIP_METADATA = 2, ///< Drop ProductInfo and Metadata tags
+    SWF_OPTIMIZE_BITMAPS        = 4, ///< Recompress DefineBitsLossless(2) data, keeping
+                                     ///< the result only where it's smaller (requires zlib)
+} SWFOptimizeFlags;
+
+/**
+ * \brief Settings for swf_optimize
+ */
+typedef struct {
+    unsigned flags;             ///< SWFOptimizeFlags; 0 for all of them
+    int level;                  ///< Zlib level from 1 to 9 for bitmaps; 0 for 9
+    unsigned threads;           ///< Bitmaps to recompress at once; 0 or 1 for just the
+                                /// calling thread. Ignored if libswf was configured
+                                /// with --disable-threads.
+} SWFOptimizeSettings;
+
+/**
+ * \brief Shrinks an SWF in place, before it's written.
+ * Removed tags are freed, and the frame and character tables are rebuilt.
+ * Bitmaps that can't be decoded are left as they are.
+ * \param[in] swf      SWF to optimize; its tags must not be in use elsewhere
+ * \param[in] settings Settings to use. NULL for the defaults.
+ * \return < 0 if something went wrong.
+ */
+SWFError swf_optimize(SWF *swf, const SWFOptimizeSettings *settings);
+
+/**
+ * \brief A file for swf_batch to parse
+ */
+typedef struct {
+    const char *path;           ///< File to read, or NULL to parse data instead
+    const void *data;           ///< Whole file in memory, if path is NULL
+    size_t size;                ///< Size of data. For paths, used only to schedule
+                                /// larger files first; 0 to have swf_batch stat the file.
+    void *opaque;               ///< User-provided pointer, left untouched
+} SWFBatchItem;
+
+/**
+ * \brief Called once for each file in a batch, when it's done.
+ * May be called from several threads at once.
+ * \param[in] item The file that finished
+ * \param[in] swf  The SWF parsed from it, possibly incomplete; NULL if it
+ *                 couldn't be allocated. The callback now owns it, and must
+ *                 free it with swf_free.
+ * \param[in] err  What went wrong; err->code is SWF_OK if nothing did.
+ * \param[in] ctx  SWFBatchSettings->ctx
+ */
+typedef void (*SWFBatchCallback)(SWFBatchItem *item, SWF *swf, const SWFErrorDesc *err, void *ctx);
+
+/**
+ * \brief Settings for swf_batch
+ */
+typedef struct {
+    unsigned threads;           ///< Files to parse at once; 0 or 1 for just the calling
+                                /// thread. Ignored if libswf was configured with
+                                /// --disable-threads.
+    unsigned parser_flags;      ///< SWFParserFlags for every file
+    SWFParserCallbacks *callbacks; ///< Parser callbacks for every file, or NULL.
+                                /// These may be called from several threads at once.
+    const SWFParserLimits *limits; ///< Limits for every file, or NULL for none
+    SWFBatchCallback done_cb;   ///< Called as each file finishes. If NULL, each SWF
+                                /// is freed as soon as it's parsed.
+    void *ctx;                  ///< User-provided pointer, passed to done_cb
+} SWFBatchSettings;
+
+/**
+ * \brief Parses many files across a pool of threads, starting with the largest.
+ * Each file's result goes to settings->done_cb; problems with individual files
+ * don't stop the batch.
+ * \param[in] items    Files to parse. Sizes of paths may be filled in.
+ * \param[in] nb_items Number of items
+ * \param[in] settings Settings to use
+ * \return < 0 if the batch couldn't be started; SWF_OK once every file is done.
+ */
+SWFError swf_batch(SWFBatchItem *items, unsigned nb_items, const SWFBatchSettings *settings);
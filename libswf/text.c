@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * \brief Code table of a font seen earlier in the stream
+ */
+typedef struct {
+    uint16_t id;
+    unsigned nb_codes;
+    uint16_t *codes;
+} TextFont;
+
+/**
+ * \brief Private data used when extracting text
+ */
+struct SWF_TextExtractor {
+    SWFErrorDesc err;       ///< Last error that occurred on this SWFTextExtractor
+    SWFTextCallback cb;     ///< User-provided callback
+    void *ctx;              ///< User-provided callback context
+    TextFont *fonts;        ///< Fonts sorted by ID
+    unsigned nb_fonts;
+    unsigned max_fonts;
+    char *scratch;          ///< Conversion buffer for spans that aren't views
+    size_t scratch_size;
+};
+
+/**
+ * \brief Returns the length of the leading all-ASCII run of buf, 16 bytes at a time.
+ */
+static size_t ascii_prefix(const uint8_t *buf, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+        if (_mm_movemask_epi8(chunk))
+            break;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(buf + i)) & 0x80)
+            break;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, buf + i, 8);
+        if (word & 0x8080808080808080ULL)
+            break;
+    }
+#endif
+    while (i < len && buf[i] < 0x80)
+        i++;
+    return i;
+}
+
+static int utf8_valid(const uint8_t *buf, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        i += ascii_prefix(buf + i, len - i);
+        if (i == len)
+            break;
+        uint8_t c = buf[i];
+        unsigned n;
+        uint32_t min;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+            min = 0x80;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            min = 0x800;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            min = 0x10000;
+        } else {
+            return 0;
+        }
+        if (len - i <= n)
+            return 0;
+        uint32_t cp = c & (0x3F >> n);
+        for (unsigned j = 1; j <= n; j++) {
+            if ((buf[i + j] & 0xC0) != 0x80)
+                return 0;
+            cp = cp << 6 | (buf[i + j] & 0x3F);
+        }
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return 0;
+        i += n + 1;
+    }
+    return 1;
+}
+
+static SWFError reserve_scratch(SWFTextExtractor *ex, size_t size) {
+    if (size <= ex->scratch_size)
+        return SWF_OK;
+    char *scratch = realloc(ex->scratch, size);
+    if (!scratch)
+        return set_error(ex, SWF_NOMEM, "reserve_scratch: realloc failed");
+    ex->scratch = scratch;
+    ex->scratch_size = size;
+    return SWF_OK;
+}
+
+static size_t put_utf8(char *out, uint32_t cp) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xC0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp >= 0xD800 && cp <= 0xDFFF)
+        cp = 0xFFFD;
+    out[0] = 0xE0 | cp >> 12;
+    out[1] = 0x80 | (cp >> 6 & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+}
+
+static SWFError emit(SWFTextExtractor *ex, const SWFTag *tag, SWFTextSource source,
+                     uint16_t id, const char *text, size_t size, int borrowed) {
+    if (!size)
+        return SWF_OK;
+    SWFTextSpan span = {
+        .text = text,
+        .size = size,
+        .source = source,
+        .tag = tag,
+        .id = id,
+        .borrowed = borrowed,
+    };
+    SWFError ret = ex->cb(&span, ex->ctx);
+    if (ret < 0)
+        return set_error(ex, ret, "emit: text callback returned an error");
+    return ret;
+}
+
+/**
+ * \brief Emits a string from a payload, as a view if it's valid UTF-8.
+ * Anything else predates SWF6's switch to UTF-8, so it's taken as Latin-1.
+ */
+static SWFError emit_string(SWFTextExtractor *ex, const SWFTag *tag, SWFTextSource source,
+                            uint16_t id, const char *text, size_t size) {
+    SWFError ret = SWF_OK;
+    if (!text)
+        return SWF_OK;
+    if (utf8_valid((const uint8_t*)text, size))
+        return emit(ex, tag, source, id, text, size, 1);
+    if ((ret = reserve_scratch(ex, size * 2)))
+        return ret;
+    size_t out = 0;
+    for (size_t i = 0; i < size; i++)
+        out += put_utf8(ex->scratch + out, (uint8_t)text[i]);
+    return emit(ex, tag, source, id, ex->scratch, out, 0);
+}
+
+static TextFont *find_font(SWFTextExtractor *ex, uint16_t id) {
+    unsigned lo = 0, hi = ex->nb_fonts;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (ex->fonts[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < ex->nb_fonts && ex->fonts[lo].id == id ? ex->fonts + lo : NULL;
+}
+
+/**
+ * \brief Stores a copy of a font's code table, since the tag may be freed
+ * before any text using it is seen.
+ */
+static SWFError add_font(SWFTextExtractor *ex, uint16_t id, Reader *rd,
+                         unsigned nb_codes, int wide) {
+    TextFont *font = find_font(ex, id);
+    if (font)
+        // Redefinitions are ignored by the player, so ignore them here too
+        return SWF_OK;
+    if (ex->nb_fonts == ex->max_fonts) {
+        unsigned max_fonts = ex->max_fonts ? ex->max_fonts * 2 : 16;
+        TextFont *fonts = realloc(ex->fonts, max_fonts * sizeof(TextFont));
+        if (!fonts)
+            return set_error(ex, SWF_NOMEM, "add_font: realloc failed");
+        ex->fonts = fonts;
+        ex->max_fonts = max_fonts;
+    }
+    uint16_t *codes = malloc((nb_codes ? nb_codes : 1) * sizeof(uint16_t));
+    if (!codes)
+        return set_error(ex, SWF_NOMEM, "add_font: malloc failed");
+    for (unsigned i = 0; i < nb_codes; i++)
+        codes[i] = wide ? rd_16(rd) : rd_8(rd);
+    unsigned pos = 0;
+    while (pos < ex->nb_fonts && ex->fonts[pos].id < id)
+        pos++;
+    memmove(ex->fonts + pos + 1, ex->fonts + pos, (ex->nb_fonts - pos) * sizeof(TextFont));
+    ex->fonts[pos] = (TextFont){ .id = id, .nb_codes = nb_codes, .codes = codes };
+    ex->nb_fonts++;
+    return SWF_OK;
+}
+
+static SWFError parse_font_2(SWFTextExtractor *ex, const SWFTag *tag) {
+    Reader rd;
+    rd_init(&rd, tag->payload, tag->size);
+    uint8_t flags = rd_8(&rd);
+    int wide_offsets = flags & 0x08;
+    int wide_codes = (flags & 0x04) || tag->type == SWF_DEFINE_FONT_3;
+    rd_8(&rd); // LanguageCode
+    rd_skip(&rd, rd_8(&rd));
+    unsigned nb_glyphs = rd_16(&rd);
+    size_t table_start = rd.pos;
+    rd_skip(&rd, nb_glyphs * (wide_offsets ? 4 : 2));
+    uint32_t code_offset = wide_offsets ? rd_32(&rd) : rd_16(&rd);
+    if (rd.overrun || code_offset > tag->size - table_start)
+        return SWF_OK;
+    rd.pos = table_start + code_offset;
+    if (rd_left(&rd) < nb_glyphs * (wide_codes ? 2 : 1))
+        return SWF_OK;
+    return add_font(ex, tag->id, &rd, nb_glyphs, wide_codes);
+}
+
+static SWFError parse_font_info(SWFTextExtractor *ex, const SWFTag *tag) {
+    Reader rd;
+    rd_init(&rd, tag->payload, tag->size);
+    uint16_t id = rd_16(&rd);
+    rd_skip(&rd, rd_8(&rd));
+    int wide_codes = rd_8(&rd) & 0x01;
+    if (tag->type == SWF_DEFINE_FONT_INFO_2)
+        rd_8(&rd); // LanguageCode
+    if (rd.overrun)
+        return SWF_OK;
+    return add_font(ex, id, &rd, rd_left(&rd) / (wide_codes ? 2 : 1), wide_codes);
+}
+
+static SWFError parse_text(SWFTextExtractor *ex, const SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    Reader rd;
+    SWFRect bounds;
+    rd_init(&rd, tag->payload, tag->size);
+    rd_rect(&rd, &bounds);
+    // MATRIX
+    if (rd_bits(&rd, 1))
+        rd_bits(&rd, rd_bits(&rd, 5) * 2);
+    if (rd_bits(&rd, 1))
+        rd_bits(&rd, rd_bits(&rd, 5) * 2);
+    rd_bits(&rd, rd_bits(&rd, 5) * 2);
+    rd_align(&rd);
+    unsigned glyph_bits = rd_8(&rd), advance_bits = rd_8(&rd);
+    if (glyph_bits > 32 || advance_bits > 32)
+        return SWF_OK;
+    TextFont *font = NULL;
+    for (;;) {
+        uint8_t flags = rd_8(&rd);
+        if (!flags || rd.overrun)
+            break;
+        if (flags & 0x08)
+            font = find_font(ex, rd_16(&rd));
+        if (flags & 0x04)
+            rd_skip(&rd, tag->type == SWF_DEFINE_TEXT_2 ? 4 : 3);
+        if (flags & 0x01)
+            rd_16(&rd);
+        if (flags & 0x02)
+            rd_16(&rd);
+        if (flags & 0x08)
+            rd_16(&rd);
+        unsigned nb_glyphs = rd_8(&rd);
+        if ((ret = reserve_scratch(ex, nb_glyphs * 3)))
+            return ret;
+        size_t out = 0;
+        for (unsigned i = 0; i < nb_glyphs; i++) {
+            uint32_t glyph = rd_bits(&rd, glyph_bits);
+            rd_bits(&rd, advance_bits);
+            uint32_t cp = font && glyph < font->nb_codes ? font->codes[glyph] : 0xFFFD;
+            out += put_utf8(ex->scratch + out, cp);
+        }
+        rd_align(&rd);
+        if (rd.overrun)
+            break;
+        if ((ret = emit(ex, tag, SWF_TEXT_GLYPHS, tag->id, ex->scratch, out, 0)))
+            return ret;
+    }
+    return SWF_OK;
+}
+
+static SWFError parse_edit_text(SWFTextExtractor *ex, const SWFTag *tag) {
+    Reader rd;
+    SWFRect bounds;
+    size_t len;
+    rd_init(&rd, tag->payload, tag->size);
+    rd_rect(&rd, &bounds);
+    uint8_t flags = rd_8(&rd), flags2 = rd_8(&rd);
+    if (flags & 0x01)
+        rd_16(&rd); // FontID
+    if (flags2 & 0x80)
+        rd_string(&rd, &len); // FontClass
+    if ((flags & 0x01) || (flags2 & 0x80))
+        rd_16(&rd); // FontHeight
+    if (flags & 0x04)
+        rd_skip(&rd, 4); // TextColor
+    if (flags & 0x02)
+        rd_16(&rd); // MaxLength
+    if (flags2 & 0x20)
+        rd_skip(&rd, 9); // Layout
+    rd_string(&rd, &len); // VariableName
+    if (!(flags & 0x80))
+        return SWF_OK;
+    const char *text = rd_string(&rd, &len);
+    return emit_string(ex, tag, (flags2 & 0x02) ? SWF_TEXT_EDIT_HTML : SWF_TEXT_EDIT_TEXT,
+                       tag->id, text, len);
+}
+
+static SWFError parse_actions(SWFTextExtractor *ex, const SWFTag *tag, Reader *rd) {
+    SWFError ret = SWF_OK;
+    for (;;) {
+        uint8_t code = rd_8(rd);
+        if (!code || rd->overrun)
+            return SWF_OK;
+        if (!(code & 0x80))
+            continue;
+        uint16_t len = rd_16(rd);
+        if (code == 0x88) { // ActionConstantPool
+            Reader pool;
+            rd_init(&pool, rd_ptr(rd), len < rd_left(rd) ? len : rd_left(rd));
+            unsigned count = rd_16(&pool);
+            for (unsigned i = 0; i < count; i++) {
+                size_t str_len;
+                const char *str = rd_string(&pool, &str_len);
+                if (!str)
+                    break;
+                if ((ret = emit_string(ex, tag, SWF_TEXT_CONSTANT_POOL, 0, str, str_len)))
+                    return ret;
+            }
+        }
+        rd_skip(rd, len);
+    }
+}
+
+static SWFError parse_abc(SWFTextExtractor *ex, const SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    Reader rd;
+    size_t len;
+    rd_init(&rd, tag->payload, tag->size);
+    if (tag->type == SWF_DO_ABC) {
+        rd_32(&rd); // Flags
+        rd_string(&rd, &len); // Name
+    }
+    rd_16(&rd); // minor_version
+    rd_16(&rd); // major_version
+    for (int i = 0; i < 2; i++) {
+        // int and uint pools
+        uint32_t count = rd_u30(&rd);
+        for (uint32_t j = 1; j < count && !rd.overrun; j++)
+            rd_u30(&rd);
+    }
+    uint32_t count = rd_u30(&rd);
+    if (count > 1)
+        rd_skip(&rd, (size_t)(count - 1) * 8);
+    count = rd_u30(&rd);
+    for (uint32_t i = 1; i < count && !rd.overrun; i++) {
+        uint32_t str_len = rd_u30(&rd);
+        const char *str = (const char*)rd_ptr(&rd);
+        rd_skip(&rd, str_len);
+        if (rd.overrun)
+            break;
+        if ((ret = emit_string(ex, tag, SWF_TEXT_ABC_STRING, 0, str, str_len)))
+            return ret;
+    }
+    return SWF_OK;
+}
+
+static SWFError parse_exports(SWFTextExtractor *ex, const SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    Reader rd;
+    rd_init(&rd, tag->payload, tag->size);
+    unsigned count = rd_16(&rd);
+    for (unsigned i = 0; i < count; i++) {
+        size_t len;
+        uint16_t id = rd_16(&rd);
+        const char *name = rd_string(&rd, &len);
+        if (!name)
+            break;
+        if ((ret = emit_string(ex, tag, SWF_TEXT_EXPORT_NAME, id, name, len)))
+            return ret;
+    }
+    return SWF_OK;
+}
+
+static SWFError parse_sprite(SWFTextExtractor *ex, const SWFTag *tag) {
+    SWFError ret = SWF_OK;
+    Reader rd;
+    rd_init(&rd, tag->payload, tag->size);
+    rd_16(&rd); // FrameCount
+    for (;;) {
+        uint16_t code;
+        uint32_t len;
+        if (!rd_tag_header(&rd, &code, &len) || code == SWF_END)
+            return SWF_OK;
+        SWFTag sub = {
+            .type = code,
+            .size = len,
+            .payload = (uint8_t*)rd_ptr(&rd),
+            .id = 0,
+        };
+        if (code != SWF_DEFINE_SPRITE &&
+            (ret = swf_text_extractor_add_tag(ex, &sub)))
+            return ret;
+        rd_skip(&rd, len);
+    }
+}
+
+SWFTextExtractor *swf_text_extractor_init(SWFTextCallback cb, void *ctx) {
+    SWFTextExtractor *out = calloc(1, sizeof(SWFTextExtractor));
+    if (!out)
+        return NULL;
+    out->cb = cb;
+    out->ctx = ctx;
+    return out;
+}
+
+SWFError swf_text_extractor_add_tag(SWFTextExtractor *ex, const SWFTag *tag) {
+    Reader rd;
+    size_t len;
+    const char *str;
+    if (!tag->payload)
+        return SWF_OK;
+    switch (tag->type) {
+    case SWF_DEFINE_FONT_2:
+    case SWF_DEFINE_FONT_3:
+        return parse_font_2(ex, tag);
+    case SWF_DEFINE_FONT_INFO:
+    case SWF_DEFINE_FONT_INFO_2:
+        return parse_font_info(ex, tag);
+    case SWF_DEFINE_TEXT:
+    case SWF_DEFINE_TEXT_2:
+        return parse_text(ex, tag);
+    case SWF_DEFINE_EDIT_TEXT:
+        return parse_edit_text(ex, tag);
+    case SWF_DO_ACTION:
+        rd_init(&rd, tag->payload, tag->size);
+        return parse_actions(ex, tag, &rd);
+    case SWF_DO_INIT_ACTION:
+        rd_init(&rd, tag->payload, tag->size);
+        rd_16(&rd); // SpriteID
+        return parse_actions(ex, tag, &rd);
+    case SWF_DO_ABC:
+        return parse_abc(ex, tag);
+    case SWF_FRAME_LABEL:
+        rd_init(&rd, tag->payload, tag->size);
+        str = rd_string(&rd, &len);
+        return emit_string(ex, tag, SWF_TEXT_FRAME_LABEL, 0, str, len);
+    case SWF_EXPORT_ASSETS:
+        return parse_exports(ex, tag);
+    case SWF_METADATA:
+        rd_init(&rd, tag->payload, tag->size);
+        str = rd_string(&rd, &len);
+        return emit_string(ex, tag, SWF_TEXT_METADATA, 0, str, len);
+    case SWF_DEFINE_SPRITE:
+        return parse_sprite(ex, tag);
+    default:
+        return SWF_OK;
+    }
+}
+
+SWFErrorDesc *swf_text_extractor_get_error(SWFTextExtractor *ex) {
+    return &ex->err;
+}
+
+void swf_text_extractor_free(SWFTextExtractor *ex) {
+    if (!ex)
+        return;
+    for (unsigned i = 0; i < ex->nb_fonts; i++)
+        free(ex->fonts[i].codes);
+    free(ex->fonts);
+    free(ex->scratch);
+    free(ex);
+}
+
+SWFError swf_extract_text(SWF *swf, SWFTextCallback cb, void *ctx) {
+    SWFError ret = SWF_OK;
+    SWFTextExtractor *ex = swf_text_extractor_init(cb, ctx);
+    if (!ex)
+        return set_error(swf, SWF_NOMEM, "swf_extract_text: Not enough memory to allocate extractor");
+    for (unsigned i = 0; i < swf->nb_tags && ret == SWF_OK; i++)
+        ret = copy_error(swf, ex, swf_text_extractor_add_tag(ex, swf->tags + i));
+    swf_text_extractor_free(ex);
+    return ret < 0 ? ret : SWF_OK;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Fires SWFParserTrace hooks, and the matching USDT probes where
+ * <sys/sdt.h> is available. Without --enable-trace, every function here
+ * is empty, so calls to them compile to nothing.
+ */
+
+#include "swf.h"
+#include <time.h>
+
+#if HAVE_TRACE && HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+static inline uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \brief Reads the clock for the start of a decoder call.
+ * \return Monotonic time in nanoseconds if anything will see the decode
+ * event; 0 otherwise.
+ */
+static inline uint64_t trace_clock(const SWFParserTrace *trace) {
+#if HAVE_TRACE
+#if !HAVE_SYS_SDT_H
+    if (!trace->decode)
+        return 0;
+#endif
+    return trace_now();
+#else
+    return 0;
+#endif
+}
+
+static inline void trace_header(const SWFParserTrace *trace, const SWF *swf) {
+#if HAVE_TRACE
+#if HAVE_SYS_SDT_H
+    DTRACE_PROBE3(libswf, header, swf->compression, swf->version, swf->size);
+#endif
+    if (trace->header)
+        trace->header(trace->ctx, trace_now(), swf);
+#endif
+}
+
+static inline void trace_decoder_init(const SWFParserTrace *trace, SWFCompression compression, size_t dic_size) {
+#if HAVE_TRACE
+#if HAVE_SYS_SDT_H
+    DTRACE_PROBE2(libswf, decoder_init, compression, dic_size);
+#endif
+    if (trace->decoder_init)
+        trace->decoder_init(trace->ctx, trace_now(), compression, dic_size);
+#endif
+}
+
+static inline void trace_buffer_grow(const SWFParserTrace *trace, size_t old_size, size_t new_size, size_t used) {
+#if HAVE_TRACE
+#if HAVE_SYS_SDT_H
+    DTRACE_PROBE3(libswf, buffer_grow, old_size, new_size, used);
+#endif
+    if (trace->buffer_grow)
+        trace->buffer_grow(trace->ctx, trace_now(), old_size, new_size, used);
+#endif
+}
+
+static inline void trace_tag(const SWFParserTrace *trace, const SWFTag *tag) {
+#if HAVE_TRACE
+#if HAVE_SYS_SDT_H
+    DTRACE_PROBE3(libswf, tag, tag->type, tag->size, tag->offset);
+#endif
+    if (trace->tag)
+        trace->tag(trace->ctx, trace_now(), tag);
+#endif
+}
+
+/**
+ * \brief Reports a decoder call.
+ * \param[in] start When it started, from trace_clock
+ * \param[in] end   When it finished, from trace_clock; 0 for now
+ */
+static inline void trace_decode(const SWFParserTrace *trace, uint64_t start, uint64_t end, size_t in_bytes, size_t out_bytes) {
+#if HAVE_TRACE
+    if (!start)
+        return;
+    end = end ? end : trace_now();
+#if HAVE_SYS_SDT_H
+    DTRACE_PROBE4(libswf, decode, start, end, in_bytes, out_bytes);
+#endif
+    if (trace->decode)
+        trace->decode(trace->ctx, start, end, in_bytes, out_bytes);
+#endif
+}
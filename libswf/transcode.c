@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "writer.h"
+#include "lzma/LzmaDec.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TRANSCODE_IN_SIZE (64 * 1024)
+#define LZMA_HEADER_SIZE (LZMA_PROPS_SIZE + 4)
+
+/**
+ * \brief Decompresses the input file's body, for use as a WriterSource
+ */
+typedef struct {
+    SWFReadCallback read;       ///< User-provided input
+    void *ctx;                  ///< Passed to read
+    SWFCompression compression; ///< Compression of the input
+    uint8_t *in;                ///< Input not yet consumed is in [in + in_pos, in + in_size)
+    size_t in_pos;
+    size_t in_size;
+    int eof;                    ///< Nonzero once read has reported the end of the input
+    uint64_t remaining;         ///< Decompressed body bytes still expected
+    uint8_t *out;               ///< Inflate output
+#if HAVE_LIBZ
+    z_stream zstrm;             ///< Zlib decoder struct
+    int zlib_init;
+#endif
+    CLzmaDec lzma;              ///< LZMA decoder struct; its dictionary is the output
+} Transcoder;
+
+/**
+ * \brief Reads until at least `want` unconsumed bytes are buffered, or the input ends.
+ */
+static SWFError fill(SWFWriter *writer, Transcoder *tc, size_t want) {
+    if (tc->in_pos) {
+        memmove(tc->in, tc->in + tc->in_pos, tc->in_size - tc->in_pos);
+        tc->in_size -= tc->in_pos;
+        tc->in_pos = 0;
+    }
+    while (!tc->eof && tc->in_size < want) {
+        size_t len = TRANSCODE_IN_SIZE - tc->in_size;
+        SWFError ret = tc->read(tc->ctx, tc->in + tc->in_size, &len);
+        if (ret < 0)
+            return set_error(writer, ret, "fill: read callback returned an error");
+        if (!len)
+            tc->eof = 1;
+        tc->in_size += len;
+    }
+    return SWF_OK;
+}
+
+static SWFError truncated(SWFWriter *writer) {
+    return set_error(writer, SWF_INVALID, "transcode_source: Input ended before its declared size");
+}
+
+/**
+ * \brief Reads at least one more byte than is currently buffered.
+ */
+static SWFError more_input(SWFWriter *writer, Transcoder *tc) {
+    size_t avail = tc->in_size - tc->in_pos;
+    SWFError ret = fill(writer, tc, avail + 1);
+    if (ret)
+        return ret;
+    return tc->in_size > avail ? SWF_OK : truncated(writer);
+}
+
+static SWFError transcode_source(SWFWriter *writer, WriterChunk *chunk) {
+    SWFError ret = SWF_OK;
+    Transcoder *tc = writer->source_ctx;
+    if (!tc->remaining)
+        return SWF_FINISHED;
+    if (tc->in_pos == tc->in_size && (ret = fill(writer, tc, 1)))
+        return ret;
+    size_t avail = tc->in_size - tc->in_pos;
+    switch (tc->compression) {
+    case SWF_UNCOMPRESSED:
+        if (!avail)
+            return truncated(writer);
+        // Pass the input buffer straight through
+        chunk->ptr = tc->in + tc->in_pos;
+        chunk->size = avail < tc->remaining ? avail : tc->remaining;
+        tc->in_pos += chunk->size;
+        break;
+#if HAVE_LIBZ
+    case SWF_ZLIB: {
+        z_stream *zstrm = &tc->zstrm;
+        zstrm->next_out = tc->out;
+        zstrm->avail_out = tc->remaining < TRANSCODE_IN_SIZE ? tc->remaining : TRANSCODE_IN_SIZE;
+        while (zstrm->next_out == tc->out) {
+            if (tc->in_pos == tc->in_size && (ret = more_input(writer, tc)))
+                return ret;
+            zstrm->next_in = tc->in + tc->in_pos;
+            zstrm->avail_in = tc->in_size - tc->in_pos;
+            int z_ret = inflate(zstrm, Z_NO_FLUSH);
+            tc->in_pos = tc->in_size - zstrm->avail_in;
+            switch (z_ret) {
+            case Z_OK:
+            case Z_BUF_ERROR:
+                break;
+            case Z_STREAM_END:
+                if (zstrm->next_out == tc->out)
+                    return truncated(writer);
+                break;
+            case Z_DATA_ERROR:
+                return set_error(writer, SWF_INVALID, zstrm->msg);
+            case Z_MEM_ERROR:
+                return set_error(writer, SWF_NOMEM, zstrm->msg);
+            default:
+                return set_error(writer, SWF_INTERNAL_ERROR, "transcode_source: inflate returned an our-fault error");
+            }
+            if (z_ret == Z_STREAM_END)
+                break;
+        }
+        chunk->ptr = tc->out;
+        chunk->size = zstrm->next_out - tc->out;
+        break;
+    }
+#endif
+    case SWF_LZMA: {
+        CLzmaDec *lzma = &tc->lzma;
+        if (lzma->dicPos == lzma->dicBufSize)
+            lzma->dicPos = 0;
+        SizeT start = lzma->dicPos;
+        SizeT limit = lzma->dicBufSize - start < tc->remaining ?
+                      lzma->dicBufSize : start + tc->remaining;
+        // Decoded data is handed out straight from the dictionary
+        while (lzma->dicPos == start) {
+            ELzmaStatus status;
+            SizeT in_len = tc->in_size - tc->in_pos;
+            SRes lz_ret = LzmaDec_DecodeToDic(lzma, limit, tc->in + tc->in_pos, &in_len,
+                                              LZMA_FINISH_ANY, &status);
+            tc->in_pos += in_len;
+            if (lz_ret == SZ_ERROR_DATA)
+                return set_error(writer, SWF_INVALID, "transcode_source: Data error in LzmaDec_DecodeToDic");
+            else if (lz_ret != SZ_OK)
+                return set_error(writer, SWF_UNKNOWN, "transcode_source: Unknown error in LzmaDec_DecodeToDic");
+            if (lzma->dicPos != start)
+                break;
+            if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+                return truncated(writer);
+            if ((ret = more_input(writer, tc)))
+                return ret;
+        }
+        chunk->ptr = lzma->dic + start;
+        chunk->size = lzma->dicPos - start;
+        break;
+    }
+    default:
+        return set_error(writer, SWF_RECOMPILE, "transcode_source: ZLIB compression requires ZLIB");
+    }
+    tc->remaining -= chunk->size;
+    return SWF_OK;
+}
+
+/**
+ * \brief Reads the input's header and sets up its decoder.
+ */
+static SWFError transcode_init(SWFWriter *writer, Transcoder *tc, SWF *swf) {
+    SWFError ret = SWF_OK;
+    if ((ret = fill(writer, tc, 8)))
+        return ret;
+    uint8_t *header = tc->in;
+    if (tc->in_size < 8 || header[1] != 'W' || header[2] != 'S' ||
+        (header[0] != SWF_UNCOMPRESSED && header[0] != SWF_ZLIB && header[0] != SWF_LZMA))
+        return set_error(writer, SWF_INVALID, "transcode_init: Input isn't an SWF file");
+    tc->compression = header[0];
+    swf->version = header[3];
+    swf->size = read_32(header + 4);
+    if (swf->size < 8)
+        return set_error(writer, SWF_INVALID, "transcode_init: Declared size is too small");
+    tc->remaining = swf->size - 8;
+    tc->in_pos = 8;
+    switch (tc->compression) {
+    case SWF_UNCOMPRESSED:
+        return SWF_OK;
+    case SWF_ZLIB:
+#if HAVE_LIBZ
+        if (!(tc->out = malloc(TRANSCODE_IN_SIZE)))
+            return set_error(writer, SWF_NOMEM, "transcode_init: Not enough memory for inflate buffer");
+        switch (inflateInit(&tc->zstrm)) {
+        case Z_OK:
+            tc->zlib_init = 1;
+            return SWF_OK;
+        case Z_MEM_ERROR:
+            return set_error(writer, SWF_NOMEM, "transcode_init: inflateInit returned Z_MEM_ERROR");
+        default:
+            return set_error(writer, SWF_INTERNAL_ERROR, "transcode_init: inflateInit returned an our-fault error");
+        }
+#else
+        return set_error(writer, SWF_RECOMPILE, "transcode_init: ZLIB compression requires ZLIB");
+#endif
+    default: {
+        if ((ret = fill(writer, tc, LZMA_HEADER_SIZE)))
+            return ret;
+        if (tc->in_size - tc->in_pos < LZMA_HEADER_SIZE)
+            return truncated(writer);
+        const uint8_t *props = tc->in + tc->in_pos + 4;
+        tc->in_pos += LZMA_HEADER_SIZE;
+        CLzmaProps decoded;
+        if (LzmaProps_Decode(&decoded, props, LZMA_PROPS_SIZE) != SZ_OK)
+            return set_error(writer, SWF_INVALID, "transcode_init: Invalid LZMA properties");
+        SRes lz_ret = LzmaDec_AllocateProbs(&tc->lzma, props, LZMA_PROPS_SIZE, &allocator);
+        if (lz_ret == SZ_ERROR_MEM)
+            return set_error(writer, SWF_NOMEM, "transcode_init: LzmaDec_AllocateProbs returned SZ_ERROR_MEM");
+        else if (lz_ret != SZ_OK)
+            return set_error(writer, SWF_INVALID, "transcode_init: LzmaDec_AllocateProbs failed");
+        // Matches can't reach back past the start of the data, so the
+        // dictionary never needs to be bigger than the body.
+        SizeT dict_size = decoded.dicSize < tc->remaining ? decoded.dicSize : tc->remaining;
+        dict_size = dict_size ? dict_size : 1;
+        if (!(tc->lzma.dic = malloc(dict_size)))
+            return set_error(writer, SWF_NOMEM, "transcode_init: Not enough memory for LZMA dictionary");
+        tc->lzma.dicBufSize = dict_size;
+        LzmaDec_Init(&tc->lzma);
+        return SWF_OK;
+    }
+    }
+}
+
+SWFError swf_writer_transcode(SWFWriter *writer, SWFReadCallback read, void *ctx) {
+    SWFError ret = SWF_OK;
+    SWF swf = { .compression = 0 };
+    Transcoder tc = { .read = read, .ctx = ctx };
+    LzmaDec_Construct(&tc.lzma);
+    if (!(tc.in = malloc(TRANSCODE_IN_SIZE))) {
+        ret = set_error(writer, SWF_NOMEM, "swf_writer_transcode: Not enough memory for input buffer");
+        goto end;
+    }
+    if ((ret = transcode_init(writer, &tc, &swf)))
+        goto end;
+    writer->swf = &swf;
+    writer->source = transcode_source;
+    writer->source_ctx = &tc;
+    writer->stable = 0;
+    ret = writer_run(writer, swf.size);
+    writer->swf = NULL;
+    writer->source_ctx = NULL;
+
+end:
+#if HAVE_LIBZ
+    if (tc.zlib_init)
+        inflateEnd(&tc.zstrm);
+#endif
+    LzmaDec_FreeProbs(&tc.lzma, &allocator);
+    free(tc.lzma.dic);
+    free(tc.out);
+    free(tc.in);
+    return ret;
+}
@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "swf.h"
+#include "internal.h"
+#include "writer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LATEST_VERSION 43
+#define LZMA_HEADER_SIZE (LZMA_PROPS_SIZE + 4)
+
+static inline void write_16(uint8_t *buf, uint16_t val) {
+    buf[0] = val;
+    buf[1] = val >> 8;
+}
+
+static inline void write_32(uint8_t *buf, uint32_t val) {
+    buf[0] = val;
+    buf[1] = val >> 8;
+    buf[2] = val >> 16;
+    buf[3] = val >> 24;
+}
+
+static unsigned sbits_needed(int32_t val) {
+    unsigned bits = 1;
+    uint32_t mag = val < 0 ? ~(uint32_t)val : (uint32_t)val;
+    while (mag) {
+        bits++;
+        mag >>= 1;
+    }
+    return bits;
+}
+
+/**
+ * \brief Gets the field width a RECT needs for all of its coordinates.
+ * \return Up to 32. NBits is 5 bits wide, so a RECT needing 32 can't be written.
+ */
+static unsigned rect_bits(const SWFRect *rect) {
+    int32_t vals[4] = { rect->x_min, rect->x_max, rect->y_min, rect->y_max };
+    unsigned nb_bits = 0;
+    for (int i = 0; i < 4; i++) {
+        unsigned bits = sbits_needed(vals[i]);
+        nb_bits = bits > nb_bits ? bits : nb_bits;
+    }
+    return nb_bits;
+}
+
+/**
+ * \brief Writes a RECT into buf. rect_bits(rect) MUST be at most 31.
+ * \return Number of bytes written (at most 17)
+ */
+static size_t put_rect(uint8_t *buf, const SWFRect *rect) {
+    int32_t vals[4] = { rect->x_min, rect->x_max, rect->y_min, rect->y_max };
+    unsigned nb_bits = rect_bits(rect);
+    size_t bit = 0, size = (5 + nb_bits * 4 + 7) >> 3;
+    memset(buf, 0, size);
+    for (int i = -1; i < 4; i++) {
+        uint32_t val = i < 0 ? nb_bits : (uint32_t)vals[i];
+        unsigned len = i < 0 ? 5 : nb_bits;
+        for (unsigned j = len; j-- > 0; bit++)
+            if (val >> j & 1)
+                buf[bit >> 3] |= 0x80 >> (bit & 7);
+    }
+    return size;
+}
+
+/**
+ * \brief Gets the size of a tag's header, including any ID.
+ */
+static inline size_t tag_header_size(const SWFTag *tag) {
+    size_t id_size = tag_has_id(tag->type) ? 2 : 0;
+    int long_header = (tag->flags & SWF_TAG_LONG_HEADER) || tag->size + id_size >= 0x3F;
+    return (long_header ? 6 : 2) + id_size;
+}
+
+static size_t put_tag_header(uint8_t *buf, const SWFTag *tag) {
+    size_t size = tag_header_size(tag);
+    uint32_t len = tag->size + (tag_has_id(tag->type) ? 2 : 0);
+    if (size - (tag_has_id(tag->type) ? 2 : 0) == 6) {
+        write_16(buf, tag->type << 6 | 0x3F);
+        write_32(buf + 2, len);
+    } else {
+        write_16(buf, tag->type << 6 | len);
+    }
+    if (tag_has_id(tag->type))
+        write_16(buf + size - 2, tag->id);
+    return size;
+}
+
+static size_t put_swf_header2(uint8_t *buf, const SWF *swf) {
+    size_t size = put_rect(buf, &swf->frame_size);
+    write_16(buf + size, swf->frame_rate);
+    write_16(buf + size + 2, swf->frame_count);
+    return size + 4;
+}
+
+static uint64_t compute_size(const SWF *swf) {
+    uint8_t tmp[32];
+    uint64_t size = 8 + put_swf_header2(tmp, swf) + 2;
+    for (unsigned i = 0; i < swf->nb_tags; i++)
+        size += tag_header_size(swf->tags + i) + swf->tags[i].size;
+    return size;
+}
+
+static SWFError tag_source(SWFWriter *writer, WriterChunk *chunk) {
+    SWFError ret = SWF_OK;
+    switch (writer->state) {
+    case WRITER_HEADER:
+        chunk->ptr = writer->scratch;
+        chunk->size = put_swf_header2(writer->scratch, writer->swf);
+        writer->state = WRITER_TAG_HEADER;
+        return SWF_OK;
+    case WRITER_TAG_HEADER:
+        if (writer->next_tag) {
+            writer->tag = NULL;
+            if ((ret = writer->next_tag(writer, &writer->tag, writer->next_tag_ctx)) < 0)
+                return set_error(writer, ret, "tag_source: next_tag callback returned an error");
+        } else {
+            writer->tag = writer->tag_index < writer->swf->nb_tags ?
+                          writer->swf->tags + writer->tag_index++ : NULL;
+        }
+        if (!writer->tag) {
+            writer->state = WRITER_FINISHED;
+            chunk->ptr = writer->scratch;
+            chunk->size = 2;
+            write_16(writer->scratch, SWF_END << 6);
+            return SWF_OK;
+        }
+        chunk->ptr = writer->scratch;
+        chunk->size = put_tag_header(writer->scratch, writer->tag);
+        writer->state = writer->tag->size ? WRITER_TAG_PAYLOAD : WRITER_TAG_HEADER;
+        // If the original header is still in front of the payload and
+        // nothing's changed, the whole tag can go out as one chunk.
+        if (writer->tag->size && writer->tag->raw_header == chunk->size &&
+            !memcmp(writer->tag->payload - chunk->size, writer->scratch, chunk->size)) {
+            chunk->ptr = writer->tag->payload - chunk->size;
+            chunk->size += writer->tag->size;
+            writer->state = WRITER_TAG_HEADER;
+        }
+        return SWF_OK;
+    case WRITER_TAG_PAYLOAD:
+        chunk->ptr = writer->tag->payload;
+        chunk->size = writer->tag->size;
+        writer->state = WRITER_TAG_HEADER;
+        return SWF_OK;
+    default:
+        return SWF_FINISHED;
+    }
+}
+
+SWFError writer_next_chunk(SWFWriter *writer, WriterChunk *chunk) {
+    SWFError ret = writer->source(writer, chunk);
+    if (ret == SWF_OK)
+        writer->body_size += chunk->size;
+    return ret;
+}
+
+SWFError writer_output(SWFWriter *writer, const void *buf, size_t size) {
+    SWFError ret = writer->output.write(writer->output.ctx, buf, size);
+    if (ret < 0)
+        return set_error(writer, ret, "writer_output: write callback returned an error");
+    writer->written += size;
+    return SWF_OK;
+}
+
+static SWFError flush_gathered(SWFWriter *writer, unsigned *nb_iov, size_t *staged) {
+    size_t size = 0;
+    for (unsigned i = 0; i < *nb_iov; i++)
+        size += writer->iov[i].len;
+    SWFError ret = writer->output.writev(writer->output.ctx, writer->iov, *nb_iov);
+    if (ret < 0)
+        return set_error(writer, ret, "flush_gathered: writev callback returned an error");
+    writer->written += size;
+    *nb_iov = 0;
+    *staged = 0;
+    return SWF_OK;
+}
+
+/**
+ * \brief Writes the body with writev, pointing straight at the chunks.
+ * Chunks in writer->scratch are copied into out_buf, since the source
+ * reuses it; everything else must stay valid until the write is done.
+ */
+static SWFError write_gathered(SWFWriter *writer) {
+    SWFError ret = SWF_OK;
+    WriterChunk chunk;
+    unsigned nb_iov = 0;
+    size_t staged = 0;
+    if (!writer->iov && !(writer->iov = malloc(WRITER_IOV_MAX * sizeof(SWFIOVec))))
+        return set_error(writer, SWF_NOMEM, "write_gathered: Not enough memory for iovec array");
+    while ((ret = writer_next_chunk(writer, &chunk)) == SWF_OK) {
+        if (!chunk.size)
+            continue;
+        if (nb_iov == WRITER_IOV_MAX ||
+            (chunk.ptr == writer->scratch && staged + chunk.size > WRITER_OUT_SIZE))
+            if ((ret = flush_gathered(writer, &nb_iov, &staged)))
+                return ret;
+        if (chunk.ptr == writer->scratch) {
+            uint8_t *dst = writer->out_buf + staged;
+            memcpy(dst, chunk.ptr, chunk.size);
+            staged += chunk.size;
+            // Merge with the previous piece if it was staged right before this one
+            if (nb_iov && (const uint8_t*)writer->iov[nb_iov - 1].base + writer->iov[nb_iov - 1].len == dst) {
+                writer->iov[nb_iov - 1].len += chunk.size;
+                continue;
+            }
+            chunk.ptr = dst;
+        }
+        writer->iov[nb_iov++] = (SWFIOVec){ chunk.ptr, chunk.size };
+    }
+    if (ret < 0)
+        return ret;
+    return nb_iov ? flush_gathered(writer, &nb_iov, &staged) : SWF_OK;
+}
+
+static SWFError write_uncompressed(SWFWriter *writer) {
+    SWFError ret = SWF_OK;
+    WriterChunk chunk;
+    if (writer->output.writev && writer->stable)
+        return write_gathered(writer);
+    while ((ret = writer_next_chunk(writer, &chunk)) == SWF_OK)
+        if (chunk.size && (ret = writer_output(writer, chunk.ptr, chunk.size)))
+            return ret;
+    return ret == SWF_FINISHED ? SWF_OK : ret;
+}
+
+#if HAVE_LIBZ
+SWFError writer_zlib_error(SWFWriter *writer, int z_ret) {
+    switch (z_ret) {
+    case Z_MEM_ERROR:
+        return set_error(writer, SWF_NOMEM, "writer_zlib_error: zlib returned Z_MEM_ERROR");
+    default:
+        return set_error(writer, SWF_INTERNAL_ERROR, "writer_zlib_error: zlib returned an our-fault error");
+    }
+}
+
+static SWFError write_zlib(SWFWriter *writer) {
+    SWFError ret = SWF_OK;
+    z_stream *zstrm = &writer->zstrm;
+    int level = writer->settings.level < 0 ? Z_DEFAULT_COMPRESSION : writer->settings.level;
+    int z_ret = deflateInit(zstrm, level > 9 ? 9 : level);
+    if (z_ret != Z_OK)
+        return writer_zlib_error(writer, z_ret);
+    zstrm->next_out = writer->out_buf;
+    zstrm->avail_out = WRITER_OUT_SIZE;
+    int flush = Z_NO_FLUSH;
+    do {
+        WriterChunk chunk = { NULL, 0 };
+        if ((ret = writer_next_chunk(writer, &chunk)) == SWF_FINISHED)
+            flush = Z_FINISH;
+        else if (ret < 0)
+            break;
+        zstrm->next_in = (uint8_t*)chunk.ptr;
+        zstrm->avail_in = chunk.size;
+        do {
+            z_ret = deflate(zstrm, flush);
+            if (z_ret == Z_STREAM_ERROR) {
+                ret = writer_zlib_error(writer, z_ret);
+                break;
+            }
+            if (!zstrm->avail_out || z_ret == Z_STREAM_END) {
+                if ((ret = writer_output(writer, writer->out_buf, WRITER_OUT_SIZE - zstrm->avail_out)))
+                    break;
+                zstrm->next_out = writer->out_buf;
+                zstrm->avail_out = WRITER_OUT_SIZE;
+            }
+        } while (zstrm->avail_in || (flush == Z_FINISH && z_ret != Z_STREAM_END));
+    } while (ret >= 0 && flush != Z_FINISH);
+    deflateEnd(zstrm);
+    return ret < 0 ? ret : SWF_OK;
+}
+#endif
+
+/**
+ * \brief Adapts the writer's source to the LZMA encoder's pull-style input.
+ */
+typedef struct {
+    ISeqInStream vt;
+    SWFWriter *writer;
+    SWFError ret;
+} WriterInStream;
+
+static SRes lzma_read(void *p, void *buf, size_t *size) {
+    WriterInStream *in = p;
+    SWFWriter *writer = in->writer;
+    size_t out = 0;
+    while (out < *size) {
+        if (!writer->pending.size) {
+            if (in->ret != SWF_OK)
+                break;
+            if ((in->ret = writer_next_chunk(writer, &writer->pending)) != SWF_OK)
+                break;
+            continue;
+        }
+        size_t copy = *size - out < writer->pending.size ? *size - out : writer->pending.size;
+        memcpy((uint8_t*)buf + out, writer->pending.ptr, copy);
+        writer->pending.ptr += copy;
+        writer->pending.size -= copy;
+        out += copy;
+    }
+    *size = out;
+    return in->ret < 0 ? SZ_ERROR_READ : SZ_OK;
+}
+
+typedef struct {
+    ISeqOutStream vt;
+    SWFWriter *writer;
+    SWFError ret;
+} WriterOutStream;
+
+static size_t lzma_write(void *p, const void *buf, size_t size) {
+    WriterOutStream *out = p;
+    if ((out->ret = writer_output(out->writer, buf, size)))
+        return 0;
+    return size;
+}
+
+static SWFError write_lzma(SWFWriter *writer, uint32_t body_size) {
+    SWFError ret = SWF_OK;
+    uint8_t header[LZMA_HEADER_SIZE];
+    SizeT props_size = LZMA_PROPS_SIZE;
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = writer->settings.level < 0 ? 5 : writer->settings.level;
+    props.level = props.level > 9 ? 9 : props.level;
+    props.dictSize = writer->settings.lzma_dict_size;
+    props.numThreads = writer->settings.threads > 1 ? 2 : 1;
+    LzmaEncProps_Normalize(&props);
+    // There's no point in a dictionary bigger than the data; the decoder
+    // has to allocate all of it.
+    while (props.dictSize > (1 << 12) && props.dictSize / 2 >= body_size)
+        props.dictSize /= 2;
+    CLzmaEncHandle enc = LzmaEnc_Create(&allocator);
+    if (!enc)
+        return set_error(writer, SWF_NOMEM, "write_lzma: LzmaEnc_Create failed");
+    if (LzmaEnc_SetProps(enc, &props) != SZ_OK ||
+        LzmaEnc_WriteProperties(enc, header + 4, &props_size) != SZ_OK) {
+        LzmaEnc_Destroy(enc, &allocator, &allocator);
+        return set_error(writer, SWF_INTERNAL_ERROR, "write_lzma: LZMA encoder rejected its properties");
+    }
+    // Compressed length is patched in once it's known, if we can seek
+    write_32(header, 0);
+    if ((ret = writer_output(writer, header, sizeof(header)))) {
+        LzmaEnc_Destroy(enc, &allocator, &allocator);
+        return ret;
+    }
+    uint64_t start = writer->written;
+    WriterInStream in = { { lzma_read }, writer, SWF_OK };
+    WriterOutStream out = { { lzma_write }, writer, SWF_OK };
+    SRes lz_ret = LzmaEnc_Encode(enc, &out.vt, &in.vt, NULL, &allocator, &allocator);
+    LzmaEnc_Destroy(enc, &allocator, &allocator);
+    switch (lz_ret) {
+    case SZ_OK:
+        break;
+    case SZ_ERROR_READ:
+        return in.ret;
+    case SZ_ERROR_WRITE:
+        return out.ret;
+    case SZ_ERROR_MEM:
+        return set_error(writer, SWF_NOMEM, "write_lzma: LzmaEnc_Encode returned SZ_ERROR_MEM");
+    case SZ_ERROR_THREAD:
+        return set_error(writer, SWF_UNKNOWN, "write_lzma: LzmaEnc_Encode couldn't start its threads");
+    default:
+        return set_error(writer, SWF_UNKNOWN, "write_lzma: LzmaEnc_Encode returned an unknown error");
+    }
+    if (in.ret < 0)
+        return in.ret;
+    if (writer->output.seek) {
+        write_32(header, writer->written - start);
+        if ((ret = writer->output.seek(writer->output.ctx, 8)) < 0 ||
+            (ret = writer->output.write(writer->output.ctx, header, 4)) < 0 ||
+            (ret = writer->output.seek(writer->output.ctx, writer->written)) < 0)
+            return set_error(writer, ret, "write_lzma: Couldn't patch compressed length");
+    }
+    return SWF_OK;
+}
+
+static SWFCompression pick_compression(SWFWriter *writer) {
+    SWFCompression compression = writer->settings.compression ?
+                                 writer->settings.compression : writer->swf->compression;
+    if (compression)
+        return compression;
+    if (writer->swf->version >= 13)
+        return SWF_LZMA;
+#if HAVE_LIBZ
+    if (writer->swf->version >= 6)
+        return SWF_ZLIB;
+#endif
+    return SWF_UNCOMPRESSED;
+}
+
+SWFError writer_run(SWFWriter *writer, uint64_t size) {
+    SWFError ret = SWF_OK;
+    SWF *swf = writer->swf;
+    uint8_t header[8];
+    if (size > UINT32_MAX)
+        return set_error(writer, SWF_INVALID, "writer_run: SWF would be larger than 4GiB");
+    if (!size && !writer->output.seek)
+        return set_error(writer, SWF_INVALID, "writer_run: Size is unknown, and output isn't seekable");
+    if (rect_bits(&swf->frame_size) > 31)
+        return set_error(writer, SWF_INVALID, "writer_run: Frame size is too large for a RECT");
+    if (!swf->version)
+        swf->version = LATEST_VERSION;
+    writer->compression = pick_compression(writer);
+    writer->body_size = 8;
+    writer->written = 0;
+    writer->pending.size = 0;
+    header[0] = writer->compression;
+    header[1] = 'W';
+    header[2] = 'S';
+    header[3] = swf->version;
+    write_32(header + 4, size);
+    if ((ret = writer_output(writer, header, sizeof(header))))
+        return ret;
+    switch (writer->compression) {
+    case SWF_UNCOMPRESSED:
+        ret = write_uncompressed(writer);
+        break;
+    case SWF_ZLIB:
+#if HAVE_LIBZ
+#if HAVE_THREADS
+        if (writer->settings.threads > 1) {
+            ret = write_zlib_parallel(writer);
+            break;
+        }
+#endif
+        ret = write_zlib(writer);
+        break;
+#else
+        return set_error(writer, SWF_RECOMPILE, "writer_run: ZLIB compression requires ZLIB");
+#endif
+    case SWF_LZMA:
+        ret = write_lzma(writer, size ? size - 8 : UINT32_MAX);
+        break;
+    default:
+        return set_error(writer, SWF_INVALID, "writer_run: Unknown compression method");
+    }
+    if (ret < 0)
+        return ret;
+    if (writer->body_size > UINT32_MAX)
+        return set_error(writer, SWF_INVALID, "writer_run: SWF is larger than 4GiB");
+    if (writer->body_size != size) {
+        if (!writer->output.seek)
+            return set_error(writer, SWF_INVALID, "writer_run: Declared size doesn't match the data written");
+        write_32(header + 4, writer->body_size);
+        if ((ret = writer->output.seek(writer->output.ctx, 4)) < 0 ||
+            (ret = writer->output.write(writer->output.ctx, header + 4, 4)) < 0 ||
+            (ret = writer->output.seek(writer->output.ctx, writer->written)) < 0)
+            return set_error(writer, ret, "writer_run: Couldn't patch file size");
+    }
+    swf->size = writer->body_size;
+    swf->compression = writer->compression;
+    return SWF_OK;
+}
+
+SWFWriter *swf_writer_init(SWFWriterOutput *output, SWFWriterSettings *settings) {
+    SWFWriter *out = calloc(1, sizeof(SWFWriter));
+    if (!out)
+        return NULL;
+    out->out_buf = malloc(WRITER_OUT_SIZE);
+    if (!out->out_buf) {
+        free(out);
+        return NULL;
+    }
+    out->output = *output;
+    if (settings) {
+        out->settings = *settings;
+    } else {
+        out->settings.level = -1;
+    }
+    return out;
+}
+
+SWFError swf_writer_write(SWFWriter *writer, SWF *swf) {
+    writer->swf = swf;
+    writer->source = tag_source;
+    writer->state = WRITER_HEADER;
+    writer->tag_index = 0;
+    writer->next_tag = NULL;
+    writer->stable = 1;
+    return writer_run(writer, compute_size(swf));
+}
+
+SWFError swf_writer_write_stream(SWFWriter *writer, SWF *swf,
+                                 SWFWriterTagCallback next_tag, void *ctx) {
+    writer->swf = swf;
+    writer->source = tag_source;
+    writer->state = WRITER_HEADER;
+    writer->next_tag = next_tag;
+    writer->next_tag_ctx = ctx;
+    writer->stable = 0;
+    return writer_run(writer, swf->size);
+}
+
+SWFErrorDesc *swf_writer_get_error(SWFWriter *writer) {
+    return &writer->err;
+}
+
+void swf_writer_free(SWFWriter *writer) {
+    if (!writer)
+        return;
+    free(writer->out_buf);
+    free(writer->iov);
+    free(writer);
+}
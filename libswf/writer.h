@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "swf.h"
+#include "internal.h"
+#include "lzma/LzmaEnc.h"
+
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/**
+ * \brief Size of the buffer compressed data is collected in before being written
+ */
+#define WRITER_OUT_SIZE (64 * 1024)
+
+/**
+ * \brief Maximum number of pieces passed to one writev call
+ */
+#define WRITER_IOV_MAX 1024
+
+/**
+ * \brief A piece of the decompressed body, ready to be encoded
+ */
+typedef struct {
+    const uint8_t *ptr;
+    size_t size;
+} WriterChunk;
+
+/**
+ * \brief Current state of the writer's body source
+ */
+typedef enum {
+    WRITER_HEADER,      ///< Next chunk is the compressed part of the header
+    WRITER_TAG_HEADER,  ///< Next chunk is a tag header, or the END tag
+    WRITER_TAG_PAYLOAD, ///< Next chunk is the current tag's payload
+    WRITER_FINISHED,    ///< No more chunks
+} SWFWriterState;
+
+/**
+ * \brief Produces the next chunk of the decompressed body.
+ * \return SWF_OK, SWF_FINISHED at the end of the body, or SWFError < 0.
+ */
+typedef SWFError (*WriterSource)(SWFWriter *writer, WriterChunk *chunk);
+
+/**
+ * \brief Private data used when writing an SWF file
+ */
+struct SWF_Writer {
+    SWFErrorDesc err;           ///< Last error that occurred on this SWFWriter
+    SWFWriterOutput output;     ///< User-provided output
+    SWFWriterSettings settings; ///< User-provided settings
+    SWFCompression compression; ///< Compression actually in use
+    SWF *swf;                   ///< SWF being written
+    WriterSource source;        ///< Produces the decompressed body
+    void *source_ctx;           ///< Private data for source
+    int stable;                 ///< Nonzero if the source's chunks (outside scratch)
+                                /// stay valid until the write finishes
+    SWFWriterState state;       ///< Current state of the tag source
+    unsigned tag_index;         ///< Index of the next tag in swf->tags
+    SWFTag *tag;                ///< Tag currently being written
+    SWFWriterTagCallback next_tag; ///< User-provided tag source; NULL to use swf->tags
+    void *next_tag_ctx;         ///< User-provided pointer passed to next_tag
+    uint8_t scratch[32];        ///< Holds header bytes referenced by the current chunk
+    WriterChunk pending;        ///< Unconsumed part of the current chunk
+    uint64_t body_size;         ///< Decompressed bytes produced, including the 8-byte header
+    uint64_t written;           ///< Bytes passed to output.write
+    uint8_t *out_buf;           ///< Compressed data waiting to be written, or
+                                /// staged header bytes for writev
+    SWFIOVec *iov;              ///< Pieces waiting for output.writev
+#if HAVE_LIBZ
+    z_stream zstrm;             ///< Zlib encoder struct
+#endif
+};
+
+/**
+ * \brief Writes the uncompressed header, then the body from writer->source.
+ * writer->swf supplies the version and compression, and is updated with
+ * what was actually written.
+ * \param[in] writer SWFWriter to write with
+ * \param[in] size   Decompressed file size to declare, or 0 if it isn't known yet
+ * \return < 0 if something went wrong.
+ */
+SWFError writer_run(SWFWriter *writer, uint64_t size);
+
+/**
+ * \brief Gets the next chunk of the body from writer->source, adding it to writer->body_size.
+ * \return SWF_OK, SWF_FINISHED at the end of the body, or SWFError < 0.
+ */
+SWFError writer_next_chunk(SWFWriter *writer, WriterChunk *chunk);
+
+/**
+ * \brief Passes bytes to the output's write callback, adding them to writer->written.
+ * \return < 0 if something went wrong.
+ */
+SWFError writer_output(SWFWriter *writer, const void *buf, size_t size);
+
+#if HAVE_LIBZ
+/**
+ * \brief Sets an error on the writer for a failed zlib call.
+ */
+SWFError writer_zlib_error(SWFWriter *writer, int z_ret);
+
+#if HAVE_THREADS
+/**
+ * \brief Writes a CWS body, compressing blocks on writer->settings.threads threads.
+ * \return < 0 if something went wrong.
+ */
+SWFError write_zlib_parallel(SWFWriter *writer);
+#endif
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * appends: parses FWS, CWS and ZWS files with an SWFParser, a byte at a
+ * time and in other small pieces, and checks that the header and tags come
+ * out the same as from swf_parse_memory. The frame size RECTs vary, from
+ * zero-width fields to 31-bit ones, so every header gets split across
+ * appends at every bit. The writer must also write each of those frame
+ * sizes back, and refuse ones too large for a RECT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+#define NB_TAGS 300
+
+static const size_t pieces[] = { 1, 2, 7, 64 };
+
+// Every file is well-formed, so none of them should trip this
+static const SWFParserLimits strict = { .strict_size = 1 };
+
+/**
+ * \brief A frame size, and how it's encoded
+ */
+typedef struct {
+    const char *name;
+    SWFRect rect;
+    unsigned nb_bits;
+} RectCase;
+
+static const RectCase rects[] = {
+    { "zero-width RECT", { 0, 0, 0, 0 }, 0 },
+    { "15-bit RECT", { 0, 550 * 20, 0, 400 * 20 }, 15 },
+    { "31-bit RECT", { -0x40000000, 0x3FFFFFFF, -1, 12345 }, 31 },
+};
+
+// Each has a coordinate that needs 32-bit fields
+static const SWFRect bad_rects[] = {
+    { 0, 0x40000000, 0, 0 },
+    { -0x40000001, 0, 0, 0 },
+    { 0, 0, INT32_MIN, INT32_MAX },
+};
+
+/**
+ * \brief Encodes a RECT with nb_bits-wide fields.
+ * \return Its size in bytes
+ */
+static size_t put_rect(uint8_t *buf, const SWFRect *rect, unsigned nb_bits) {
+    int32_t vals[4] = { rect->x_min, rect->x_max, rect->y_min, rect->y_max };
+    size_t bit = 0, size = (5 + nb_bits * 4 + 7) >> 3;
+    memset(buf, 0, size);
+    for (int i = -1; i < 4; i++) {
+        uint32_t val = i < 0 ? nb_bits : (uint32_t)vals[i];
+        unsigned len = i < 0 ? 5 : nb_bits;
+        for (unsigned j = len; j-- > 0; bit++)
+            if (val >> j & 1)
+                buf[bit >> 3] |= 0x80 >> (bit & 7);
+    }
+    return size;
+}
+
+/**
+ * \brief Replaces an FWS file's frame size, which the writer always
+ * encodes as small as it can, and fixes up the file's size.
+ */
+static SWFError set_rect(MemFile *fws, const RectCase *rc) {
+    uint8_t rect[17];
+    size_t old_size = (5 + (fws->data[8] >> 3) * 4 + 7) >> 3;
+    size_t new_size = put_rect(rect, &rc->rect, rc->nb_bits);
+    uint8_t *data = malloc(fws->size - old_size + new_size);
+    if (!data)
+        return SWF_NOMEM;
+    memcpy(data, fws->data, 8);
+    memcpy(data + 8, rect, new_size);
+    memcpy(data + 8 + new_size, fws->data + 8 + old_size, fws->size - 8 - old_size);
+    free(fws->data);
+    fws->data = data;
+    fws->size = fws->alloc = fws->size - old_size + new_size;
+    data[4] = fws->size;
+    data[5] = fws->size >> 8;
+    data[6] = fws->size >> 16;
+    data[7] = fws->size >> 24;
+    return SWF_OK;
+}
+
+/**
+ * \brief Generates tags of many sizes, including both sides of the short
+ * header's limit of 62 bytes and ones that start with a character ID.
+ */
+static void make_tags(SWFTag *tags, uint8_t *payloads, size_t payloads_size) {
+    uint64_t seed = 1;
+    size_t pos = 0;
+    for (unsigned i = 0; i < NB_TAGS; i++) {
+        SWFTag *tag = &tags[i];
+        uint32_t r = next_random(&seed);
+        memset(tag, 0, sizeof(*tag));
+        switch (r % 5) {
+        case 0:
+            tag->type = SWF_SHOW_FRAME;
+            break;
+        case 1:
+            tag->type = SWF_PLACE_OBJECT_2;
+            tag->size = 60 + r / 5 % 6;
+            break;
+        case 2:
+            tag->type = SWF_DO_ACTION;
+            tag->size = r / 5 % 2000;
+            break;
+        default:
+            tag->type = SWF_DEFINE_SHAPE;
+            tag->id = i + 1;
+            tag->size = r / 5 % 200;
+            break;
+        }
+        if (tag->size > payloads_size - pos)
+            tag->size = 0;
+        for (uint32_t j = 0; j < tag->size; j++)
+            payloads[pos + j] = next_random(&seed);
+        tag->payload = payloads + pos;
+        tag->flags = SWF_TAG_BORROWED;
+        pos += tag->size;
+    }
+}
+
+static int compare_header(const char *what, const SWF *swf, const SWF *want) {
+    if (swf->compression != want->compression || swf->version != want->version ||
+        swf->size != want->size || swf->frame_rate != want->frame_rate ||
+        swf->frame_count != want->frame_count ||
+        memcmp(&swf->frame_size, &want->frame_size, sizeof(swf->frame_size))) {
+        fprintf(stderr, "%s: header differs from swf_parse_memory's\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Parses file in every piece size, and compares the results with
+ * swf_parse_memory's and with what was written.
+ * \return Number of failures
+ */
+static int check_file(const char *name, const MemFile *file, const RectCase *rc,
+                      const SWFTag *tags, unsigned nb_tags) {
+    char what[128];
+    int failed = 0;
+    SWF *want, *swf;
+    if (swf_parse_memory(file->data, file->size, 0, &strict, &want) < 0) {
+        fprintf(stderr, "%s, %s: swf_parse_memory: %s\n", name, rc->name,
+                want && want->err.text ? want->err.text : "failed");
+        swf_free(want);
+        return 1;
+    }
+    if (memcmp(&want->frame_size, &rc->rect, sizeof(rc->rect))) {
+        fprintf(stderr, "%s, %s: swf_parse_memory got the wrong frame size\n", name, rc->name);
+        failed++;
+    }
+    snprintf(what, sizeof(what), "%s, %s: swf_parse_memory", name, rc->name);
+    failed += compare_tags(what, want, tags, nb_tags);
+    for (unsigned i = 0; i < sizeof(pieces) / sizeof(*pieces); i++) {
+        const char *text;
+        snprintf(what, sizeof(what), "%s, %s: %zu-byte appends", name, rc->name, pieces[i]);
+        if (parse_pieces(file->data, file->size, pieces[i], &strict, &swf, &text) != SWF_FINISHED) {
+            fprintf(stderr, "%s: %s\n", what, text ? text : "no END tag");
+            failed++;
+        } else {
+            failed += compare_header(what, swf, want);
+            failed += compare_tags(what, swf, want->tags, want->nb_tags);
+        }
+        swf_free(swf);
+    }
+    swf_free(want);
+    return failed;
+}
+
+/**
+ * \brief Writes an empty SWF with a given frame size.
+ */
+static SWFError write_rect(MemFile *out, const SWFRect *rect) {
+    SWFWriterSettings settings = { .compression = SWF_UNCOMPRESSED };
+    SWFWriterOutput output;
+    SWFWriter *writer;
+    SWF *swf = swf_init();
+    SWFError ret = SWF_NOMEM;
+    mem_output(&output, out);
+    writer = swf_writer_init(&output, &settings);
+    if (swf && writer) {
+        swf->version = 13;
+        swf->frame_size = *rect;
+        ret = swf_writer_write(writer, swf);
+    }
+    swf_writer_free(writer);
+    swf_free(swf);
+    return ret;
+}
+
+/**
+ * \brief Checks that every frame size that fits in a RECT is written and
+ * parsed back the same, and that ones that don't fit are refused.
+ * \return Number of failures
+ */
+static int check_writer_rects(void) {
+    int failed = 0;
+    for (unsigned r = 0; r < sizeof(rects) / sizeof(*rects); r++) {
+        MemFile file = { 0 };
+        SWF *swf = NULL;
+        if (write_rect(&file, &rects[r].rect) < 0) {
+            fprintf(stderr, "Writing a %s failed\n", rects[r].name);
+            failed++;
+        } else if (swf_parse_memory(file.data, file.size, 0, &strict, &swf) < 0 ||
+                   memcmp(&swf->frame_size, &rects[r].rect, sizeof(rects[r].rect))) {
+            fprintf(stderr, "A written %s didn't parse back the same\n", rects[r].name);
+            failed++;
+        }
+        swf_free(swf);
+        free(file.data);
+    }
+    for (unsigned r = 0; r < sizeof(bad_rects) / sizeof(*bad_rects); r++) {
+        MemFile file = { 0 };
+        SWFError ret = write_rect(&file, &bad_rects[r]);
+        if (ret != SWF_INVALID) {
+            fprintf(stderr, "Writing too large a RECT (%u) returned %i; expected %i\n", r, ret, SWF_INVALID);
+            failed++;
+        }
+        free(file.data);
+    }
+    return failed;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        SWFCompression compression;
+    } formats[] = {
+        { "CWS", SWF_ZLIB },
+        { "ZWS", SWF_LZMA },
+    };
+    static SWFTag tags[NB_TAGS];
+    static uint8_t payloads[256 * 1024];
+    int failed = 0;
+    make_tags(tags, payloads, sizeof(payloads));
+    failed += check_writer_rects();
+    for (unsigned r = 0; r < sizeof(rects) / sizeof(*rects); r++) {
+        SWFWriterSettings settings = { .compression = SWF_UNCOMPRESSED };
+        MemFile fws = { 0 };
+        if (write_tags(&fws, &settings, tags, NB_TAGS) < 0 || set_rect(&fws, &rects[r]) < 0) {
+            free(fws.data);
+            return 1;
+        }
+        failed += check_file("FWS", &fws, &rects[r], tags, NB_TAGS);
+        for (unsigned f = 0; f < sizeof(formats) / sizeof(*formats); f++) {
+            MemFile file = { 0 };
+            SWFError ret = transcode_file(&file, formats[f].compression, &fws);
+            if (ret == SWF_RECOMPILE) {
+                printf("%s isn't supported by this build; skipping it\n", formats[f].name);
+            } else if (ret < 0) {
+                failed++;
+            } else {
+                failed += check_file(formats[f].name, &file, &rects[r], tags, NB_TAGS);
+            }
+            free(file.data);
+        }
+        free(fws.data);
+    }
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * display: simulates the display list of a small timeline. The first
+ * frames use every PlaceObject and RemoveObject form, and their change
+ * lists and contents are checked against what the player would do; the
+ * rest are random. Then every frame is sought to, out of order, with
+ * several keyframe intervals, and must match what stepping forward gave.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+#define NB_FRAMES 40
+#define NB_CHECKED 4                ///< Frames with expected changes below
+#define MAX_TAGS 256
+#define MAX_OBJECTS 16
+
+static const unsigned intervals[] = { 0, 1, 3, 16 };
+static const unsigned seeks[] = { NB_FRAMES - 1, 0, 17, 16, 3, 2, 33, 1, NB_FRAMES - 1, 5, 4 };
+
+/**
+ * \brief A tag payload being built, a bit at a time
+ */
+typedef struct {
+    uint8_t data[64];
+    unsigned bit;
+} Bits;
+
+static void put_bits(Bits *b, uint32_t val, unsigned nb_bits) {
+    for (unsigned i = nb_bits; i-- > 0; b->bit++)
+        if (val >> i & 1)
+            b->data[b->bit >> 3] |= 0x80 >> (b->bit & 7);
+}
+
+static void put_8(Bits *b, uint8_t val) {
+    b->bit = (b->bit + 7) & ~7;
+    put_bits(b, val, 8);
+}
+
+static void put_16(Bits *b, uint16_t val) {
+    put_8(b, val);
+    put_8(b, val >> 8);
+}
+
+static void put_string(Bits *b, const char *str) {
+    do
+        put_8(b, *str);
+    while (*str++);
+}
+
+/**
+ * \brief Writes a MATRIX, leaving out the terms that are at their defaults.
+ * Every field is 20 bits, which is plenty for these values.
+ */
+static void put_matrix(Bits *b, const SWFMatrix *m) {
+    int has_scale = m->scale_x != 1 << 16 || m->scale_y != 1 << 16;
+    int has_rotate = m->rotate_skew_0 || m->rotate_skew_1;
+    b->bit = (b->bit + 7) & ~7;
+    put_bits(b, has_scale, 1);
+    if (has_scale) {
+        put_bits(b, 20, 5);
+        put_bits(b, m->scale_x & 0xFFFFF, 20);
+        put_bits(b, m->scale_y & 0xFFFFF, 20);
+    }
+    put_bits(b, has_rotate, 1);
+    if (has_rotate) {
+        put_bits(b, 20, 5);
+        put_bits(b, m->rotate_skew_0 & 0xFFFFF, 20);
+        put_bits(b, m->rotate_skew_1 & 0xFFFFF, 20);
+    }
+    put_bits(b, 20, 5);
+    put_bits(b, m->translate_x & 0xFFFFF, 20);
+    put_bits(b, m->translate_y & 0xFFFFF, 20);
+}
+
+/**
+ * \brief Writes a CXFORM, or a CXFORMWITHALPHA if alpha is set, with
+ * 12-bit terms.
+ */
+static void put_cxform(Bits *b, const SWFColorTransform *cx, int has_add, int has_mult, int alpha) {
+    unsigned nb_terms = alpha ? 4 : 3;
+    b->bit = (b->bit + 7) & ~7;
+    put_bits(b, has_add, 1);
+    put_bits(b, has_mult, 1);
+    put_bits(b, 12, 4);
+    for (unsigned i = 0; has_mult && i < nb_terms; i++)
+        put_bits(b, cx->mult[i] & 0xFFF, 12);
+    for (unsigned i = 0; has_add && i < nb_terms; i++)
+        put_bits(b, cx->add[i] & 0xFFF, 12);
+}
+
+/**
+ * \brief A timeline being built
+ */
+typedef struct {
+    SWFTag tags[MAX_TAGS];
+    Bits payloads[MAX_TAGS];
+    unsigned nb_tags;
+} Timeline;
+
+static Bits *add_tag(Timeline *tl, SWFTagType type) {
+    SWFTag *tag = &tl->tags[tl->nb_tags];
+    Bits *b = &tl->payloads[tl->nb_tags++];
+    memset(b, 0, sizeof(*b));
+    *tag = (SWFTag) { .type = type, .payload = b->data, .flags = SWF_TAG_BORROWED };
+    return b;
+}
+
+/**
+ * \brief Sets the size of every tag from how many bits went into it.
+ */
+static void finish_tags(Timeline *tl) {
+    for (unsigned i = 0; i < tl->nb_tags; i++)
+        tl->tags[i].size = (tl->payloads[i].bit + 7) >> 3;
+}
+
+#define IDENTITY_MATRIX { .scale_x = 1 << 16, .scale_y = 1 << 16 }
+#define IDENTITY_CXFORM { .mult = { 256, 256, 256, 256 } }
+
+// Objects as they are after each change below; the tags take their
+// matrices and color transforms from these
+static const SWFDisplayObject obj_a0 = { 1, 8, 0, 0, { 1 << 16, 1 << 16, 0, 0, 20, 40 },
+                                         { { 256, 256, 256, 256 }, { 10, 20, 30 } } };
+static const SWFDisplayObject obj_b0 = { 3, 2, 500, 5, { 2 << 16, 1 << 15, 0, 0, -100, 7 }, IDENTITY_CXFORM };
+static const SWFDisplayObject obj_c0 = { 2, 3, 0, 0, { 1 << 16, 1 << 16, 0, 0, 1, 2 }, IDENTITY_CXFORM };
+static const SWFDisplayObject obj_a1 = { 1, 8, 0, 0, { 1 << 16, 1 << 16, 0, 0, 300, -300 },
+                                         { { 256, 256, 256, 256 }, { 10, 20, 30 } } };
+static const SWFDisplayObject obj_b1 = { 3, 4, 500, 5, { 2 << 16, 1 << 15, 0, 0, -100, 7 }, IDENTITY_CXFORM };
+static const SWFDisplayObject obj_d1 = { 2, 5, 0, 0, IDENTITY_MATRIX, IDENTITY_CXFORM };
+// A CXFORMWITHALPHA with only multiply terms resets the add terms
+static const SWFDisplayObject obj_a2 = { 1, 8, 0, 0, { 1 << 16, 1 << 16, 0, 0, 300, -300 },
+                                         { { 128, 256, 256, 64 } } };
+static const SWFDisplayObject obj_e2 = { 7, 6, 0, 0, { 1 << 16, 1 << 16, -49152, 49152, 5, 5 }, IDENTITY_CXFORM };
+
+typedef struct {
+    SWFDisplayChangeType type;
+    const SWFDisplayObject *object;
+} ExpectedChange;
+
+typedef struct {
+    const ExpectedChange *changes;
+    unsigned nb_changes;
+    const SWFDisplayObject *const *objects;
+    unsigned nb_objects;
+} ExpectedFrame;
+
+static const ExpectedChange changes_0[] = {
+    { SWF_DISPLAY_PLACE, &obj_a0 },
+    { SWF_DISPLAY_PLACE, &obj_b0 },
+    { SWF_DISPLAY_PLACE, &obj_c0 },
+};
+static const ExpectedChange changes_1[] = {
+    { SWF_DISPLAY_MODIFY, &obj_a1 },
+    { SWF_DISPLAY_MODIFY, &obj_b1 },
+    { SWF_DISPLAY_REMOVE, &obj_c0 },
+    { SWF_DISPLAY_PLACE, &obj_d1 },
+    { SWF_DISPLAY_MODIFY, &obj_a2 },
+};
+static const ExpectedChange changes_2[] = {
+    { SWF_DISPLAY_PLACE, &obj_e2 },
+    { SWF_DISPLAY_REMOVE, &obj_a2 },
+    { SWF_DISPLAY_REMOVE, &obj_b1 },
+};
+static const SWFDisplayObject *const objects_0[] = { &obj_a0, &obj_c0, &obj_b0 };
+static const SWFDisplayObject *const objects_1[] = { &obj_a2, &obj_d1, &obj_b1 };
+static const SWFDisplayObject *const objects_2[] = { &obj_d1, &obj_e2 };
+
+static const ExpectedFrame expected[NB_CHECKED] = {
+    { changes_0, 3, objects_0, 3 },
+    { changes_1, 5, objects_1, 3 },
+    { changes_2, 3, objects_2, 2 },
+    { NULL, 0, objects_2, 2 },
+};
+
+/**
+ * \brief Writes a PlaceObject2, or a PlaceObject3 if class_name isn't NULL.
+ * Fields are written if flags has their bits set.
+ */
+static void place(Timeline *tl, uint8_t flags, uint8_t flags2, uint16_t depth, const char *class_name,
+                  uint16_t character, const SWFMatrix *matrix, const SWFColorTransform *cxform,
+                  uint16_t ratio, const char *name, uint16_t clip_depth) {
+    Bits *b = add_tag(tl, class_name ? SWF_PLACE_OBJECT_3 : SWF_PLACE_OBJECT_2);
+    put_8(b, flags);
+    if (class_name)
+        put_8(b, flags2);
+    put_16(b, depth);
+    if (class_name && (flags2 & 0x08 || (flags2 & 0x10 && flags & 0x02)))
+        put_string(b, class_name);
+    if (flags & 0x02)
+        put_16(b, character);
+    if (flags & 0x04)
+        put_matrix(b, matrix);
+    if (flags & 0x08)
+        put_cxform(b, cxform, 1, 1, 1);
+    if (flags & 0x10)
+        put_16(b, ratio);
+    if (flags & 0x20)
+        put_string(b, name);
+    if (flags & 0x40)
+        put_16(b, clip_depth);
+}
+
+static void show_frame(Timeline *tl) {
+    add_tag(tl, SWF_SHOW_FRAME);
+}
+
+static void make_timeline(Timeline *tl) {
+    uint64_t seed = 1;
+    Bits *b;
+
+    // Frame 0: PlaceObject with a CXFORM, PlaceObject2 with every field,
+    // and PlaceObject3 with HasClassName, so the class comes before the ID
+    b = add_tag(tl, SWF_PLACE_OBJECT);
+    put_16(b, 8);
+    put_16(b, 1);
+    put_matrix(b, &obj_a0.matrix);
+    put_cxform(b, &obj_a0.cxform, 1, 0, 0);
+    place(tl, 0x76, 0, 3, NULL, 2, &obj_b0.matrix, NULL, 500, "clip", 5);
+    place(tl, 0x06, 0x08, 2, "Foo", 3, &obj_c0.matrix, NULL, 0, NULL, 0);
+    show_frame(tl);
+
+    // Frame 1: a move, a replace, a place at an occupied depth without
+    // Move, and a PlaceObject3 with HasImage but no character, which has
+    // no ClassName; then a move of an empty depth, which does nothing
+    place(tl, 0x05, 0, 1, NULL, 0, &obj_a1.matrix, NULL, 0, NULL, 0);
+    place(tl, 0x03, 0, 3, NULL, 4, NULL, NULL, 0, NULL, 0);
+    place(tl, 0x02, 0, 2, NULL, 5, NULL, NULL, 0, NULL, 0);
+    b = add_tag(tl, SWF_PLACE_OBJECT_3);
+    put_8(b, 0x09);
+    put_8(b, 0x10);
+    put_16(b, 1);
+    put_cxform(b, &obj_a2.cxform, 0, 1, 1);
+    place(tl, 0x05, 0, 9, NULL, 0, &obj_a0.matrix, NULL, 0, NULL, 0);
+    show_frame(tl);
+
+    // Frame 2: PlaceObject3 with HasImage and a character, which does have
+    // a ClassName; RemoveObject; RemoveObject2; and a removal of an empty depth
+    place(tl, 0x06, 0x10, 7, "Bar", 6, &obj_e2.matrix, NULL, 0, NULL, 0);
+    b = add_tag(tl, SWF_REMOVE_OBJECT);
+    put_16(b, 8);
+    put_16(b, 1);
+    b = add_tag(tl, SWF_REMOVE_OBJECT_2);
+    put_16(b, 3);
+    b = add_tag(tl, SWF_REMOVE_OBJECT_2);
+    put_16(b, 50);
+    show_frame(tl);
+
+    // Frame 3 is empty
+    show_frame(tl);
+
+    for (unsigned f = NB_CHECKED; f < NB_FRAMES; f++) {
+        unsigned nb_ops = next_random(&seed) % 4;
+        for (unsigned i = 0; i < nb_ops; i++) {
+            uint32_t r = next_random(&seed);
+            uint16_t depth = 10 + r / 4 % 6;
+            SWFMatrix matrix = IDENTITY_MATRIX;
+            SWFColorTransform cxform = { .mult = { r % 256, 256, 256, 256 }, .add = { 0, 0, r % 100 } };
+            matrix.translate_x = r % 1000;
+            switch (r % 4) {
+            case 0:
+                place(tl, 0x06, 0, depth, NULL, 1 + r % 100, &matrix, NULL, 0, NULL, 0);
+                break;
+            case 1:
+                place(tl, 0x05, 0, depth, NULL, 0, &matrix, NULL, 0, NULL, 0);
+                break;
+            case 2:
+                b = add_tag(tl, SWF_REMOVE_OBJECT_2);
+                put_16(b, depth);
+                break;
+            default:
+                place(tl, 0x09, 0x10, depth, "", 0, NULL, &cxform, 0, NULL, 0);
+                break;
+            }
+        }
+        show_frame(tl);
+    }
+    finish_tags(tl);
+}
+
+static int same_object(const SWFDisplayObject *a, const SWFDisplayObject *b) {
+    return a->depth == b->depth && a->character == b->character && a->ratio == b->ratio &&
+           a->clip_depth == b->clip_depth && !memcmp(&a->matrix, &b->matrix, sizeof(a->matrix)) &&
+           !memcmp(&a->cxform, &b->cxform, sizeof(a->cxform));
+}
+
+/**
+ * \brief Checks a frame's change list against what's expected.
+ * \return Number of failures
+ */
+static int check_changes(const char *what, const SWFDisplayChange *changes, unsigned nb_changes,
+                         const ExpectedFrame *want) {
+    if (nb_changes != want->nb_changes) {
+        fprintf(stderr, "%s: %u changes; expected %u\n", what, nb_changes, want->nb_changes);
+        return 1;
+    }
+    for (unsigned i = 0; i < nb_changes; i++) {
+        if (changes[i].type != want->changes[i].type || !same_object(&changes[i].object, want->changes[i].object)) {
+            fprintf(stderr, "%s: change %u is type %i at depth %u; expected type %i at depth %u\n", what, i,
+                    changes[i].type, changes[i].object.depth, want->changes[i].type, want->changes[i].object->depth);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief A copy of a display list's contents
+ */
+typedef struct {
+    SWFDisplayObject objects[MAX_OBJECTS];
+    unsigned nb_objects;
+} State;
+
+/**
+ * \brief Checks a display list's contents and frame number against a state.
+ * \return Number of failures
+ */
+static int check_state(const char *what, SWFDisplayList *dl, unsigned frame, const State *want) {
+    unsigned nb_objects;
+    const SWFDisplayObject *objects = swf_display_list_get_objects(dl, &nb_objects);
+    if (swf_display_list_get_frame(dl) != (int)frame) {
+        fprintf(stderr, "%s: at frame %i; expected %u\n", what, swf_display_list_get_frame(dl), frame);
+        return 1;
+    }
+    if (nb_objects != want->nb_objects) {
+        fprintf(stderr, "%s: %u objects; expected %u\n", what, nb_objects, want->nb_objects);
+        return 1;
+    }
+    for (unsigned i = 0; i < nb_objects; i++) {
+        if (!same_object(&objects[i], &want->objects[i])) {
+            fprintf(stderr, "%s: object %u differs\n", what, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Steps through every frame, checking the first few against what's
+ * expected, and saving the rest to states; or checking against them, if
+ * they've been saved already.
+ * \return Number of failures
+ */
+static int check_steps(SWF *swf, unsigned interval, State *states, int saved) {
+    SWFDisplayList *dl = swf_display_list_init(swf, NULL, interval);
+    const SWFDisplayChange *changes;
+    unsigned nb_changes;
+    char what[128];
+    int failed = 0;
+    if (!dl)
+        return 1;
+    for (unsigned f = 0; f < NB_FRAMES; f++) {
+        snprintf(what, sizeof(what), "Interval %u, stepping to frame %u", interval, f);
+        if (swf_display_list_next_frame(dl, &changes, &nb_changes) != SWF_OK) {
+            fprintf(stderr, "%s: %s\n", what, swf_display_list_get_error(dl)->text);
+            failed++;
+            break;
+        }
+        if (f < NB_CHECKED) {
+            State want = { .nb_objects = expected[f].nb_objects };
+            for (unsigned i = 0; i < want.nb_objects; i++)
+                want.objects[i] = *expected[f].objects[i];
+            failed += check_changes(what, changes, nb_changes, &expected[f]);
+            failed += check_state(what, dl, f, &want);
+        }
+        if (saved) {
+            failed += check_state(what, dl, f, &states[f]);
+        } else {
+            const SWFDisplayObject *objects = swf_display_list_get_objects(dl, &states[f].nb_objects);
+            if (states[f].nb_objects > MAX_OBJECTS) {
+                fprintf(stderr, "%s: too many objects\n", what);
+                failed++;
+                break;
+            }
+            memcpy(states[f].objects, objects, states[f].nb_objects * sizeof(*objects));
+        }
+    }
+    if (!failed && swf_display_list_next_frame(dl, &changes, &nb_changes) != SWF_FINISHED) {
+        fprintf(stderr, "Interval %u: no SWF_FINISHED after the last frame\n", interval);
+        failed++;
+    }
+    swf_display_list_free(dl);
+    return failed;
+}
+
+/**
+ * \brief Seeks around a display list, both before and after it has stepped
+ * through every frame, and checks each frame against states.
+ * \return Number of failures
+ */
+static int check_seeks(SWF *swf, unsigned interval, const State *states) {
+    char what[128];
+    int failed = 0;
+    for (int stepped = 0; stepped < 2; stepped++) {
+        SWFDisplayList *dl = swf_display_list_init(swf, NULL, interval);
+        if (!dl)
+            return failed + 1;
+        while (stepped && swf_display_list_next_frame(dl, NULL, NULL) == SWF_OK);
+        for (unsigned i = 0; i < sizeof(seeks) / sizeof(*seeks); i++) {
+            snprintf(what, sizeof(what), "Interval %u, %sseek %u to frame %u", interval,
+                     stepped ? "stepped, " : "", i, seeks[i]);
+            if (swf_display_list_seek(dl, seeks[i]) < 0) {
+                fprintf(stderr, "%s: %s\n", what, swf_display_list_get_error(dl)->text);
+                failed++;
+            } else {
+                failed += check_state(what, dl, seeks[i], &states[seeks[i]]);
+            }
+        }
+        if (swf_display_list_seek(dl, NB_FRAMES) != SWF_INVALID) {
+            fprintf(stderr, "Interval %u: seeking past the end didn't fail\n", interval);
+            failed++;
+        }
+        swf_display_list_free(dl);
+    }
+    return failed;
+}
+
+int main(void) {
+    static Timeline tl;
+    static State states[NB_FRAMES];
+    SWFWriterSettings settings = { .compression = SWF_UNCOMPRESSED };
+    MemFile file = { 0 };
+    SWF *swf;
+    int failed = 0;
+    make_timeline(&tl);
+    if (write_tags(&file, &settings, tl.tags, tl.nb_tags) < 0)
+        return 1;
+    if (swf_parse_memory(file.data, file.size, 0, NULL, &swf) < 0) {
+        fprintf(stderr, "swf_parse_memory: %s\n", swf && swf->err.text ? swf->err.text : "failed");
+        swf_free(swf);
+        free(file.data);
+        return 1;
+    }
+    if (swf->nb_frames != NB_FRAMES) {
+        fprintf(stderr, "%u frames; expected %u\n", swf->nb_frames, NB_FRAMES);
+        failed++;
+    } else {
+        for (unsigned i = 0; i < sizeof(intervals) / sizeof(*intervals); i++) {
+            failed += check_steps(swf, intervals[i], states, i > 0);
+            failed += check_seeks(swf, intervals[i], states);
+        }
+    }
+    swf_free(swf);
+    free(file.data);
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * lzmakernels: decodes ZWS files with each LZMA kernel, along every path
+ * the parser has, and checks that the tags come out as they went in.
+ * The files use small and large dictionaries, and are several times
+ * larger than the small ones, so the streaming decoder's dictionary wraps.
+ * Their data mixes literals, overlapping short-distance matches, and
+ * matches from about a dictionary's length back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+#define BODY_SIZE (1280 * 1024)     ///< Payload bytes in each file
+#define MAX_TAG_SIZE (32 * 1024)
+#define APPEND_SIZE 4093            ///< Odd, so appends split LZMA symbols
+
+static const uint32_t dict_sizes[] = { 4096, 64 * 1024, 1024 * 1024 };
+static const int levels[] = { 1, 9 };
+
+/**
+ * \brief Fills out with data that exercises the decoder: random literals,
+ * runs, short periodic patterns, and copies from earlier in the corpus.
+ * \param[in] corpus Everything generated so far; out is its end
+ * \param[in] pos    Size of corpus
+ */
+static void fill(uint64_t *seed, const uint8_t *corpus, size_t pos, uint8_t *out, uint32_t size) {
+    for (uint32_t i = 0; i < size;) {
+        uint32_t r = next_random(seed), len = 2 + next_random(seed) % 300;
+        size_t have = pos + i, dist;
+        len = len < size - i ? len : size - i;
+        switch (r % 6) {
+        case 0:
+            for (uint32_t j = 0; j < len; j++)
+                out[i + j] = next_random(seed);
+            break;
+        case 1:
+            // A run is a match at distance 1 that overlaps itself
+            memset(out + i, next_random(seed), len);
+            break;
+        case 2:
+            dist = 2 + next_random(seed) % 7;
+            for (uint32_t j = 0; j < len; j++)
+                out[i + j] = j < dist ? next_random(seed) : out[i + j - dist];
+            break;
+        default:
+            switch (r / 6 % 4) {
+            case 0:
+                dist = 1 + next_random(seed) % 64;
+                break;
+            case 1:
+                // Right around one of the dictionary sizes
+                dist = dict_sizes[next_random(seed) % 3] - 16 + next_random(seed) % 16;
+                break;
+            default:
+                dist = 1 + next_random(seed) % (have ? have : 1);
+                break;
+            }
+            if (dist > have) {
+                memset(out + i, 0, len);
+                break;
+            }
+            for (uint32_t j = 0; j < len; j++)
+                out[i + j] = corpus[pos + i + j - dist];
+            break;
+        }
+        i += len;
+    }
+}
+
+/**
+ * \brief Generates the tags that every file holds.
+ * \return Number of tags, or 0 if out of memory
+ */
+static unsigned make_tags(SWFTag **tags_out, uint8_t **corpus_out) {
+    uint64_t seed = 1;
+    unsigned nb_tags = 0, max_tags = BODY_SIZE / 16;
+    size_t pos = 0;
+    uint8_t *corpus = malloc(BODY_SIZE);
+    SWFTag *tags = calloc(max_tags, sizeof(*tags));
+    if (!corpus || !tags) {
+        free(corpus);
+        free(tags);
+        return 0;
+    }
+    while (pos < BODY_SIZE && nb_tags < max_tags) {
+        SWFTag *tag = &tags[nb_tags++];
+        uint32_t size, r = next_random(&seed);
+        switch (r % 4) {
+        case 0:
+            tag->type = SWF_SHOW_FRAME;
+            size = 0;
+            break;
+        case 1:
+            tag->type = SWF_PLACE_OBJECT_2;
+            size = 3 + r / 4 % 40;
+            break;
+        case 2:
+            tag->type = SWF_DO_ACTION;
+            size = r / 4 % MAX_TAG_SIZE;
+            break;
+        default:
+            tag->type = SWF_DEFINE_BITS_LOSSLESS;
+            tag->id = nb_tags;
+            size = r / 4 % MAX_TAG_SIZE;
+            break;
+        }
+        size = size < BODY_SIZE - pos ? size : BODY_SIZE - pos;
+        fill(&seed, corpus, pos, corpus + pos, size);
+        tag->payload = corpus + pos;
+        tag->size = size;
+        tag->flags = SWF_TAG_BORROWED;
+        pos += size;
+    }
+    *tags_out = tags;
+    *corpus_out = corpus;
+    return nb_tags;
+}
+
+/**
+ * \brief Decodes file every way the parser can, and compares the tags.
+ * \return Number of failures
+ */
+static int check_file(const char *kernel, uint32_t dict_size, int level, const MemFile *file,
+                      const SWFTag *tags, unsigned nb_tags) {
+    // Bigger than the dictionary and the largest tag, but not the body
+    size_t stream_buffer = dict_size > MAX_TAG_SIZE * 2 ? dict_size : MAX_TAG_SIZE * 2;
+    SWFParserLimits stream_limits = { .max_buffered = stream_buffer };
+    struct {
+        const char *name;
+        size_t piece;
+        const SWFParserLimits *limits;
+    } paths[] = {
+        { "whole append", file->size, NULL },
+        { "small appends", APPEND_SIZE, NULL },
+        { "streamed", APPEND_SIZE, &stream_limits },
+    };
+    char what[128];
+    int failed = 0;
+    SWF *swf;
+    SWFError ret;
+
+    snprintf(what, sizeof(what), "%s kernel, dictionary %"PRIu32", level %i, swf_parse_memory",
+             kernel, dict_size, level);
+    if ((ret = swf_parse_memory(file->data, file->size, 0, NULL, &swf)) < 0) {
+        fprintf(stderr, "%s: %s\n", what, swf && swf->err.text ? swf->err.text : "failed");
+        failed++;
+    } else {
+        failed += compare_tags(what, swf, tags, nb_tags);
+    }
+    swf_free(swf);
+
+    for (unsigned i = 0; i < sizeof(paths) / sizeof(*paths); i++) {
+        const char *text;
+        snprintf(what, sizeof(what), "%s kernel, dictionary %"PRIu32", level %i, %s",
+                 kernel, dict_size, level, paths[i].name);
+        if ((ret = parse_pieces(file->data, file->size, paths[i].piece, paths[i].limits, &swf, &text)) != SWF_FINISHED) {
+            fprintf(stderr, "%s: %s\n", what, text ? text : "no END tag");
+            failed++;
+        } else {
+            failed += compare_tags(what, swf, tags, nb_tags);
+        }
+        swf_free(swf);
+    }
+    return failed;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        SWFLzmaKernel kernel;
+    } kernels[] = {
+        { "reference", SWF_LZMA_KERNEL_REFERENCE },
+        { "fast", SWF_LZMA_KERNEL_FAST },
+    };
+    SWFTag *tags;
+    uint8_t *corpus;
+    unsigned nb_tags = make_tags(&tags, &corpus);
+    int failed = 0;
+    if (!nb_tags) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (unsigned d = 0; d < sizeof(dict_sizes) / sizeof(*dict_sizes); d++) {
+        for (unsigned l = 0; l < sizeof(levels) / sizeof(*levels); l++) {
+            SWFWriterSettings settings = {
+                .compression = SWF_LZMA,
+                .level = levels[l],
+                .lzma_dict_size = dict_sizes[d],
+            };
+            MemFile file = { 0 };
+            if (write_tags(&file, &settings, tags, nb_tags) < 0) {
+                failed++;
+                continue;
+            }
+            for (unsigned k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+                if (swf_set_lzma_kernel(kernels[k].kernel) == SWF_RECOMPILE) {
+                    if (!d && !l)
+                        printf("The %s kernel isn't built for this machine; skipping it\n", kernels[k].name);
+                    continue;
+                }
+                failed += check_file(kernels[k].name, dict_sizes[d], levels[l], &file, tags, nb_tags);
+            }
+            free(file.data);
+        }
+    }
+    swf_set_lzma_kernel(SWF_LZMA_KERNEL_AUTO);
+    free(tags);
+    free(corpus);
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
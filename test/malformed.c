@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * malformed: feeds broken and hostile files to every way of parsing, with
+ * and without limits, and checks that each fails with the right error
+ * rather than crashing. Each file is also tried as CWS and ZWS, and
+ * through swf_batch. Best run under -fsanitize=address.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "testutil.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#define HAVE_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HAVE_ASAN 1
+#endif
+#endif
+
+#define MAX_TAGS 1000
+#define MAX_TAG_SIZE (1 << 16)
+#define MAX_FILES 8
+#define MEMORY_CAP (1024 * 1024 * 1024)    ///< Address space for files with memory_cap set
+
+/**
+ * \brief A malformed FWS file, and the error it should fail with
+ */
+typedef struct {
+    const char *name;
+    const uint8_t *data;
+    size_t size;
+    SWFError expect;            ///< Without limits; SWF_OK if it should parse
+    SWFError expect_limited;    ///< With every limit set
+    uint32_t declared_size;     ///< Size to declare once compressed; 0 to leave it
+    int memory_cap;             ///< Nonzero to parse with only MEMORY_CAP of address space
+} BadFile;
+
+// DefineShape starts with a character ID, so its length can't be under 2
+static const uint8_t empty_define_shape[] = {
+    'F', 'W', 'S', 13, 17, 0, 0, 0,
+    0x00, 0x00, 0x18, 0x01, 0x00,   // Zero-width RECT, 24fps, 1 frame
+    0x80, 0x00,                     // DefineShape, length 0
+    0x00, 0x00,                     // END
+};
+
+static const uint8_t short_define_shape[] = {
+    'F', 'W', 'S', 13, 18, 0, 0, 0,
+    0x00, 0x00, 0x18, 0x01, 0x00,
+    0x81, 0x00, 0xAA,               // DefineShape, length 1
+    0x00, 0x00,
+};
+
+// Will declare 64MB, so a compressed body would be allocated at that size
+static const uint8_t huge_declared_size[] = {
+    'F', 'W', 'S', 13, 17, 0, 0, 0,
+    0x00, 0x00, 0x18, 0x01, 0x00,
+    0x40, 0x00,                     // ShowFrame
+    0x00, 0x00,
+};
+
+// The END tag comes before the declared size, which strict_size rejects
+static const uint8_t early_end[] = {
+    'F', 'W', 'S', 13, 20, 0, 0, 0,
+    0x00, 0x00, 0x18, 0x01, 0x00,
+    0x40, 0x00,
+    0x00, 0x00,
+    0xAA, 0xAA, 0xAA,               // Not a tag
+};
+
+static const SWFParserLimits limits = {
+    .max_decompressed = 1 << 20,
+    .max_tag_size = MAX_TAG_SIZE,
+    .max_buffered = 1 << 20,
+    .max_tags = MAX_TAGS,
+    .strict_size = 1,
+};
+
+static int check_result(const char *what, SWFError ret, SWFError expect, const char *text) {
+    if (ret == expect || (ret == SWF_FINISHED && expect == SWF_OK))
+        return 0;
+    fprintf(stderr, "%s: returned %i (%s); expected %i\n", what, ret, text ? text : "no error text", expect);
+    return 1;
+}
+
+/**
+ * \brief Copies a file, so its header can be changed.
+ */
+static SWFError copy_file(MemFile *out, const MemFile *in) {
+    if (!(out->data = malloc(in->size)))
+        return SWF_NOMEM;
+    memcpy(out->data, in->data, in->size);
+    out->size = out->alloc = in->size;
+    return SWF_OK;
+}
+
+/**
+ * \brief Sets the size in a file's header, which is never compressed.
+ */
+static void set_declared_size(MemFile *file, uint32_t size) {
+    file->data[4] = size;
+    file->data[5] = size >> 8;
+    file->data[6] = size >> 16;
+    file->data[7] = size >> 24;
+}
+
+/**
+ * \brief Parses file every way, with and without limits.
+ * \return Number of failures
+ */
+static int check_file(const char *format, const BadFile *bad, const MemFile *file) {
+    static const size_t pieces[] = { 0, 1, 7 };
+    char what[128];
+    int failed = 0;
+    SWF *swf;
+    for (int limited = 0; limited < 2; limited++) {
+        SWFError expect = limited ? bad->expect_limited : bad->expect;
+        const char *text;
+        SWFError ret = swf_parse_memory(file->data, file->size, 0, limited ? &limits : NULL, &swf);
+        snprintf(what, sizeof(what), "%s %s, swf_parse_memory%s", format, bad->name,
+                 limited ? ", with limits" : "");
+        failed += check_result(what, ret, expect, swf ? swf->err.text : NULL);
+        swf_free(swf);
+        for (unsigned i = 0; i < sizeof(pieces) / sizeof(*pieces); i++) {
+            size_t piece = pieces[i] ? pieces[i] : file->size;
+            snprintf(what, sizeof(what), "%s %s, %zu-byte appends%s", format, bad->name, piece,
+                     limited ? ", with limits" : "");
+            ret = parse_pieces(file->data, file->size, piece, limited ? &limits : NULL, &swf, &text);
+            failed += check_result(what, ret, expect, text);
+            swf_free(swf);
+        }
+    }
+    return failed;
+}
+
+/**
+ * \brief Runs check_file in a child process with its address space capped,
+ * so that allocating a file's declared size rather than what it really
+ * decompresses to fails.
+ * \return Number of failures
+ */
+static int check_file_capped(const char *format, const BadFile *bad, const MemFile *file) {
+#if HAVE_ASAN
+    // ASan reserves terabytes of address space up front, so it can't be capped
+    return check_file(format, bad, file);
+#else
+    int status;
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    } else if (!pid) {
+        struct rlimit limit = { .rlim_cur = MEMORY_CAP, .rlim_max = MEMORY_CAP };
+        if (setrlimit(RLIMIT_AS, &limit) < 0) {
+            perror("setrlimit");
+            _exit(1);
+        }
+        _exit(check_file(format, bad, file) ? 1 : 0);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "%s %s: failed with %i MB of address space\n", format, bad->name, MEMORY_CAP >> 20);
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+static void batch_done(SWFBatchItem *item, SWF *swf, const SWFErrorDesc *err, void *ctx) {
+    *(SWFError*)item->opaque = err->code;
+    swf_free(swf);
+}
+
+/**
+ * \brief Parses the FWS version of every file in one batch, with and without limits.
+ * \return Number of failures
+ */
+static int check_batch(const BadFile *files, const MemFile *data, unsigned nb_files) {
+    SWFBatchItem items[MAX_FILES];
+    SWFError results[MAX_FILES];
+    char what[128];
+    int failed = 0;
+    for (unsigned i = 0; i < nb_files; i++)
+        items[i] = (SWFBatchItem) { .data = data[i].data, .size = data[i].size, .opaque = &results[i] };
+    for (int limited = 0; limited < 2; limited++) {
+        SWFBatchSettings settings = {
+            .threads = 2,
+            .limits = limited ? &limits : NULL,
+            .done_cb = batch_done,
+        };
+        if (swf_batch(items, nb_files, &settings) < 0) {
+            fprintf(stderr, "swf_batch failed\n");
+            return failed + 1;
+        }
+        for (unsigned i = 0; i < nb_files; i++) {
+            snprintf(what, sizeof(what), "FWS %s, swf_batch%s", files[i].name, limited ? ", with limits" : "");
+            failed += check_result(what, results[i], limited ? files[i].expect_limited : files[i].expect, NULL);
+        }
+    }
+    return failed;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        SWFCompression compression;
+    } formats[] = {
+        { "FWS", SWF_UNCOMPRESSED },
+        { "CWS", SWF_ZLIB },
+        { "ZWS", SWF_LZMA },
+    };
+    static SWFTag big_tag = { .type = SWF_DO_ACTION, .size = MAX_TAG_SIZE + 1 };
+    static SWFTag many_tags[MAX_TAGS + 1];
+    static uint8_t big_payload[MAX_TAG_SIZE + 1];
+    SWFWriterSettings settings = { .compression = SWF_UNCOMPRESSED };
+    MemFile big_file = { 0 }, many_file = { 0 }, fws_files[MAX_FILES] = { { 0 } };
+    int failed = 0;
+    big_tag.payload = big_payload;
+    for (unsigned i = 0; i < MAX_TAGS + 1; i++)
+        many_tags[i].type = SWF_SHOW_FRAME;
+    if (write_tags(&big_file, &settings, &big_tag, 1) < 0 ||
+        write_tags(&many_file, &settings, many_tags, MAX_TAGS + 1) < 0)
+        return 1;
+    const BadFile files[] = {
+        { "zero-length DefineShape", empty_define_shape, sizeof(empty_define_shape), SWF_INVALID, SWF_INVALID },
+        { "one-byte DefineShape", short_define_shape, sizeof(short_define_shape), SWF_INVALID, SWF_INVALID },
+        { "64MB declared size", huge_declared_size, sizeof(huge_declared_size), SWF_OK, SWF_LIMIT, 64 << 20 },
+        { "tag over max_tag_size", big_file.data, big_file.size, SWF_OK, SWF_LIMIT },
+        { "more than max_tags tags", many_file.data, many_file.size, SWF_OK, SWF_LIMIT },
+        { "END before the declared size", early_end, sizeof(early_end), SWF_OK, SWF_INVALID },
+        { "2GB declared size", huge_declared_size, sizeof(huge_declared_size), SWF_OK, SWF_LIMIT, 0x7FFFFFFF, 1 },
+    };
+    unsigned nb_files = sizeof(files) / sizeof(*files);
+    for (unsigned i = 0; i < nb_files; i++) {
+        MemFile fws = { .data = (uint8_t*)files[i].data, .size = files[i].size };
+        for (unsigned f = 0; f < sizeof(formats) / sizeof(*formats); f++) {
+            MemFile file = { 0 };
+            SWFError ret = formats[f].compression == SWF_UNCOMPRESSED ? copy_file(&file, &fws) :
+                           transcode_file(&file, formats[f].compression, &fws);
+            if (ret == SWF_RECOMPILE)
+                continue;
+            if (ret < 0) {
+                failed++;
+                continue;
+            }
+            if (files[i].declared_size)
+                set_declared_size(&file, files[i].declared_size);
+            if (files[i].memory_cap)
+                failed += check_file_capped(formats[f].name, &files[i], &file);
+            else
+                failed += check_file(formats[f].name, &files[i], &file);
+            if (formats[f].compression == SWF_UNCOMPRESSED)
+                fws_files[i] = file;
+            else
+                free(file.data);
+        }
+    }
+    failed += check_batch(files, fws_files, nb_files);
+    for (unsigned i = 0; i < nb_files; i++)
+        free(fws_files[i].data);
+    free(big_file.data);
+    free(many_file.data);
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * pdeflate: writes CWS files with 1, 2 and 4 compression threads, with
+ * bodies just under, at and just over a multiple of the parallel writer's
+ * block size, then inflates each with zlib and checks that it gives back
+ * the body exactly. zlib also checks the combined Adler-32.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+#if HAVE_LIBZ
+#include <zlib.h>
+
+#define BLOCK_SIZE (128 * 1024)     ///< Same as pdeflate.c's
+#define PERIOD 1531                 ///< Repeats span block boundaries, so the dictionaries matter
+
+static const unsigned threads[] = { 1, 2, 4 };
+// Enough blocks to wrap the job ring, which holds 2 per thread
+static const unsigned nb_blocks[] = { 1, 9 };
+static const int offsets[] = { -1, 0, 1 };
+
+/**
+ * \brief Fills buf with a pattern that repeats every PERIOD bytes, with
+ * random changes, so it compresses but not to nothing.
+ */
+static void fill(uint8_t *buf, size_t size) {
+    uint64_t seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        uint32_t r = next_random(&seed);
+        buf[i] = i < PERIOD || !(r % 61) ? (uint8_t)(r >> 8) : buf[i - PERIOD];
+    }
+}
+
+/**
+ * \brief Inflates a CWS file's body and compares it with the FWS file's.
+ * \return Number of failures
+ */
+static int check_file(const char *what, const MemFile *cws, const MemFile *fws) {
+    uLongf size = fws->size - 8;
+    uint8_t *body = malloc(size ? size : 1);
+    int ret;
+    if (!body) {
+        fprintf(stderr, "%s: Out of memory\n", what);
+        return 1;
+    }
+    if (cws->size < 8 || cws->data[0] != 'C' || memcmp(cws->data + 1, fws->data + 1, 7)) {
+        fprintf(stderr, "%s: header differs\n", what);
+        ret = 1;
+    } else if ((ret = uncompress(body, &size, cws->data + 8, cws->size - 8)) != Z_OK) {
+        fprintf(stderr, "%s: uncompress returned %i\n", what, ret);
+        ret = 1;
+    } else if (size != fws->size - 8 || memcmp(body, fws->data + 8, size)) {
+        fprintf(stderr, "%s: body differs\n", what);
+        ret = 1;
+    }
+    free(body);
+    return ret ? 1 : 0;
+}
+
+int main(void) {
+    size_t max_payload = BLOCK_SIZE * nb_blocks[sizeof(nb_blocks) / sizeof(*nb_blocks) - 1] + 1;
+    uint8_t *payload = malloc(max_payload);
+    SWFTag tag = { .type = SWF_DO_ACTION, .size = 100, .flags = SWF_TAG_BORROWED };
+    SWFWriterSettings fws_settings = { .compression = SWF_UNCOMPRESSED };
+    MemFile probe = { 0 };
+    size_t overhead;
+    int failed = 0;
+    if (!payload) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    fill(payload, max_payload);
+    tag.payload = payload;
+    // Everything in the body but the payload: the rest of the header, the
+    // DoAction's long tag header, and END
+    if (write_tags(&probe, &fws_settings, &tag, 1) < 0) {
+        free(payload);
+        return 1;
+    }
+    overhead = probe.size - 8 - tag.size;
+    free(probe.data);
+
+    for (unsigned b = 0; b < sizeof(nb_blocks) / sizeof(*nb_blocks); b++) {
+        for (unsigned o = 0; o < sizeof(offsets) / sizeof(*offsets); o++) {
+            size_t body_size = BLOCK_SIZE * nb_blocks[b] + offsets[o];
+            MemFile fws = { 0 };
+            tag.size = body_size - overhead;
+            if (write_tags(&fws, &fws_settings, &tag, 1) < 0) {
+                failed++;
+                continue;
+            }
+            for (unsigned t = 0; t < sizeof(threads) / sizeof(*threads); t++) {
+                SWFWriterSettings settings = { .compression = SWF_ZLIB, .level = -1, .threads = threads[t] };
+                MemFile cws = { 0 };
+                char what[128];
+                snprintf(what, sizeof(what), "%zu-byte body, %u threads", body_size, threads[t]);
+                if (write_tags(&cws, &settings, &tag, 1) < 0)
+                    failed++;
+                else
+                    failed += check_file(what, &cws, &fws);
+                free(cws.data);
+            }
+            free(fws.data);
+        }
+    }
+    free(payload);
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
+
+#else
+
+int main(void) {
+    printf("CWS isn't supported by this build; skipping\n");
+    return TEST_SKIP;
+}
+
+#endif
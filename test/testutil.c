@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Helpers shared by the "make check" tests, which use only the public API.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+typedef struct {
+    SWFTag *tags;
+    unsigned nb_tags;
+    unsigned n;             ///< Tags handed to the writer so far
+} TagList;
+
+uint32_t next_random(uint64_t *seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 33;
+}
+
+static SWFError write_cb(void *ctx, const void *buf, size_t len) {
+    MemFile *out = ctx;
+    if (out->pos + len > out->alloc) {
+        size_t alloc = out->alloc ? out->alloc : 64 * 1024;
+        while (alloc < out->pos + len)
+            alloc *= 2;
+        uint8_t *data = realloc(out->data, alloc);
+        if (!data)
+            return SWF_NOMEM;
+        out->data = data;
+        out->alloc = alloc;
+    }
+    memcpy(out->data + out->pos, buf, len);
+    out->pos += len;
+    if (out->pos > out->size)
+        out->size = out->pos;
+    return SWF_OK;
+}
+
+static SWFError seek_cb(void *ctx, uint64_t offset) {
+    ((MemFile*)ctx)->pos = offset;
+    return SWF_OK;
+}
+
+void mem_output(SWFWriterOutput *output, MemFile *out) {
+    *output = (SWFWriterOutput) { .write = write_cb, .seek = seek_cb, .ctx = out };
+}
+
+static SWFError next_tag(SWFWriter *writer, SWFTag **tag, void *ctx) {
+    TagList *list = ctx;
+    *tag = list->n < list->nb_tags ? &list->tags[list->n++] : NULL;
+    return SWF_OK;
+}
+
+SWFError write_tags(MemFile *out, SWFWriterSettings *settings, SWFTag *tags, unsigned nb_tags) {
+    TagList list = { .tags = tags, .nb_tags = nb_tags };
+    SWFWriterOutput output;
+    SWFWriter *writer;
+    SWF *swf = swf_init();
+    SWFError ret = SWF_NOMEM;
+    mem_output(&output, out);
+    writer = swf_writer_init(&output, settings);
+    if (swf && writer) {
+        swf->version = 13;
+        swf->frame_size.x_max = 550 * 20;
+        swf->frame_size.y_max = 400 * 20;
+        swf->frame_rate = 24 << 8;
+        if ((ret = swf_writer_write_stream(writer, swf, next_tag, &list)) < 0)
+            fprintf(stderr, "Writing test file: %s\n", swf_writer_get_error(writer)->text);
+    }
+    swf_writer_free(writer);
+    swf_free(swf);
+    return ret;
+}
+
+static SWFError read_cb(void *ctx, void *buf, size_t *len) {
+    MemFile *in = ctx;
+    size_t left = in->size - in->pos;
+    *len = *len < left ? *len : left;
+    memcpy(buf, in->data + in->pos, *len);
+    in->pos += *len;
+    return SWF_OK;
+}
+
+SWFError transcode_file(MemFile *out, SWFCompression compression, const MemFile *in) {
+    MemFile reader = { .data = in->data, .size = in->size };
+    SWFWriterOutput output;
+    SWFWriterSettings settings = { .compression = compression, .level = -1 };
+    SWFWriter *writer;
+    SWFError ret = SWF_NOMEM;
+    mem_output(&output, out);
+    writer = swf_writer_init(&output, &settings);
+    if (writer && (ret = swf_writer_transcode(writer, read_cb, &reader)) < 0)
+        fprintf(stderr, "Transcoding test file: %s\n", swf_writer_get_error(writer)->text);
+    swf_writer_free(writer);
+    return ret;
+}
+
+SWFError parse_pieces(const uint8_t *data, size_t len, size_t piece, const SWFParserLimits *limits,
+                      SWF **out, const char **text) {
+    SWFParser *parser = swf_parser_init();
+    SWFError ret = SWF_NEED_MORE_DATA;
+    *out = NULL;
+    *text = NULL;
+    if (!parser)
+        return SWF_NOMEM;
+    swf_parser_set_limits(parser, limits);
+    for (size_t pos = 0; pos < len && ret != SWF_FINISHED; pos += piece) {
+        size_t size = len - pos < piece ? len - pos : piece;
+        if ((ret = swf_parser_append(parser, data + pos, size)) < 0) {
+            *text = swf_parser_get_error(parser)->text;
+            break;
+        }
+    }
+    if (ret >= 0 && ret != SWF_FINISHED)
+        ret = SWF_NEED_MORE_DATA;
+    *out = swf_parser_get_swf(parser);
+    swf_parser_free(parser);
+    return ret;
+}
+
+int compare_tags(const char *what, const SWF *swf, const SWFTag *want, unsigned nb_want) {
+    for (unsigned i = 0; i < nb_want && i < swf->nb_tags; i++) {
+        const SWFTag *a = &swf->tags[i], *b = &want[i];
+        if (a->type != b->type || a->id != b->id || a->size != b->size) {
+            fprintf(stderr, "%s: tag %u is type %i, ID %u, size %"PRIu32"; expected type %i, ID %u, size %"PRIu32"\n",
+                    what, i, a->type, a->id, a->size, b->type, b->id, b->size);
+            return 1;
+        }
+        if (b->size && memcmp(a->payload, b->payload, b->size)) {
+            fprintf(stderr, "%s: tag %u's payload differs\n", what, i);
+            return 1;
+        }
+    }
+    if (swf->nb_tags != nb_want) {
+        fprintf(stderr, "%s: %u tags; expected %u\n", what, swf->nb_tags, nb_want);
+        return 1;
+    }
+    return 0;
+}
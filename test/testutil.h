@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "swf.h"
+
+/// Exit status that tells "make check" a test was skipped
+#define TEST_SKIP 77
+
+/**
+ * \brief An SWF file written to memory
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t alloc;           ///< Space allocated for data
+    size_t pos;             ///< Write position
+} MemFile;
+
+/**
+ * \brief Steps a 64-bit LCG, so test data is the same on every run.
+ * \return The next 31 random bits
+ */
+uint32_t next_random(uint64_t *seed);
+
+/**
+ * \brief Sets up a writer output that writes into a MemFile.
+ * \param[out] output Output to set up
+ * \param[in]  out    Where to write; free out->data when done
+ */
+void mem_output(SWFWriterOutput *output, MemFile *out);
+
+/**
+ * \brief Writes tags to out as an SWF file, with a fixed header.
+ * \param[out] out      Where to write the file; free out->data when done
+ * \param[in]  settings Writer settings
+ * \param[in]  tags     Tags to write, not including END
+ * \param[in]  nb_tags  Number of tags
+ * \return < 0 if something went wrong.
+ */
+SWFError write_tags(MemFile *out, SWFWriterSettings *settings, SWFTag *tags, unsigned nb_tags);
+
+/**
+ * \brief Re-encodes a file's body with another compression.
+ * \param[out] out         Where to write the file; free out->data when done
+ * \param[in]  compression Compression to write
+ * \param[in]  in          File to re-encode
+ * \return < 0 if something went wrong.
+ */
+SWFError transcode_file(MemFile *out, SWFCompression compression, const MemFile *in);
+
+/**
+ * \brief Parses a whole file with an SWFParser, appending piece bytes at a time.
+ * \param[in]  data   The whole file
+ * \param[in]  len    Size of data
+ * \param[in]  piece  Bytes per swf_parser_append
+ * \param[in]  limits Limits to set on the parser; NULL for none
+ * \param[out] out    Set to the parsed SWF, even on failure; free it with swf_free
+ * \param[out] text   Set to the parser's error text on failure, or NULL
+ * \return SWF_FINISHED if the END tag was reached; SWF_NEED_MORE_DATA if
+ * the data ran out first; < 0 on error.
+ */
+SWFError parse_pieces(const uint8_t *data, size_t len, size_t piece, const SWFParserLimits *limits,
+                      SWF **out, const char **text);
+
+/**
+ * \brief Checks that an SWF has exactly the given tags, followed by nothing.
+ * Prints the first difference.
+ * \param[in] what    Description of how swf was parsed, for the message
+ * \param[in] swf     Parsed SWF
+ * \param[in] want    Expected tags
+ * \param[in] nb_want Number of expected tags
+ * \return 0 if they match; 1 otherwise.
+ */
+int compare_tags(const char *what, const SWF *swf, const SWFTag *want, unsigned nb_want);
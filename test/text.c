@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * text: extracts text from glyph runs in DefineFont2/3 fonts, from
+ * DefineEditText with and without the HTML flag, and from a DoABC string
+ * pool, and checks every span. Some of the strings have multibyte
+ * sequences, valid and not, straddling the 16-byte chunks that the ASCII
+ * fast path checks at a time; invalid ones must be taken as Latin-1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "testutil.h"
+
+#define MAX_SPANS 32
+#define STOP_AFTER 3
+
+/**
+ * \brief A tag payload being built
+ */
+typedef struct {
+    uint8_t data[256];
+    size_t size;
+} Buf;
+
+static void put_8(Buf *b, uint8_t val) {
+    b->data[b->size++] = val;
+}
+
+static void put_16(Buf *b, uint16_t val) {
+    put_8(b, val);
+    put_8(b, val >> 8);
+}
+
+static void put_32(Buf *b, uint32_t val) {
+    put_16(b, val);
+    put_16(b, val >> 16);
+}
+
+static void put_bytes(Buf *b, const char *data, size_t size) {
+    memcpy(b->data + b->size, data, size);
+    b->size += size;
+}
+
+/// Writes a NUL-terminated string, including the NUL
+static void put_string(Buf *b, const char *str) {
+    put_bytes(b, str, strlen(str) + 1);
+}
+
+static void put_u30(Buf *b, uint32_t val) {
+    do {
+        put_8(b, (val & 0x7F) | (val > 0x7F ? 0x80 : 0));
+        val >>= 7;
+    } while (val);
+}
+
+/**
+ * \brief A span of text the extractor should report
+ */
+typedef struct {
+    SWFTextSource source;
+    uint16_t id;
+    const char *text;
+    size_t size;
+    int borrowed;
+} Span;
+
+#define SPAN(source, id, text, borrowed) { source, id, text, sizeof(text) - 1, borrowed }
+
+// 15 ASCII bytes, so a sequence after them crosses a 16-byte boundary
+#define PAD15 "abcdefghijklmno"
+#define PAD30 PAD15 PAD15
+
+/**
+ * \brief A string for the DoABC pool, and what should come out for it
+ */
+typedef struct {
+    const char *in;
+    size_t in_size;
+    Span out;
+} PoolString;
+
+#define POOL(in, out, borrowed) { in, sizeof(in) - 1, SPAN(SWF_TEXT_ABC_STRING, 0, out, borrowed) }
+
+static const PoolString pool[] = {
+    POOL("hello", "hello", 1),
+    // Empty strings aren't reported
+    POOL("", "", 1),
+    // A 3-byte sequence, then a 4-byte one, across the first and second boundaries
+    POOL(PAD15 "\xE4\xB8\xAD" PAD15 "\xF0\x9F\x98\x80" "xyz", PAD15 "\xE4\xB8\xAD" PAD15 "\xF0\x9F\x98\x80" "xyz", 1),
+    // A 3-byte sequence missing its last byte, across the first boundary
+    POOL(PAD15 "\xE4\xB8" "AB", PAD15 "\xC3\xA4\xC2\xB8" "AB", 0),
+    // A lone continuation byte right after a whole chunk of ASCII
+    POOL(PAD30 "p\x80q", PAD30 "p\xC2\x80q", 0),
+    // An overlong NUL, and a sequence cut off by the end of the string
+    POOL("\xC0\x80", "\xC3\x80\xC2\x80", 0),
+    POOL(PAD15 "\xC3", PAD15 "\xC3\x83", 0),
+};
+
+static const Span want[] = {
+    // DefineText: font 1 with wide codes, then font 2, then font 2 again
+    // without a font change; glyph 9 isn't in font 1
+    SPAN(SWF_TEXT_GLYPHS, 10, "Hi\xC3\xA9\xE4\xB8\xAD\xEF\xBF\xBD", 0),
+    SPAN(SWF_TEXT_GLYPHS, 10, "cba", 0),
+    SPAN(SWF_TEXT_GLYPHS, 10, "a", 0),
+    // DefineText2 with font 3's narrow codes
+    SPAN(SWF_TEXT_GLYPHS, 11, "yx", 0),
+    SPAN(SWF_TEXT_EDIT_HTML, 20, "<p>caf\xC3\xA9</p>", 1),
+    // Latin-1, converted
+    SPAN(SWF_TEXT_EDIT_TEXT, 21, "na\xC3\xAFve", 0),
+};
+
+/**
+ * \brief Writes a DefineFont2 or DefineFont3 with no glyph shapes.
+ * \param[in] shapes Bytes of shape data to put between the offset table and the codes
+ */
+static void put_font(Buf *b, SWFTagType type, uint8_t flags, const uint16_t *codes, unsigned nb_codes,
+                     unsigned shapes) {
+    // DefineFont3 codes are always wide
+    int wide_offsets = flags & 0x08, wide_codes = flags & 0x04 || type == SWF_DEFINE_FONT_3;
+    uint32_t code_offset = (nb_codes + 1) * (wide_offsets ? 4 : 2) + shapes;
+    put_8(b, flags);
+    put_8(b, 0); // LanguageCode
+    put_8(b, 4);
+    put_bytes(b, "Font", 4);
+    put_16(b, nb_codes);
+    for (unsigned i = 0; i < nb_codes; i++) {
+        if (wide_offsets)
+            put_32(b, code_offset);
+        else
+            put_16(b, code_offset);
+    }
+    if (wide_offsets)
+        put_32(b, code_offset);
+    else
+        put_16(b, code_offset);
+    for (unsigned i = 0; i < shapes; i++)
+        put_8(b, 0);
+    for (unsigned i = 0; i < nb_codes; i++) {
+        if (wide_codes)
+            put_16(b, codes[i]);
+        else
+            put_8(b, codes[i]);
+    }
+}
+
+/**
+ * \brief Writes glyph entries with 4-bit indices and advances.
+ */
+static void put_glyphs(Buf *b, const uint8_t *glyphs, unsigned nb_glyphs) {
+    put_8(b, nb_glyphs);
+    for (unsigned i = 0; i < nb_glyphs; i++)
+        put_8(b, glyphs[i] << 4 | 5);
+}
+
+typedef struct {
+    SWFTag tags[16];
+    Buf payloads[16];
+    unsigned nb_tags;
+} TagList;
+
+static Buf *add_tag(TagList *list, SWFTagType type, uint16_t id) {
+    Buf *b = &list->payloads[list->nb_tags];
+    list->tags[list->nb_tags++] = (SWFTag) { .type = type, .id = id, .payload = b->data, .flags = SWF_TAG_BORROWED };
+    b->size = 0;
+    return b;
+}
+
+static void make_tags(TagList *list) {
+    static const uint16_t codes_1[] = { 'H', 'i', 0xE9, 0x4E2D };
+    static const uint16_t codes_2[] = { 'a', 'b', 'c' };
+    static const uint16_t codes_3[] = { 'x', 'y' };
+    static const uint8_t glyphs_1[] = { 0, 1, 2, 3, 9 }, glyphs_2[] = { 2, 1, 0 }, glyphs_3[] = { 0 };
+    static const uint8_t glyphs_4[] = { 1, 0 };
+    Buf *b;
+
+    put_font(add_tag(list, SWF_DEFINE_FONT_2, 1), SWF_DEFINE_FONT_2, 0x04, codes_1, 4, 0);
+    put_font(add_tag(list, SWF_DEFINE_FONT_3, 2), SWF_DEFINE_FONT_3, 0x08, codes_2, 3, 5);
+    put_font(add_tag(list, SWF_DEFINE_FONT_2, 3), SWF_DEFINE_FONT_2, 0x00, codes_3, 2, 0);
+
+    b = add_tag(list, SWF_DEFINE_TEXT, 10);
+    put_8(b, 0);                // Zero-width RECT
+    put_8(b, 0);                // Identity MATRIX
+    put_8(b, 4);                // GlyphBits
+    put_8(b, 4);                // AdvanceBits
+    put_8(b, 0x88);             // HasFont
+    put_16(b, 1);
+    put_16(b, 240);
+    put_glyphs(b, glyphs_1, sizeof(glyphs_1));
+    put_8(b, 0x8D);             // HasFont, HasColor, HasXOffset
+    put_16(b, 2);
+    put_bytes(b, "\xFF\x00\x00", 3);
+    put_16(b, 100);
+    put_16(b, 240);
+    put_glyphs(b, glyphs_2, sizeof(glyphs_2));
+    put_8(b, 0x82);             // HasYOffset
+    put_16(b, 300);
+    put_glyphs(b, glyphs_3, sizeof(glyphs_3));
+    put_8(b, 0);
+
+    b = add_tag(list, SWF_DEFINE_TEXT_2, 11);
+    put_8(b, 0);
+    put_8(b, 0);
+    put_8(b, 4);
+    put_8(b, 4);
+    put_8(b, 0x8C);             // HasFont, HasColor, which has alpha here
+    put_16(b, 3);
+    put_bytes(b, "\x00\xFF\x00\x80", 4);
+    put_16(b, 240);
+    put_glyphs(b, glyphs_4, sizeof(glyphs_4));
+    put_8(b, 0);
+
+    b = add_tag(list, SWF_DEFINE_EDIT_TEXT, 20);
+    put_8(b, 0);
+    put_8(b, 0x85);             // HasText, HasTextColor, HasFont
+    put_8(b, 0x22);             // HasLayout, HTML
+    put_16(b, 1);
+    put_16(b, 240);
+    put_bytes(b, "\x00\x00\x00\xFF", 4);
+    put_bytes(b, "\x00\x00\x00\x00\x00\x00\x00\x00\x00", 9);
+    put_string(b, "v");
+    put_string(b, "<p>caf\xC3\xA9</p>");
+
+    b = add_tag(list, SWF_DEFINE_EDIT_TEXT, 21);
+    put_8(b, 0);
+    put_8(b, 0x82);             // HasText, HasMaxLength
+    put_8(b, 0x80);             // HasFontClass
+    put_string(b, "MyFont");
+    put_16(b, 240);
+    put_16(b, 50);
+    put_string(b, "w");
+    put_string(b, "na\xEFve");
+
+    // No HasText, so no text
+    b = add_tag(list, SWF_DEFINE_EDIT_TEXT, 22);
+    put_8(b, 0);
+    put_8(b, 0x00);
+    put_8(b, 0x00);
+    put_string(b, "nothing");
+
+    b = add_tag(list, SWF_DO_ABC, 0);
+    put_32(b, 1);               // Flags
+    put_string(b, "frame1");
+    put_16(b, 16);
+    put_16(b, 46);
+    put_u30(b, 3);              // int pool
+    put_u30(b, 1);
+    put_u30(b, 300);
+    put_u30(b, 0);              // uint pool
+    put_u30(b, 2);              // double pool
+    put_bytes(b, "\x00\x00\x00\x00\x00\x00\xF0\x3F", 8);
+    put_u30(b, sizeof(pool) / sizeof(*pool) + 1);
+    for (unsigned i = 0; i < sizeof(pool) / sizeof(*pool); i++) {
+        put_u30(b, pool[i].in_size);
+        put_bytes(b, pool[i].in, pool[i].in_size);
+    }
+    put_u30(b, 0);              // namespace pool; the rest is never read
+
+    for (unsigned i = 0; i < list->nb_tags; i++)
+        list->tags[i].size = list->payloads[i].size;
+}
+
+/**
+ * \brief Spans reported so far
+ */
+typedef struct {
+    Span spans[MAX_SPANS];
+    char text[MAX_SPANS][128];
+    unsigned nb_spans;
+    unsigned stop_after;        ///< Stop extracting after this many spans; 0 to never
+    int failed;
+} Found;
+
+static SWFError text_cb(SWFTextSpan *span, void *ctx) {
+    Found *found = ctx;
+    const SWFTag *tag = span->tag;
+    if (found->nb_spans == MAX_SPANS || span->size > sizeof(found->text[0])) {
+        fprintf(stderr, "Too many spans, or too long a one\n");
+        found->failed++;
+        return SWF_UNKNOWN;
+    }
+    if (span->borrowed && (span->text < (const char*)tag->payload ||
+                           span->text + span->size > (const char*)tag->payload + tag->size)) {
+        fprintf(stderr, "Span %u is borrowed, but isn't in its tag's payload\n", found->nb_spans);
+        found->failed++;
+    }
+    char *text = found->text[found->nb_spans];
+    memcpy(text, span->text, span->size);
+    found->spans[found->nb_spans++] = (Span) {
+        .source = span->source,
+        .id = span->id,
+        .text = text,
+        .size = span->size,
+        .borrowed = span->borrowed,
+    };
+    return found->nb_spans == found->stop_after ? SWF_FINISHED : SWF_OK;
+}
+
+static int check_span(unsigned i, const Span *span, const Span *want) {
+    if (span->source != want->source || span->id != want->id || span->size != want->size ||
+        memcmp(span->text, want->text, want->size) || !span->borrowed != !want->borrowed) {
+        fprintf(stderr, "Span %u is \"%.*s\" (%zu bytes) from source %i, ID %u, borrowed %i; "
+                "expected \"%s\" (%zu bytes) from source %i, ID %u, borrowed %i\n", i,
+                (int)span->size, span->text, span->size, span->source, span->id, span->borrowed,
+                want->text, want->size, want->source, want->id, want->borrowed);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Checks every span found, in order.
+ * \return Number of failures
+ */
+static int check_spans(const Found *found) {
+    unsigned nb_want = sizeof(want) / sizeof(*want), n = 0;
+    int failed = found->failed;
+    for (unsigned i = 0; i < found->nb_spans; i++) {
+        const Span *expect = NULL;
+        // Empty strings are skipped
+        while (n >= nb_want && n - nb_want < sizeof(pool) / sizeof(*pool) && !pool[n - nb_want].out.size)
+            n++;
+        if (n < nb_want)
+            expect = &want[n];
+        else if (n - nb_want < sizeof(pool) / sizeof(*pool))
+            expect = &pool[n - nb_want].out;
+        if (!expect) {
+            fprintf(stderr, "Span %u wasn't expected\n", i);
+            return failed + 1;
+        }
+        failed += check_span(i, &found->spans[i], expect);
+        n++;
+    }
+    unsigned nb_nonempty = nb_want;
+    for (unsigned i = 0; i < sizeof(pool) / sizeof(*pool); i++)
+        nb_nonempty += !!pool[i].out.size;
+    if (!found->stop_after && found->nb_spans != nb_nonempty) {
+        fprintf(stderr, "%u spans; expected %u\n", found->nb_spans, nb_nonempty);
+        failed++;
+    }
+    return failed;
+}
+
+int main(void) {
+    static TagList list;
+    static Found found, stopped = { .stop_after = STOP_AFTER };
+    SWFWriterSettings settings = { .compression = SWF_UNCOMPRESSED };
+    MemFile file = { 0 };
+    SWF *swf;
+    int failed = 0;
+    make_tags(&list);
+    if (write_tags(&file, &settings, list.tags, list.nb_tags) < 0)
+        return 1;
+    if (swf_parse_memory(file.data, file.size, 0, NULL, &swf) < 0) {
+        fprintf(stderr, "swf_parse_memory: %s\n", swf && swf->err.text ? swf->err.text : "failed");
+        swf_free(swf);
+        free(file.data);
+        return 1;
+    }
+    if (swf_extract_text(swf, text_cb, &found) < 0) {
+        fprintf(stderr, "swf_extract_text: %s\n", swf->err.text);
+        failed++;
+    }
+    failed += check_spans(&found);
+
+    // A callback that returns anything but SWF_OK stops extraction
+    if (swf_extract_text(swf, text_cb, &stopped) < 0) {
+        fprintf(stderr, "swf_extract_text, stopped early: %s\n", swf->err.text);
+        failed++;
+    } else if (stopped.nb_spans != STOP_AFTER) {
+        fprintf(stderr, "swf_extract_text, stopped early: %u spans; expected %u\n", stopped.nb_spans, STOP_AFTER);
+        failed++;
+    }
+    failed += check_spans(&stopped);
+
+    swf_free(swf);
+    free(file.data);
+    if (failed)
+        fprintf(stderr, "%i failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * swfgen: writes synthetic SWF files for benchmarking and stress-testing,
+ * from a seed, so the same options always give the same file.
+ * The tags' types and sizes are planned with one random stream, and each
+ * tag's contents come from a stream seeded by its index. A first pass over
+ * the plan gives the exact file size and frame count for the header, then
+ * the tags are generated one at a time as the writer asks for them, so
+ * memory use doesn't depend on the size of the file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "swf.h"
+
+typedef enum {
+    KIND_TINY,      ///< PlaceObject2, RemoveObject2 and ShowFrame tags of a few bytes
+    KIND_BINARY,    ///< Large DefineBinaryData tags
+    KIND_SPRITE,    ///< DefineSprites nested inside each other
+    KIND_LONG,      ///< Small FrameLabels, written with long headers anyway
+    KIND_BITMAP,    ///< DefineBitsLossless2 ARGB bitmaps
+    KIND_ABC,       ///< DoABC tags with ActionScript 3 bytecode-sized blobs
+    NB_KINDS,
+} TagKind;
+
+static const char *const kind_names[NB_KINDS] = { "tiny", "binary", "sprite", "long", "bitmap", "abc" };
+
+#define RECT_SIZE 9         ///< Bytes in the header's frame size RECT
+#define MAX_ABC_SIZE (256 * 1024)
+#define ZLIB_BLOCK 65535    ///< Largest stored deflate block
+
+/**
+ * \brief What to generate
+ */
+typedef struct {
+    unsigned weights[NB_KINDS];
+    unsigned total_weight;
+    uint32_t max_binary;    ///< Largest DefineBinaryData payload
+    unsigned max_depth;     ///< Deepest sprite nesting
+    unsigned max_bitmap;    ///< Largest bitmap width and height
+} Mix;
+
+/**
+ * \brief A planned tag, before its payload is generated
+ */
+typedef struct {
+    TagKind kind;
+    SWFTagType type;
+    uint32_t size;          ///< Payload size, not counting an ID written by the library
+    uint16_t id;            ///< Character ID, for types whose ID the library writes
+    uint8_t flags;          ///< SWFTagFlags
+    unsigned width;         ///< Bitmap width, or sprite depth
+    unsigned height;        ///< Bitmap height
+} TagPlan;
+
+/**
+ * \brief Plans the file's tags; see plan_next
+ */
+typedef struct {
+    const Mix *mix;
+    uint64_t rng;           ///< Layout stream
+    uint64_t target;        ///< Bytes of tags to plan, headers included
+    uint64_t planned;       ///< Bytes of tags planned so far
+    unsigned nb_tags;
+    unsigned nb_frames;
+    uint16_t next_id;       ///< Next character ID to define
+} Planner;
+
+typedef struct {
+    Planner planner;
+    uint64_t seed;
+    SWFTag tag;
+    uint8_t *payload;       ///< Big enough for any planned tag
+    uint64_t counts[NB_KINDS];
+} Generator;
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * \brief Gets a random number from lo to hi, inclusive
+ */
+static uint32_t rand_range(uint64_t *state, uint32_t lo, uint32_t hi) {
+    return lo + (hi > lo ? splitmix64(state) % ((uint64_t)hi - lo + 1) : 0);
+}
+
+static void put_16(uint8_t *buf, uint16_t val) {
+    buf[0] = val;
+    buf[1] = val >> 8;
+}
+
+static void put_32(uint8_t *buf, uint32_t val) {
+    put_16(buf, val);
+    put_16(buf + 2, val >> 16);
+}
+
+/**
+ * \brief Size of a tag header, including the ID if the library writes one.
+ * Matches the writer: long headers for payloads of 63 bytes or more.
+ */
+static uint32_t header_size(uint32_t size, int has_id, int force_long) {
+    size += has_id ? 2 : 0;
+    return (force_long || size >= 0x3F ? 6 : 2) + (has_id ? 2 : 0);
+}
+
+/**
+ * \brief Writes a tag header for a tag nested in a sprite's payload
+ */
+static size_t put_header(uint8_t *buf, SWFTagType type, uint32_t size) {
+    if (size < 0x3F) {
+        put_16(buf, type << 6 | size);
+        return 2;
+    }
+    put_16(buf, type << 6 | 0x3F);
+    put_32(buf + 2, size);
+    return 6;
+}
+
+/**
+ * \brief Size of a DefineSprite's payload at the given depth, not counting its ID.
+ * Each level holds three PlaceObject2s, the next level down, a ShowFrame and an END.
+ */
+static uint32_t sprite_size(unsigned depth) {
+    uint32_t size = 2 + 3 * (2 + 5) + 2 + 2;
+    if (depth > 1) {
+        uint32_t inner = sprite_size(depth - 1) + 2;
+        size += (inner >= 0x3F ? 6 : 2) + inner;
+    }
+    return size;
+}
+
+/**
+ * \brief Size of a zlib stream holding len bytes in stored blocks
+ */
+static uint32_t zlib_stored_size(uint32_t len) {
+    return 2 + len + 5 * (len ? (len + ZLIB_BLOCK - 1) / ZLIB_BLOCK : 1) + 4;
+}
+
+static TagKind pick_kind(Planner *p) {
+    uint32_t r = splitmix64(&p->rng) % p->mix->total_weight;
+    for (TagKind kind = 0; kind < NB_KINDS; kind++) {
+        if (r < p->mix->weights[kind])
+            return kind;
+        r -= p->mix->weights[kind];
+    }
+    return KIND_TINY;
+}
+
+/**
+ * \brief Plans the next tag.
+ * \return 0 once the target size has been reached
+ */
+static int plan_next(Planner *p, TagPlan *plan) {
+    const Mix *mix = p->mix;
+    uint64_t left = p->target > p->planned ? p->target - p->planned : 0;
+    memset(plan, 0, sizeof(*plan));
+    if (!p->nb_tags) {
+        // Every file starts with FileAttributes
+        plan->type = SWF_FILE_ATTRIBUTES;
+        plan->size = 4;
+    } else if (!left) {
+        return 0;
+    } else {
+        switch ((plan->kind = pick_kind(p))) {
+        case KIND_TINY:
+            switch (splitmix64(&p->rng) % 8) {
+            case 0:
+                plan->type = SWF_SHOW_FRAME;
+                break;
+            case 1:
+                plan->type = SWF_REMOVE_OBJECT_2;
+                plan->size = 2;
+                break;
+            default:
+                // Moving an object (3 bytes) or placing one (5 bytes)
+                plan->type = SWF_PLACE_OBJECT_2;
+                plan->size = splitmix64(&p->rng) & 1 ? 3 : 5;
+                break;
+            }
+            break;
+        case KIND_BINARY:
+            plan->type = SWF_DEFINE_BINARY_DATA;
+            plan->size = 6 + rand_range(&p->rng, mix->max_binary / 16, mix->max_binary);
+            if (plan->size > left)
+                plan->size = left > 6 ? left : 6;
+            break;
+        case KIND_SPRITE:
+            plan->type = SWF_DEFINE_SPRITE;
+            plan->id = p->next_id++;
+            plan->width = rand_range(&p->rng, 1, mix->max_depth);
+            plan->size = sprite_size(plan->width);
+            break;
+        case KIND_LONG:
+            plan->type = SWF_FRAME_LABEL;
+            plan->flags = SWF_TAG_LONG_HEADER;
+            plan->size = rand_range(&p->rng, 2, 40);
+            break;
+        case KIND_BITMAP:
+            plan->type = SWF_DEFINE_BITS_LOSSLESS_2;
+            plan->id = p->next_id++;
+            plan->width = rand_range(&p->rng, 16, mix->max_bitmap);
+            plan->height = rand_range(&p->rng, 16, mix->max_bitmap);
+            if ((uint64_t)plan->width * plan->height * 4 > left) {
+                plan->height = left / (plan->width * 4);
+                plan->height = plan->height ? plan->height : 1;
+            }
+            plan->size = 5 + zlib_stored_size(plan->width * plan->height * 4);
+            break;
+        case KIND_ABC:
+            plan->type = SWF_DO_ABC;
+            plan->size = 4 + 8 + rand_range(&p->rng, 4 + MAX_ABC_SIZE / 64, 4 + MAX_ABC_SIZE);
+            if (plan->size > left)
+                plan->size = left > 16 ? left : 16;
+            break;
+        default:
+            break;
+        }
+        if (!p->next_id)
+            // IDs wrap around; 0 isn't a valid one
+            p->next_id = 1;
+    }
+    p->nb_tags++;
+    p->nb_frames += plan->type == SWF_SHOW_FRAME;
+    p->planned += header_size(plan->size, plan->id != 0, plan->flags & SWF_TAG_LONG_HEADER) + plan->size;
+    return 1;
+}
+
+/**
+ * \brief Fills buf with stretches of text, repeats, zeros and noise, so
+ * it compresses about as well as real-world data does.
+ */
+static void fill_mixed(uint64_t *rng, uint8_t *buf, uint32_t size) {
+    static const char text[] = "package { import flash.display.Sprite; public class Main extends Sprite { "
+                               "private var frame:int = 0; public function Main() { addEventListener(";
+    uint32_t i = 0;
+    while (i < size) {
+        uint32_t len = rand_range(rng, 64, 4096);
+        len = len < size - i ? len : size - i;
+        switch (splitmix64(rng) % 4) {
+        case 0:
+            for (uint32_t j = 0; j < len; j++)
+                buf[i + j] = text[(j + i) % (sizeof(text) - 1)];
+            break;
+        case 1:
+            if (i >= 256) {
+                uint32_t dist = rand_range(rng, 1, 256);
+                for (uint32_t j = 0; j < len; j++)
+                    buf[i + j] = buf[i + j - dist];
+                break;
+            }
+            // Fall through to zeros if there's nothing to repeat yet
+        case 2:
+            memset(buf + i, 0, len);
+            break;
+        default:
+            for (uint32_t j = 0; j < len; j += 8) {
+                uint64_t r = splitmix64(rng);
+                memcpy(buf + i + j, &r, len - j < 8 ? len - j : 8);
+            }
+            break;
+        }
+        i += len;
+    }
+}
+
+static size_t fill_sprite(uint64_t *rng, uint8_t *buf, unsigned depth, uint16_t id) {
+    size_t pos = 2;
+    put_16(buf, 1);     // Frame count
+    for (int i = 0; i < 3; i++) {
+        pos += put_header(buf + pos, SWF_PLACE_OBJECT_2, 5);
+        buf[pos] = 0x02;  // PlaceFlagHasCharacter
+        put_16(buf + pos + 1, i + 1);
+        put_16(buf + pos + 3, rand_range(rng, 1, id > 1 ? id - 1 : 1));
+        pos += 5;
+    }
+    if (depth > 1) {
+        uint32_t inner = sprite_size(depth - 1) + 2;
+        pos += put_header(buf + pos, SWF_DEFINE_SPRITE, inner);
+        put_16(buf + pos, id);
+        pos += 2 + fill_sprite(rng, buf + pos + 2, depth - 1, id);
+    }
+    pos += put_header(buf + pos, SWF_SHOW_FRAME, 0);
+    pos += put_header(buf + pos, SWF_END, 0);
+    return pos;
+}
+
+/**
+ * \brief Writes a DefineBitsLossless2 payload (minus the ID): a gradient
+ * with some noise, in a zlib stream of stored blocks.
+ */
+static void fill_bitmap(uint64_t *rng, uint8_t *buf, unsigned width, unsigned height) {
+    uint32_t len = width * height * 4, a = 1, b = 0, i = 0;
+    uint8_t *out = buf + 5;
+    buf[0] = 5;         // 32-bit ARGB
+    put_16(buf + 1, width);
+    put_16(buf + 3, height);
+    *out++ = 0x78;
+    *out++ = 0x01;
+    do {
+        uint32_t block = len - i < ZLIB_BLOCK ? len - i : ZLIB_BLOCK;
+        *out++ = i + block == len;
+        put_16(out, block);
+        put_16(out + 2, ~block);
+        out += 4;
+        for (uint32_t end = i + block; i < end; i++) {
+            uint32_t pixel = i >> 2, x = pixel % width, y = pixel / width;
+            switch (i & 3) {
+            case 0: *out = 0xFF; break;
+            case 1: *out = x * 255 / width; break;
+            case 2: *out = y * 255 / height; break;
+            default: *out = (x ^ y) + (splitmix64(rng) & 15); break;
+            }
+            a += *out++;
+            b += a;
+            if ((i & 4095) == 4095) {
+                a %= 65521;
+                b %= 65521;
+            }
+        }
+    } while (i < len);
+    a %= 65521;
+    b %= 65521;
+    out[0] = b >> 8;
+    out[1] = b;
+    out[2] = a >> 8;
+    out[3] = a;
+}
+
+static SWFError next_tag(SWFWriter *writer, SWFTag **tag, void *ctx) {
+    Generator *gen = ctx;
+    TagPlan plan;
+    unsigned index = gen->planner.nb_tags;
+    if (!plan_next(&gen->planner, &plan)) {
+        *tag = NULL;
+        return SWF_OK;
+    }
+    uint64_t rng = gen->seed ^ ((uint64_t)index * 0xD1B54A32D192ED03ULL);
+    uint8_t *buf = gen->payload;
+    switch (plan.type) {
+    case SWF_FILE_ATTRIBUTES:
+        put_32(buf, 0x08);  // ActionScript 3
+        break;
+    case SWF_PLACE_OBJECT_2:
+        buf[0] = plan.size == 3 ? 0x01 : 0x02;  // Move, or place a character
+        put_16(buf + 1, rand_range(&rng, 1, 64));
+        if (plan.size == 5)
+            put_16(buf + 3, rand_range(&rng, 1, gen->planner.next_id > 1 ? gen->planner.next_id - 1 : 1));
+        break;
+    case SWF_REMOVE_OBJECT_2:
+        put_16(buf, rand_range(&rng, 1, 64));
+        break;
+    case SWF_DEFINE_BINARY_DATA:
+        put_16(buf, index & 0xFFFF);
+        put_32(buf + 2, 0);
+        fill_mixed(&rng, buf + 6, plan.size - 6);
+        break;
+    case SWF_DEFINE_SPRITE:
+        fill_sprite(&rng, buf, plan.width, plan.id);
+        break;
+    case SWF_FRAME_LABEL:
+        for (uint32_t i = 0; i < plan.size - 1; i++)
+            buf[i] = 'a' + splitmix64(&rng) % 26;
+        buf[plan.size - 1] = 0;
+        break;
+    case SWF_DEFINE_BITS_LOSSLESS_2:
+        fill_bitmap(&rng, buf, plan.width, plan.height);
+        break;
+    case SWF_DO_ABC:
+        put_32(buf, 1);     // kDoAbcLazyInitializeFlag
+        memcpy(buf + 4, "gen\0", 4);
+        put_16(buf + 8, 16);
+        put_16(buf + 10, 46);
+        fill_mixed(&rng, buf + 12, plan.size - 12);
+        break;
+    default:
+        break;
+    }
+    memset(&gen->tag, 0, sizeof(gen->tag));
+    gen->tag.type = plan.type;
+    gen->tag.size = plan.size;
+    gen->tag.id = plan.id;
+    gen->tag.flags = plan.flags;
+    gen->tag.payload = plan.size ? buf : NULL;
+    gen->counts[plan.kind]++;
+    *tag = &gen->tag;
+    return SWF_OK;
+}
+
+static SWFError write_cb(void *ctx, const void *buf, size_t len) {
+    return fwrite(buf, 1, len, ctx) == len ? SWF_OK : SWF_UNKNOWN;
+}
+
+static SWFError seek_cb(void *ctx, uint64_t offset) {
+    return fseeko(ctx, offset, SEEK_SET) ? SWF_UNKNOWN : SWF_OK;
+}
+
+/**
+ * \brief Parses a size with an optional K, M or G suffix
+ */
+static uint64_t parse_size(const char *str) {
+    char *end;
+    uint64_t size = strtoull(str, &end, 10);
+    switch (*end) {
+    case 'G': case 'g': size <<= 10; // Fall through
+    case 'M': case 'm': size <<= 10; // Fall through
+    case 'K': case 'k': size <<= 10; end++; break;
+    default: break;
+    }
+    return *end ? 0 : size;
+}
+
+/**
+ * \brief Parses a tag mix like "tiny=50,binary=2"; unnamed kinds get weight 0
+ */
+static int parse_mix(Mix *mix, char *str) {
+    memset(mix->weights, 0, sizeof(mix->weights));
+    for (char *item = strtok(str, ","); item; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        TagKind kind = 0;
+        if (!eq)
+            return -1;
+        *eq = 0;
+        while (kind < NB_KINDS && strcmp(item, kind_names[kind]))
+            kind++;
+        if (kind == NB_KINDS)
+            return -1;
+        mix->weights[kind] = strtoul(eq + 1, NULL, 10);
+    }
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options] output.swf\n"
+            "Writes a synthetic SWF file; the same options always give the same file.\n"
+            "  -S SIZE   Decompressed size, with an optional K, M or G suffix (default: 1M)\n"
+            "  -s SEED   Random seed (default: 1)\n"
+            "  -c F|C|Z  Compression (default: Z)\n"
+            "  -l LEVEL  Compression level from 0 to 9 (default: library's default)\n"
+            "  -j N      Threads to compress with (default: 1)\n"
+            "  -m MIX    Relative weights of each kind of tag, as kind=weight,...\n"
+            "            Kinds: tiny, binary, sprite, long, bitmap, abc\n"
+            "            (default: tiny=60,binary=2,sprite=10,long=20,bitmap=3,abc=5)\n"
+            "  -B SIZE   Largest DefineBinaryData payload (default: 16M)\n"
+            "  -d DEPTH  Deepest nesting of sprites (default: 16)\n"
+            "  -b SIDE   Largest bitmap width and height (default: 2048)\n"
+            "The output may be - for stdout; ZWS written there has no compressed length.\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    static Generator gen;
+    Mix mix = {
+        .weights = { [KIND_TINY] = 60, [KIND_BINARY] = 2, [KIND_SPRITE] = 10,
+                     [KIND_LONG] = 20, [KIND_BITMAP] = 3, [KIND_ABC] = 5 },
+        .max_binary = 16 << 20,
+        .max_depth = 16,
+        .max_bitmap = 2048,
+    };
+    SWFWriterSettings settings = { .compression = SWF_LZMA, .level = -1 };
+    uint64_t size = 1 << 20, seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "S:s:c:l:j:m:B:d:b:")) != -1) {
+        switch (c) {
+        case 'S':
+            size = parse_size(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'c':
+            if (strlen(optarg) != 1 || !strchr("FCZ", optarg[0])) {
+                usage(argv[0]);
+                return 1;
+            }
+            settings.compression = optarg[0];
+            break;
+        case 'l':
+            settings.level = atoi(optarg);
+            break;
+        case 'j':
+            settings.threads = atoi(optarg);
+            break;
+        case 'm':
+            if (parse_mix(&mix, optarg) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'B':
+            mix.max_binary = parse_size(optarg);
+            break;
+        case 'd':
+            mix.max_depth = atoi(optarg);
+            break;
+        case 'b':
+            mix.max_bitmap = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (TagKind kind = 0; kind < NB_KINDS; kind++)
+        mix.total_weight += mix.weights[kind];
+    if (optind != argc - 1 || !size || !mix.total_weight || mix.max_binary < 16 ||
+        mix.max_binary > (256 << 20) || mix.max_depth < 1 || mix.max_depth > 64 ||
+        mix.max_bitmap < 16 || mix.max_bitmap > 8192) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *out_path = argv[optind];
+
+    // First pass: plan every tag, for the header's size and frame count
+    SWF *swf = swf_init();
+    if (!swf) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    swf->version = settings.compression == SWF_LZMA ? 13 : 10;
+    swf->frame_size.x_max = 550 * 20;
+    swf->frame_size.y_max = 400 * 20;
+    swf->frame_rate = 24 << 8;
+    Planner planner = { .mix = &mix, .rng = seed, .next_id = 1 };
+    uint64_t header = 8 + RECT_SIZE + 4, end = 2;
+    planner.target = size > header + end ? size - header - end : 0;
+    TagPlan plan;
+    uint32_t max_size = 0;
+    while (plan_next(&planner, &plan))
+        max_size = plan.size > max_size ? plan.size : max_size;
+    if (header + planner.planned + end > UINT32_MAX) {
+        fprintf(stderr, "SWF files can't be larger than 4GiB\n");
+        swf_free(swf);
+        return 1;
+    }
+    swf->size = header + planner.planned + end;
+    swf->frame_count = planner.nb_frames > 0xFFFF ? 0xFFFF : planner.nb_frames;
+
+    // Second pass: the same plan, generating each tag as it's written
+    gen.planner = (Planner){ .mix = &mix, .rng = seed, .target = planner.target, .next_id = 1 };
+    gen.seed = seed;
+    FILE *out = strcmp(out_path, "-") ? fopen(out_path, "wb") : stdout;
+    if (!out || !(gen.payload = malloc(max_size ? max_size : 1))) {
+        fprintf(stderr, "%s: %s\n", out_path, out ? "Not enough memory" : "Couldn't open file");
+        swf_free(swf);
+        return 1;
+    }
+    SWFWriterOutput output = { .write = write_cb, .seek = out != stdout ? seek_cb : NULL, .ctx = out };
+    SWFWriter *writer = swf_writer_init(&output, &settings);
+    SWFError ret = SWF_NOMEM;
+    if (!writer)
+        fprintf(stderr, "Not enough memory\n");
+    else if ((ret = swf_writer_write_stream(writer, swf, next_tag, &gen)) < 0)
+        fprintf(stderr, "%s: %s\n", out_path, swf_writer_get_error(writer)->text);
+    if (out != stdout && fclose(out) && ret >= 0) {
+        fprintf(stderr, "%s: Error writing file\n", out_path);
+        ret = SWF_UNKNOWN;
+    }
+    if (ret >= 0) {
+        fprintf(stderr, "%s: %u bytes, %u tags, %u frames (", out_path, swf->size,
+                planner.nb_tags, planner.nb_frames);
+        for (TagKind kind = 0; kind < NB_KINDS; kind++)
+            fprintf(stderr, "%s%s %llu", kind ? ", " : "", kind_names[kind],
+                    (unsigned long long)gen.counts[kind]);
+        fprintf(stderr, ")\n");
+    }
+    swf_writer_free(writer);
+    swf_free(swf);
+    free(gen.payload);
+    return ret < 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2014 Rodger Combs <rodger.combs@gmail.com>
+ *
+ * This file is part of libswf.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * swfopt: strips debugging and metadata tags from an SWF file, recompresses
+ * its lossless bitmaps, and writes it back out with the best compression
+ * its version allows (LZMA for version 13 and up).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "swf.h"
+
+static SWFError write_cb(void *ctx, const void *buf, size_t len) {
+    return fwrite(buf, 1, len, ctx) == len ? SWF_OK : SWF_UNKNOWN;
+}
+
+static SWFError seek_cb(void *ctx, uint64_t offset) {
+    return fseeko(ctx, offset, SEEK_SET) ? SWF_UNKNOWN : SWF_OK;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options] input.swf output.swf\n"
+            "  -d        Keep debugging tags (EnableDebugger, DebugID, EnableTelemetry)\n"
+            "  -m        Keep metadata tags (ProductInfo, Metadata)\n"
+            "  -b        Don't recompress lossless bitmaps\n"
+            "  -c F|C|Z  Output compression (default: Z if the version allows it, else C)\n"
+            "  -l LEVEL  Compression level from 1 to 9 (default: 9)\n"
+            "  -j N      Threads to compress with (default: 1)\n",
+            name);
+}
+
+static SWFError parse_file(SWFParser *parser, FILE *file) {
+    uint8_t data[200 * 1024];
+    for (;;) {
+        size_t read = fread(data, 1, sizeof(data), file);
+        if (!read)
+            return ferror(file) ? SWF_UNKNOWN : SWF_INVALID;
+        SWFError ret = swf_parser_append(parser, data, read);
+        if (ret < 0 || ret == SWF_FINISHED)
+            return ret;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    SWFOptimizeSettings opt = { .flags = SWF_OPTIMIZE_STRIP_DEBUG | SWF_OPTIMIZE_STRIP_METADATA |
+                                         SWF_OPTIMIZE_BITMAPS };
+    SWFWriterSettings settings = { .level = 9 };
+    int c;
+    while ((c = getopt(argc, argv, "dmbc:l:j:")) != -1) {
+        switch (c) {
+        case 'd':
+            opt.flags &= ~SWF_OPTIMIZE_STRIP_DEBUG;
+            break;
+        case 'm':
+            opt.flags &= ~SWF_OPTIMIZE_STRIP_METADATA;
+            break;
+        case 'b':
+            opt.flags &= ~SWF_OPTIMIZE_BITMAPS;
+            break;
+        case 'c':
+            if (strlen(optarg) != 1 || !strchr("FCZ", optarg[0])) {
+                usage(argv[0]);
+                return 1;
+            }
+            settings.compression = optarg[0];
+            break;
+        case 'l':
+            opt.level = settings.level = atoi(optarg);
+            break;
+        case 'j':
+            opt.threads = settings.threads = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *in_path = argv[optind], *out_path = argv[optind + 1];
+
+    FILE *in = fopen(in_path, "rb");
+    if (!in) {
+        perror(in_path);
+        return 1;
+    }
+    SWFParser *parser = swf_parser_init();
+    SWF *swf = swf_parser_get_swf(parser);
+    SWFError ret = parse_file(parser, in);
+    long in_size = ftell(in);
+    fclose(in);
+    if (ret < 0) {
+        fprintf(stderr, "%s: %s\n", in_path, ret == SWF_INVALID && !swf_parser_get_error(parser)->text ?
+                "Truncated file" : swf_parser_get_error(parser)->text);
+        return 1;
+    }
+
+    unsigned nb_tags = swf->nb_tags;
+    if (opt.flags && (ret = swf_optimize(swf, &opt)) < 0) {
+        fprintf(stderr, "%s: %s\n", in_path, swf->err.text);
+        return 1;
+    }
+    if (!settings.compression)
+        settings.compression = swf->version >= 13 ? SWF_LZMA : swf->version >= 6 ? SWF_ZLIB : SWF_UNCOMPRESSED;
+
+    FILE *out = fopen(out_path, "wb");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    SWFWriterOutput output = { .write = write_cb, .seek = seek_cb, .ctx = out };
+    SWFWriter *writer = swf_writer_init(&output, &settings);
+    if (!writer) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    if ((ret = swf_writer_write(writer, swf)) < 0) {
+        fprintf(stderr, "%s: %s\n", out_path, swf_writer_get_error(writer)->text);
+        return 1;
+    }
+    long out_size = ftell(out);
+    if (fclose(out)) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(stderr, "%s: %ld -> %ld bytes (%u tags removed)\n",
+            out_path, in_size, out_size, nb_tags - swf->nb_tags);
+
+    swf_writer_free(writer);
+    swf_parser_free(parser);
+    swf_free(swf);
+    return 0;
+}